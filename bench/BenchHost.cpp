@@ -0,0 +1,122 @@
+#include "BenchHost.h"
+#include "BenchRunner.h"
+#include <cstdarg>
+#include <cstdio>
+
+BenchHost g_BenchHost;
+SocketHost* g_SocketHost = &g_BenchHost;
+
+// Every bench callback belongs to the same pretend plugin
+static IPluginContext s_BenchContext;
+
+IPluginContext* GetBenchContext() {
+	return &s_BenchContext;
+}
+
+BenchArgs::Arg* BenchCallback::Next() {
+	if (m_args.m_count >= BenchArgs::kMaxArgs) {
+		return nullptr;
+	}
+	BenchArgs::Arg* arg = &m_args.m_args[m_args.m_count++];
+	*arg = BenchArgs::Arg();
+	return arg;
+}
+
+int BenchCallback::PushCell(cell_t cell) {
+	BenchArgs::Arg* arg = Next();
+	if (!arg) return 1;
+	arg->cell = cell;
+	return 0;
+}
+
+int BenchCallback::PushString(const char* string) {
+	BenchArgs::Arg* arg = Next();
+	if (!arg) return 1;
+	arg->string = string;
+	return 0;
+}
+
+int BenchCallback::PushStringEx(char* buffer, size_t length, int stringFlags, int copyFlags) {
+	BenchArgs::Arg* arg = Next();
+	if (!arg) return 1;
+	arg->string = buffer;
+	arg->length = length ? length - 1 : 0;
+	return 0;
+}
+
+int BenchCallback::Execute(cell_t* result) {
+	if (m_function) {
+		m_function(m_args);
+	}
+	m_args.m_count = 0;
+	if (result) {
+		*result = 0;
+	}
+	return 0;
+}
+
+IPluginContext* BenchCallback::GetParentContext() {
+	return &s_BenchContext;
+}
+
+void BenchHost::SetConfigValue(const char* key, std::string value) {
+	m_config[key] = std::move(value);
+}
+
+const char* BenchHost::GetConfigValue(const char* key) {
+	auto it = m_config.find(key);
+	return it != m_config.end() ? it->second.c_str() : nullptr;
+}
+
+void BenchHost::LogError(const char* format, ...) {
+	m_errors.fetch_add(1, std::memory_order_relaxed);
+
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+Handle_t BenchHost::CreateSocketHandle(SocketBase* socket, IPluginFunction* owner) {
+	return AddSocket(socket);
+}
+
+void BenchHost::FreeSocketHandle(SocketBase* socket, IPluginFunction* owner) {
+	CloseSocket(static_cast<Handle_t>(socket->m_smHandle));
+}
+
+Handle_t BenchHost::AddSocket(SocketBase* socket) {
+	if (!m_freeHandles.empty()) {
+		Handle_t handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+		m_sockets[handle - 1] = socket;
+		return handle;
+	}
+	m_sockets.push_back(socket);
+	return static_cast<Handle_t>(m_sockets.size());
+}
+
+SocketBase* BenchHost::GetSocket(Handle_t handle) const {
+	if (handle == 0 || handle > m_sockets.size()) {
+		return nullptr;
+	}
+	return m_sockets[handle - 1];
+}
+
+void BenchHost::CloseSocket(Handle_t handle) {
+	SocketBase* socket = GetSocket(handle);
+	if (!socket) return;
+
+	m_sockets[handle - 1] = nullptr;
+	m_freeHandles.push_back(handle);
+	g_SocketManager.DestroySocket(socket);
+}
+
+void BenchHost::CloseAll() {
+	for (size_t i = 0; i < m_sockets.size(); ++i) {
+		if (m_sockets[i]) {
+			CloseSocket(static_cast<Handle_t>(i + 1));
+		}
+	}
+}
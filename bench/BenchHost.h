@@ -0,0 +1,117 @@
+#pragma once
+
+#include "core/SocketHost.h"
+#include "core/SocketManager.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Arguments pushed to a BenchCallback, in push order.
+ */
+class BenchArgs {
+public:
+	static constexpr size_t kMaxArgs = 8;
+
+	[[nodiscard]] cell_t Cell(size_t index) const { return m_args[index].cell; }
+	[[nodiscard]] const char* String(size_t index) const { return m_args[index].string; }
+	// Bytes of a PushStringEx buffer, without the terminator
+	[[nodiscard]] size_t Length(size_t index) const { return m_args[index].length; }
+
+private:
+	friend class BenchCallback;
+
+	struct Arg {
+		cell_t cell = 0;
+		const char* string = nullptr;
+		size_t length = 0;
+	};
+
+	Arg m_args[kMaxArgs];
+	size_t m_count = 0;
+};
+
+/**
+ * IPluginFunction that runs a C++ function, standing in for a plugin
+ * callback. Arguments follow the natives' callback signatures in
+ * socket.inc, e.g. Receive is (socket, data, size, address, port, data).
+ *
+ * Strings point into the core's buffers and are valid during the call only.
+ */
+class BenchCallback : public IPluginFunction {
+public:
+	using Function = std::function<void(const BenchArgs& args)>;
+
+	BenchCallback() = default;
+	explicit BenchCallback(Function function) : m_function(std::move(function)) {}
+
+	void Set(Function function) { m_function = std::move(function); }
+
+	int PushCell(cell_t cell) override;
+	int PushString(const char* string) override;
+	int PushStringEx(char* buffer, size_t length, int stringFlags, int copyFlags) override;
+	int Execute(cell_t* result) override;
+	IPluginContext* GetParentContext() override;
+
+private:
+	BenchArgs::Arg* Next();
+
+	Function m_function;
+	BenchArgs m_args;
+};
+
+/**
+ * Host services for the benchmark harness.
+ *
+ * Handles are indexes into a socket table, so callbacks can map the
+ * handles they are given back to sockets the way natives do.
+ */
+class BenchHost : public SocketHost {
+public:
+	void SetConfigValue(const char* key, std::string value);
+
+	const char* GetConfigValue(const char* key) override;
+	void LogError(const char* format, ...) override;
+	Handle_t CreateSocketHandle(SocketBase* socket, IPluginFunction* owner) override;
+	void FreeSocketHandle(SocketBase* socket, IPluginFunction* owner) override;
+
+	/**
+	 * Create a socket with a handle, like Socket() in a plugin.
+	 */
+	template<typename T>
+	T* CreateSocket();
+
+	[[nodiscard]] SocketBase* GetSocket(Handle_t handle) const;
+
+	/**
+	 * Destroy the socket behind handle, like CloseHandle in a plugin.
+	 */
+	void CloseSocket(Handle_t handle);
+
+	// Destroy every socket that still has a handle
+	void CloseAll();
+
+	[[nodiscard]] size_t GetOpenCount() const { return m_sockets.size() - m_freeHandles.size(); }
+	[[nodiscard]] size_t GetErrorCount() const { return m_errors.load(std::memory_order_relaxed); }
+
+private:
+	Handle_t AddSocket(SocketBase* socket);
+
+	std::unordered_map<std::string, std::string> m_config;
+	// Handle n is m_sockets[n - 1], nullptr once closed
+	std::vector<SocketBase*> m_sockets;
+	std::vector<Handle_t> m_freeHandles;
+	std::atomic<size_t> m_errors{0};
+};
+
+extern BenchHost g_BenchHost;
+
+template<typename T>
+T* BenchHost::CreateSocket() {
+	T* socket = g_SocketManager.CreateSocket<T>();
+	socket->m_smHandle = AddSocket(socket);
+	return socket;
+}
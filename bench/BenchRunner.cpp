@@ -0,0 +1,107 @@
+#include "BenchRunner.h"
+#include "core/CallbackManager.h"
+#include "core/HttpClient.h"
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <thread>
+
+static std::deque<std::unique_ptr<BenchCallback>> s_callbacks;
+
+void BenchResult::Fail(std::string reason) {
+	if (ok) {
+		ok = false;
+		error = std::move(reason);
+	}
+}
+
+double Now() {
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+void RunFrame(const BenchOptions& options) {
+	const auto start = std::chrono::steady_clock::now();
+
+	g_CallbackManager.ProcessPendingCallbacks();
+	g_HttpClient.ProcessCompletions();
+
+	if (options.frameMicroseconds > 0) {
+		std::this_thread::sleep_until(start + std::chrono::microseconds(options.frameMicroseconds));
+	} else {
+		std::this_thread::yield();
+	}
+}
+
+bool RunUntil(const BenchOptions& options, const std::function<bool()>& done) {
+	const double deadline = Now() + options.timeoutSeconds;
+	while (!done()) {
+		if (Now() > deadline) {
+			return false;
+		}
+		RunFrame(options);
+	}
+	return true;
+}
+
+bool Await(const BenchOptions& options, BenchResult& result, const char* what, const std::function<bool()>& done) {
+	if (!RunUntil(options, [&]() { return !result.ok || done(); })) {
+		result.Fail(std::string("Timed out waiting for ") + what);
+	}
+	return result.ok;
+}
+
+bool Expect(BenchResult& result, bool condition, const std::string& reason) {
+	if (!condition) {
+		result.Fail(reason);
+	}
+	return result.ok;
+}
+
+void RunFor(const BenchOptions& options, double seconds) {
+	const double end = Now() + seconds;
+	while (Now() < end) {
+		RunFrame(options);
+	}
+}
+
+uint16_t ListenLocal(const BenchOptions& options, SocketBase* socket, BenchResult& result) {
+	uint16_t port = 0;
+	BenchCallback* onListen = MakeCallback([&port](const BenchArgs& args) {
+		port = static_cast<uint16_t>(args.Cell(2));
+	});
+	SetCallback(socket, CallbackEvent::Listen, onListen);
+	TrapErrors(socket, result);
+
+	if (!socket->Bind("127.0.0.1", 0, false) || !socket->Listen()) {
+		result.Fail("Could not listen on 127.0.0.1");
+	} else if (!RunUntil(options, [&]() { return port != 0 || !result.ok; })) {
+		result.Fail("Timed out waiting for the listener");
+	}
+
+	SetCallback(socket, CallbackEvent::Listen, nullptr);
+	return result.ok ? port : 0;
+}
+
+BenchCallback* MakeCallback(BenchCallback::Function function) {
+	s_callbacks.push_back(std::make_unique<BenchCallback>(std::move(function)));
+	return s_callbacks.back().get();
+}
+
+void ReleaseCallbacks() {
+	s_callbacks.clear();
+}
+
+void RecordLatency(BenchResult& result, const char* prefix, const LatencyHistogram& histogram) {
+	const std::string name(prefix);
+	result.Metric((name + "_p50_us").c_str(), histogram.Percentile(0.5) / 1000.0);
+	result.Metric((name + "_p99_us").c_str(), histogram.Percentile(0.99) / 1000.0);
+	result.Metric((name + "_p999_us").c_str(), histogram.Percentile(0.999) / 1000.0);
+	result.Metric((name + "_max_us").c_str(), histogram.GetMax() / 1000.0);
+}
+
+void TrapErrors(SocketBase* socket, BenchResult& result) {
+	SetCallback(socket, CallbackEvent::Error, MakeCallback([&result](const BenchArgs& args) {
+		result.Fail(std::string("Socket error: ") + args.String(2));
+	}));
+}
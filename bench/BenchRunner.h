@@ -0,0 +1,139 @@
+#pragma once
+
+#include "BenchHost.h"
+#include "core/LatencyHistogram.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Command line settings shared by all benchmarks.
+ */
+struct BenchOptions {
+	// Event loops of the current run, as the SocketEventLoops core.cfg key
+	size_t loops = 1;
+	// Messages per run, scaled down by the slower round trip benchmarks
+	size_t messages = 100000;
+	size_t messageSize = 256;
+	// Parallel connections (streams) or in-flight requests (HTTP)
+	size_t connections = 8;
+	// Destinations of the UDP fan-out benchmarks
+	size_t targets = 64;
+	// Game frame pacing, 0 runs frames back to back
+	int frameMicroseconds = 0;
+	int callbacksPerFrame = 1024;
+	double timeoutSeconds = 30.0;
+};
+
+/**
+ * Outcome of one benchmark, written out as one JSON object.
+ */
+struct BenchResult {
+	std::string name;
+	// Event loops the run had
+	size_t loops = 1;
+	bool ok = true;
+	std::string error;
+	std::vector<std::pair<std::string, double>> params;
+	std::vector<std::pair<std::string, double>> metrics;
+
+	void Param(const char* key, double value) { params.emplace_back(key, value); }
+	void Metric(const char* key, double value) { metrics.emplace_back(key, value); }
+
+	// Mark the run failed, keeps the first reason
+	void Fail(std::string reason);
+};
+
+struct Benchmark {
+	const char* name;
+	const char* description;
+	void (*run)(const BenchOptions& options, BenchResult& result);
+};
+
+/**
+ * One game frame: run due socket callbacks and HTTP completions.
+ */
+void RunFrame(const BenchOptions& options);
+
+/**
+ * Run frames until done returns true.
+ *
+ * @return false if options.timeoutSeconds passed first
+ */
+bool RunUntil(const BenchOptions& options, const std::function<bool()>& done);
+
+/**
+ * Run frames until done returns true, failing result on timeout.
+ *
+ * @param what What is awaited, for the failure message
+ * @return false if result failed, now or before
+ */
+bool Await(const BenchOptions& options, BenchResult& result, const char* what, const std::function<bool()>& done);
+
+/**
+ * Fail result with reason unless condition holds, for the protocol checks.
+ *
+ * @return false if result failed, now or before
+ */
+bool Expect(BenchResult& result, bool condition, const std::string& reason);
+
+/**
+ * Run frames for a while, letting closes and late events settle.
+ */
+void RunFor(const BenchOptions& options, double seconds);
+
+/**
+ * Seconds on a monotonic clock.
+ */
+[[nodiscard]] double Now();
+
+/**
+ * Bind socket to 127.0.0.1 on an ephemeral port and listen.
+ *
+ * @return Port, 0 on failure with the reason in result
+ */
+uint16_t ListenLocal(const BenchOptions& options, SocketBase* socket, BenchResult& result);
+
+/**
+ * Callback kept alive until the running benchmark's sockets are closed,
+ * so late events never reach a destroyed callback.
+ */
+BenchCallback* MakeCallback(BenchCallback::Function function);
+
+// Free the callbacks of the last benchmark (after its sockets are gone)
+void ReleaseCallbacks();
+
+// Context of every BenchCallback, for HttpClient::CancelRequests
+IPluginContext* GetBenchContext();
+
+inline void SetCallback(SocketBase* socket, CallbackEvent event, BenchCallback* callback) {
+	socket->GetCallback(event).function = callback;
+}
+
+/**
+ * Fail result on the socket's first error.
+ */
+void TrapErrors(SocketBase* socket, BenchResult& result);
+
+/**
+ * Add p50, p99, p99.9 and max of a nanosecond histogram as
+ * <prefix>_p50_us and so on.
+ */
+void RecordLatency(BenchResult& result, const char* prefix, const LatencyHistogram& histogram);
+
+// Benchmarks, see the table in socket_bench.cpp
+void BenchJobQueue(const BenchOptions& options, BenchResult& result);
+void BenchFootprint(const BenchOptions& options, BenchResult& result);
+void BenchTcpThroughput(const BenchOptions& options, BenchResult& result);
+void BenchTcpLatency(const BenchOptions& options, BenchResult& result);
+void BenchTcpChurn(const BenchOptions& options, BenchResult& result);
+void BenchWebSocketEcho(const BenchOptions& options, BenchResult& result);
+void BenchUdpThroughput(const BenchOptions& options, BenchResult& result);
+void BenchUdpSendTo(const BenchOptions& options, BenchResult& result);
+void BenchUdpSendToMany(const BenchOptions& options, BenchResult& result);
+void BenchHttpKeepAlive(const BenchOptions& options, BenchResult& result);
+void BenchHttpProtocol(const BenchOptions& options, BenchResult& result);
+void BenchWebSocketProtocol(const BenchOptions& options, BenchResult& result);
@@ -0,0 +1,200 @@
+#include "BenchRunner.h"
+#include "socket/UdpSocket.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Datagrams allowed in flight before the sender waits for the receivers
+static constexpr size_t kDatagramWindow = 4096;
+// Receivers quiet for this long while datagrams are missing means loss
+static constexpr double kLossTimeout = 0.2;
+
+/**
+ * Paces a UDP sender against what its receivers got so far. Datagrams
+ * that were lost stop counting against the window once the receivers
+ * have been quiet for kLossTimeout.
+ */
+class DatagramFlow {
+public:
+	DatagramFlow(size_t total, size_t window) : m_total(total), m_window(window) {}
+
+	void OnReceive() {
+		++m_received;
+		m_lastProgress = Now();
+	}
+
+	void OnSent(size_t count) {
+		m_sent += count;
+		if (m_sent == count) {
+			m_lastProgress = Now();
+		}
+	}
+
+	// Datagrams the sender may send now
+	[[nodiscard]] size_t Credit() {
+		Settle();
+		// Late arrivals of forgiven datagrams must not wrap the count
+		size_t inFlight = m_sent - std::min(m_sent, m_received + m_forgiven);
+		size_t credit = inFlight < m_window ? m_window - inFlight : 0;
+		return std::min(credit, m_total - m_sent);
+	}
+
+	// Everything was sent and has arrived or is given up on
+	[[nodiscard]] bool IsDone() {
+		Settle();
+		return m_sent == m_total && m_received + m_forgiven >= m_sent;
+	}
+
+	[[nodiscard]] size_t GetReceived() const { return m_received; }
+	[[nodiscard]] double GetLastReceive() const { return m_lastProgress; }
+
+private:
+	void Settle() {
+		if (m_sent > m_received + m_forgiven && Now() - m_lastProgress > kLossTimeout) {
+			m_forgiven = m_sent - m_received;
+		}
+	}
+
+	size_t m_total;
+	size_t m_window;
+	size_t m_sent = 0;
+	size_t m_received = 0;
+	size_t m_forgiven = 0;
+	double m_lastProgress = 0;
+};
+
+/**
+ * Bind count receivers to ephemeral ports on 127.0.0.1, all sharing onReceive.
+ *
+ * @return Their ports, empty on failure
+ */
+static std::vector<uint16_t> OpenReceivers(const BenchOptions& options, BenchResult& result, size_t count,
+	BenchCallback* onReceive) {
+	std::vector<uint16_t> ports;
+	for (size_t i = 0; i < count; ++i) {
+		UdpSocket* receiver = g_BenchHost.CreateSocket<UdpSocket>();
+		receiver->SetOption(SocketOption::ReceiveBuffer, 4 * 1024 * 1024);
+		SetCallback(receiver, CallbackEvent::Receive, onReceive);
+
+		uint16_t port = ListenLocal(options, receiver, result);
+		if (!port) {
+			return {};
+		}
+		ports.push_back(port);
+	}
+	return ports;
+}
+
+static void RecordDelivery(BenchResult& result, DatagramFlow& flow, size_t total, size_t size, double start) {
+	const double elapsed = std::max(flow.GetLastReceive() - start, 1e-9);
+	const size_t received = flow.GetReceived();
+
+	result.Metric("seconds", elapsed);
+	result.Metric("datagrams_per_s", received / elapsed);
+	result.Metric("mb_per_s", static_cast<double>(received) * size / elapsed / 1e6);
+	result.Metric("loss_pct", 100.0 * (total - std::min(received, total)) / total);
+}
+
+void BenchUdpThroughput(const BenchOptions& options, BenchResult& result) {
+	const size_t total = std::max<size_t>(options.messages, 1);
+	const std::string payload(std::clamp<size_t>(options.messageSize, 1, 65000), 'x');
+
+	result.Param("datagrams", static_cast<double>(total));
+	result.Param("message_size", static_cast<double>(payload.size()));
+
+	DatagramFlow flow(total, kDatagramWindow);
+	BenchCallback* onReceive = MakeCallback([&flow](const BenchArgs& args) { flow.OnReceive(); });
+	std::vector<uint16_t> ports = OpenReceivers(options, result, 1, onReceive);
+	if (ports.empty()) return;
+
+	UdpSocket* sender = g_BenchHost.CreateSocket<UdpSocket>();
+	TrapErrors(sender, result);
+
+	const double start = Now();
+	bool done = RunUntil(options, [&]() {
+		for (size_t credit = flow.Credit(); credit && result.ok; --credit) {
+			if (!sender->SendTo(payload, "127.0.0.1", ports[0])) {
+				result.Fail("SendTo failed");
+			}
+			flow.OnSent(1);
+		}
+		return flow.IsDone() || !result.ok;
+	});
+
+	if (!done) {
+		result.Fail("Timed out after " + std::to_string(flow.GetReceived()) + " of " + std::to_string(total) + " datagrams");
+	}
+	if (!result.ok) return;
+
+	RecordDelivery(result, flow, total, payload.size(), start);
+}
+
+/**
+ * Send one payload to options.targets receivers, round after round, with
+ * one SendToMany per round or one SendTo per destination.
+ */
+static void RunFanOut(const BenchOptions& options, BenchResult& result, bool batched) {
+	const size_t targetCount = std::max<size_t>(options.targets, 1);
+	const size_t rounds = std::max<size_t>(options.messages / targetCount, 1);
+	const size_t total = rounds * targetCount;
+	const std::string payload(std::clamp<size_t>(options.messageSize, 1, 65000), 'x');
+
+	result.Param("targets", static_cast<double>(targetCount));
+	result.Param("rounds", static_cast<double>(rounds));
+	result.Param("message_size", static_cast<double>(payload.size()));
+
+	// A round is sent whole, so the window holds at least one
+	DatagramFlow flow(total, std::max(kDatagramWindow, targetCount));
+	BenchCallback* onReceive = MakeCallback([&flow](const BenchArgs& args) { flow.OnReceive(); });
+	std::vector<uint16_t> ports = OpenReceivers(options, result, targetCount, onReceive);
+	if (ports.empty()) return;
+
+	std::vector<DatagramTarget> targets;
+	for (uint16_t port : ports) {
+		targets.push_back({"127.0.0.1", port});
+	}
+
+	UdpSocket* sender = g_BenchHost.CreateSocket<UdpSocket>();
+	TrapErrors(sender, result);
+
+	// Game thread time spent inside the send calls
+	double sendSeconds = 0;
+
+	const double start = Now();
+	bool done = RunUntil(options, [&]() {
+		while (flow.Credit() >= targetCount && result.ok) {
+			const double callStart = Now();
+			if (batched) {
+				if (sender->SendToMany(payload, targets.data(), targets.size()) != targets.size()) {
+					result.Fail("SendToMany failed");
+				}
+			} else {
+				for (const DatagramTarget& target : targets) {
+					if (!sender->SendTo(payload, target.host, target.port)) {
+						result.Fail("SendTo failed");
+						break;
+					}
+				}
+			}
+			sendSeconds += Now() - callStart;
+			flow.OnSent(targetCount);
+		}
+		return flow.IsDone() || !result.ok;
+	});
+
+	if (!done) {
+		result.Fail("Timed out after " + std::to_string(flow.GetReceived()) + " of " + std::to_string(total) + " datagrams");
+	}
+	if (!result.ok) return;
+
+	RecordDelivery(result, flow, total, payload.size(), start);
+	result.Metric("send_call_ns_per_datagram", sendSeconds * 1e9 / total);
+}
+
+void BenchUdpSendTo(const BenchOptions& options, BenchResult& result) {
+	RunFanOut(options, result, false);
+}
+
+void BenchUdpSendToMany(const BenchOptions& options, BenchResult& result) {
+	RunFanOut(options, result, true);
+}
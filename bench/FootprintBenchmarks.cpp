@@ -0,0 +1,201 @@
+#include "BenchRunner.h"
+#include "core/CallbackManager.h"
+#include "core/SendRequest.h"
+#include "lockfree/QueueTypes.h"
+#include "socket/TcpSocket.h"
+#include "socket/UdpSocket.h"
+#ifndef _WIN32
+#include "socket/UnixSocket.h"
+#endif
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Sockets held open at once, clients and their accepted peers together
+static constexpr size_t kFootprintSockets = 10000;
+// Connects in flight, kept below the listen backlog
+static constexpr size_t kConnectWindow = 128;
+// Descriptors left for the listener, loops and stdio
+static constexpr size_t kReservedDescriptors = 64;
+
+/**
+ * Bytes of heap in use, -1 where the allocator cannot tell.
+ */
+static double HeapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	// Sums every arena, so allocations on the UV threads count too
+	struct mallinfo2 info = mallinfo2();
+	return static_cast<double>(info.uordblks + info.hblkhd);
+#else
+	return -1;
+#endif
+}
+
+/**
+ * Resident set size in bytes, -1 where unknown.
+ */
+static double ResidentSize() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return static_cast<double>(counters.WorkingSetSize);
+	}
+	return -1;
+#else
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (!statm) return -1;
+
+	unsigned long size = 0;
+	unsigned long resident = 0;
+	int fields = fscanf(statm, "%lu %lu", &size, &resident);
+	fclose(statm);
+	return fields == 2 ? static_cast<double>(resident) * sysconf(_SC_PAGESIZE) : -1;
+#endif
+}
+
+/**
+ * Raise the descriptor limit as far as allowed.
+ *
+ * @return Sockets that fit, at most kFootprintSockets
+ */
+static size_t ReserveDescriptors() {
+#ifdef _WIN32
+	return kFootprintSockets;
+#else
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+		return 0;
+	}
+	if (limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+		getrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur >= kFootprintSockets + kReservedDescriptors) {
+		return kFootprintSockets;
+	}
+	return limit.rlim_cur > kReservedDescriptors ? static_cast<size_t>(limit.rlim_cur) - kReservedDescriptors : 0;
+#endif
+}
+
+struct MemorySample {
+	double heap;
+	double resident;
+};
+
+static MemorySample SampleMemory(const BenchOptions& options) {
+	// Let closes, accepts and recycled buffers settle first
+	RunFor(options, 0.2);
+	return {HeapInUse(), ResidentSize()};
+}
+
+static void RecordGrowth(BenchResult& result, const char* prefix, const MemorySample& before,
+	const MemorySample& after, size_t sockets) {
+	const std::string name(prefix);
+	if (before.heap >= 0 && after.heap >= 0) {
+		result.Metric((name + "_heap_bytes_per_socket").c_str(), (after.heap - before.heap) / sockets);
+	}
+	if (before.resident >= 0 && after.resident >= 0) {
+		result.Metric((name + "_rss_bytes_per_socket").c_str(), (after.resident - before.resident) / sockets);
+	}
+}
+
+void BenchFootprint(const BenchOptions& options, BenchResult& result) {
+	result.Metric("tcp_socket_bytes", sizeof(TcpSocket));
+	result.Metric("udp_socket_bytes", sizeof(UdpSocket));
+#ifndef _WIN32
+	result.Metric("unix_socket_bytes", sizeof(UnixSocket));
+#endif
+	result.Metric("event_queue_bytes", sizeof(SocketEventQueue));
+	result.Metric("event_node_bytes", sizeof(EventNode));
+	result.Metric("send_request_bytes", sizeof(SendRequest));
+	result.Metric("async_job_bytes", sizeof(AsyncJob));
+
+	// Half the sockets connect, the other half are their accepted peers
+	const size_t pairs = ReserveDescriptors() / 2;
+	if (pairs < kConnectWindow) {
+		result.Fail("Descriptor limit too low for the footprint run");
+		return;
+	}
+	const size_t sockets = pairs * 2;
+	const std::string payload(std::max<size_t>(options.messageSize, 1), 'x');
+
+	result.Param("sockets", static_cast<double>(sockets));
+	result.Param("message_size", static_cast<double>(payload.size()));
+
+	size_t accepted = 0;
+	size_t connected = 0;
+	size_t received = 0;
+
+	BenchCallback* onReceive = MakeCallback([&received](const BenchArgs& args) {
+		received += static_cast<size_t>(args.Cell(2));
+	});
+	BenchCallback* onIncoming = MakeCallback([&](const BenchArgs& args) {
+		if (SocketBase* peer = g_BenchHost.GetSocket(args.Cell(1))) {
+			SetCallback(peer, CallbackEvent::Receive, onReceive);
+			TrapErrors(peer, result);
+		}
+		++accepted;
+	});
+	BenchCallback* onConnect = MakeCallback([&connected](const BenchArgs& args) { ++connected; });
+
+	TcpSocket* listener = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(listener, CallbackEvent::Incoming, onIncoming);
+	uint16_t port = ListenLocal(options, listener, result);
+	if (!port) return;
+
+	const MemorySample empty = SampleMemory(options);
+
+	std::vector<TcpSocket*> clients;
+	clients.reserve(pairs);
+	bool done = RunUntil(options, [&]() {
+		while (clients.size() < pairs && clients.size() - connected < kConnectWindow && result.ok) {
+			TcpSocket* client = g_BenchHost.CreateSocket<TcpSocket>();
+			SetCallback(client, CallbackEvent::Connect, onConnect);
+			TrapErrors(client, result);
+			if (!client->Connect("127.0.0.1", port)) {
+				result.Fail("Connect failed");
+			}
+			clients.push_back(client);
+		}
+		return (connected >= pairs && accepted >= pairs) || !result.ok;
+	});
+	if (!done) {
+		result.Fail("Timed out after " + std::to_string(connected) + " of " + std::to_string(pairs) + " connections");
+	}
+	if (!result.ok) return;
+
+	// Connected but never used
+	const MemorySample idle = SampleMemory(options);
+	RecordGrowth(result, "idle", empty, idle, sockets);
+
+	// One message per connection puts receive slabs and send requests in
+	// the pools, which stay cached after the connections go quiet again
+	const size_t expected = pairs * payload.size();
+	for (TcpSocket* client : clients) {
+		if (!client->Send(payload)) {
+			result.Fail("Send failed");
+			return;
+		}
+	}
+	if (!RunUntil(options, [&]() { return received >= expected || !result.ok; })) {
+		result.Fail("Timed out after " + std::to_string(received) + " of " + std::to_string(expected) + " bytes");
+	}
+	if (!result.ok) return;
+
+	const MemorySample used = SampleMemory(options);
+	RecordGrowth(result, "used", empty, used, sockets);
+}
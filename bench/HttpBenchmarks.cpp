@@ -0,0 +1,92 @@
+#include "BenchRunner.h"
+#include "core/HttpClient.h"
+#include "socket/TcpSocket.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+void BenchHttpKeepAlive(const BenchOptions& options, BenchResult& result) {
+	const size_t total = std::max<size_t>(options.messages / 10, 1);
+	const size_t concurrency = std::max<size_t>(options.connections, 1);
+	const std::string body(options.messageSize, 'x');
+
+	result.Param("requests", static_cast<double>(total));
+	result.Param("concurrency", static_cast<double>(concurrency));
+	result.Param("body_size", static_cast<double>(body.size()));
+
+	// Stand-in server: answers every request head it sees with the same response
+	const std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " +
+		std::to_string(body.size()) + "\r\n\r\n" + body;
+	std::unordered_map<cell_t, std::string> requests;
+
+	BenchCallback* onRequest = MakeCallback([&](const BenchArgs& args) {
+		SocketBase* peer = g_BenchHost.GetSocket(args.Cell(0));
+		if (!peer) return;
+
+		std::string& buffer = requests[args.Cell(0)];
+		buffer.append(args.String(1), args.Length(1));
+		size_t end;
+		while ((end = buffer.find("\r\n\r\n")) != std::string::npos) {
+			buffer.erase(0, end + 4);
+			if (!peer->Send(response)) {
+				result.Fail("Response send failed");
+			}
+		}
+	});
+	BenchCallback* onIncoming = MakeCallback([&](const BenchArgs& args) {
+		if (SocketBase* peer = g_BenchHost.GetSocket(args.Cell(1))) {
+			SetCallback(peer, CallbackEvent::Receive, onRequest);
+		}
+	});
+
+	TcpSocket* listener = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(listener, CallbackEvent::Incoming, onIncoming);
+	uint16_t port = ListenLocal(options, listener, result);
+	if (!port) return;
+
+	const std::string url = "http://127.0.0.1:" + std::to_string(port) + "/bench";
+	g_GlobalOptions.Set(SocketOption::HttpMaxConnections, static_cast<int>(concurrency));
+
+	LatencyHistogram latency;
+	std::vector<uint64_t> startTimes(total);
+	size_t started = 0;
+	size_t completed = 0;
+
+	// (status, headers, body, size, error, data)
+	BenchCallback* onResponse = MakeCallback([&](const BenchArgs& args) {
+		if (args.Cell(0) != 200) {
+			result.Fail("HTTP request failed: status " + std::to_string(args.Cell(0)) + " " + args.String(4));
+		} else if (args.Length(2) != body.size()) {
+			result.Fail("HTTP response body was truncated");
+		}
+		latency.Record(uv_hrtime() - startTimes[static_cast<size_t>(args.Cell(5))]);
+		++completed;
+	});
+
+	const double start = Now();
+	bool done = RunUntil(options, [&]() {
+		while (started < total && started - completed < concurrency && result.ok) {
+			const char* error = nullptr;
+			startTimes[started] = uv_hrtime();
+			if (!g_HttpClient.Request("GET", url, std::string_view(), std::string_view(), onResponse,
+				static_cast<cell_t>(started), error)) {
+				result.Fail(error ? error : "Request could not be queued");
+			}
+			++started;
+		}
+		return completed >= total || !result.ok;
+	});
+	const double elapsed = Now() - start;
+
+	g_GlobalOptions.Set(SocketOption::HttpMaxConnections, 0);
+
+	if (!done) {
+		result.Fail("Timed out after " + std::to_string(completed) + " of " + std::to_string(total) + " requests");
+	}
+	if (!result.ok) return;
+
+	result.Metric("seconds", elapsed);
+	result.Metric("requests_per_s", total / elapsed);
+	RecordLatency(result, "request", latency);
+}
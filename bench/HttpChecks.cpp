@@ -0,0 +1,435 @@
+#include "BenchRunner.h"
+#include "core/HttpClient.h"
+#include "core/HttpResponseParser.h"
+#include "socket/TcpSocket.h"
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using ParseResult = HttpResponseParser::Result;
+
+// Inputs up to this size are also split at every offset and fed bytewise
+static constexpr size_t kMaxSplitInput = 512;
+static constexpr int kPipelineDepth = 4;
+
+static std::string Reply(const std::string& body, const char* headers = "") {
+	return "HTTP/1.1 200 OK\r\n" + std::string(headers) + "Content-Length: " + std::to_string(body.size()) +
+		"\r\n\r\n" + body;
+}
+
+/**
+ * One response as HttpResponseParser should see it.
+ */
+struct ParserCase {
+	const char* name;
+	std::string bytes;
+	bool head;
+	int status;
+	std::string body;
+	bool keepAlive;
+	// Bytes of the next response at the end of bytes, left unconsumed
+	size_t trailing;
+	// The body runs until the connection closes
+	bool untilClose;
+	// Body of the complete response in the trailing bytes, if any
+	const char* next = nullptr;
+};
+
+/**
+ * Feed bytes in the reads given by cuts, stopping at the end of the
+ * response as HttpClient does.
+ */
+static ParseResult FeedReads(HttpResponseParser& parser, std::string_view bytes, const std::vector<size_t>& cuts,
+	size_t& consumed) {
+	consumed = 0;
+	size_t start = 0;
+	for (size_t i = 0; i <= cuts.size(); ++i) {
+		const size_t end = i < cuts.size() ? cuts[i] : bytes.size();
+		while (start < end) {
+			size_t used = 0;
+			ParseResult state = parser.Feed(bytes.data() + start, end - start, used);
+			start += used;
+			consumed += used;
+			if (state != ParseResult::NeedMore) {
+				return state;
+			}
+			if (used == 0) break;
+		}
+		start = end;
+	}
+	return ParseResult::NeedMore;
+}
+
+// Cuts for whole, split at offset and bytewise feeds of size bytes
+static std::vector<std::vector<size_t>> Splits(size_t size) {
+	std::vector<std::vector<size_t>> splits{{}};
+	if (size > kMaxSplitInput) {
+		return splits;
+	}
+	for (size_t offset = 1; offset < size; ++offset) {
+		splits.push_back({offset});
+	}
+	std::vector<size_t> bytewise;
+	for (size_t offset = 1; offset < size; ++offset) {
+		bytewise.push_back(offset);
+	}
+	splits.push_back(std::move(bytewise));
+	return splits;
+}
+
+static std::string Where(const char* name, const std::vector<size_t>& cuts) {
+	if (cuts.empty()) return std::string(name) + " (whole)";
+	if (cuts.size() == 1) return std::string(name) + " (split at " + std::to_string(cuts[0]) + ")";
+	return std::string(name) + " (bytewise)";
+}
+
+static void CheckParserResponses(BenchResult& result, size_t& cases, size_t& splits) {
+	const ParserCase responses[] = {
+		{"chunked with extensions and trailers",
+			"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+			"5;name=value\r\nHello\r\n7\r\n, world\r\n0\r\nX-Checksum: 1\r\n\r\nHTTP/1.1",
+			false, 200, "Hello, world", true, 8, false},
+		{"interim responses",
+			"HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 103 Early Hints\r\nLink: </style.css>\r\n\r\n" + Reply("final"),
+			false, 200, "final", true, 0, false},
+		{"204", "HTTP/1.1 204 No Content\r\nContent-Length: 5\r\n\r\n", false, 204, "", true, 0, false},
+		{"HEAD", "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n", true, 200, "", true, 0, false},
+		{"Connection: close", Reply("bye", "Connection: close\r\n"), false, 200, "bye", false, 0, false},
+		{"HTTP/1.0", "HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok", false, 200, "ok", false, 0, false},
+		{"read until close", "HTTP/1.1 200 OK\r\n\r\nuntil close", false, 200, "until close", false, 0, true},
+		{"pipelined", Reply("first") + Reply("second"), false, 200, "first", true, Reply("second").size(), false, "second"},
+	};
+
+	HttpResponseParser parser;
+	for (const ParserCase& response : responses) {
+		for (const std::vector<size_t>& cuts : Splits(response.bytes.size())) {
+			const std::string where = Where(response.name, cuts);
+			size_t consumed = 0;
+			parser.Reset(response.head);
+			ParseResult state = FeedReads(parser, response.bytes, cuts, consumed);
+			if (response.untilClose) {
+				if (!Expect(result, state == ParseResult::NeedMore, where + ": ended before the close")) return;
+				state = parser.Finish();
+			}
+
+			if (!Expect(result, state == ParseResult::Complete,
+					where + ": " + (parser.GetError() ? parser.GetError() : "incomplete")) ||
+				!Expect(result, consumed == response.bytes.size() - response.trailing,
+					where + ": consumed " + std::to_string(consumed) + " bytes") ||
+				!Expect(result, parser.GetStatus() == response.status,
+					where + ": status " + std::to_string(parser.GetStatus())) ||
+				!Expect(result, parser.GetBody() == response.body, where + ": body \"" + parser.GetBody() + "\"") ||
+				!Expect(result, parser.IsKeepAlive() == response.keepAlive, where + ": wrong keep-alive") ||
+				!Expect(result, parser.GetHeaders().find("Link:") == std::string::npos,
+					where + ": interim headers leaked into the response")) {
+				return;
+			}
+
+			// The rest of a pipelined read is the next response
+			if (response.next) {
+				std::string_view rest = std::string_view(response.bytes).substr(consumed);
+				parser.Reset(false);
+				if (!Expect(result, FeedReads(parser, rest, {}, consumed) == ParseResult::Complete &&
+						parser.GetBody() == response.next, where + ": next response lost")) {
+					return;
+				}
+			}
+			++splits;
+		}
+		++cases;
+	}
+}
+
+static void CheckParserErrors(BenchResult& result, size_t& cases, size_t& splits) {
+	std::string longHeaders = "HTTP/1.1 200 OK\r\n";
+	// Every line fits, together they do not (the status line is not counted)
+	for (size_t i = 0; longHeaders.size() <= HttpResponseParser::kMaxHeaderSize + 1024; ++i) {
+		longHeaders += "X-Filler-" + std::to_string(i) + ": " + std::string(1000, 'x') + "\r\n";
+	}
+	longHeaders += "\r\n";
+
+	const struct {
+		const char* name;
+		std::string bytes;
+		const char* error;
+	} errors[] = {
+		{"bad status", "HTTP/1.1 2x0 OK\r\n\r\n", "Malformed status line"},
+		{"bad version", "HTTP/2 200 OK\r\n\r\n", "Malformed status line"},
+		{"bad length", "HTTP/1.1 200 OK\r\nContent-Length: 1x\r\n\r\n", "Invalid Content-Length"},
+		{"two lengths", "HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+			"Conflicting Content-Length headers"},
+		{"bad chunk size", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", "Malformed chunk size"},
+		{"chunk overrun", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n", "Malformed chunked body"},
+		{"protocol switch", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n", "Unexpected protocol switch"},
+		{"header without colon", "HTTP/1.1 200 OK\r\nNo colon here\r\n\r\n", "Malformed response header"},
+		{"huge length", "HTTP/1.1 200 OK\r\nContent-Length: 99999999\r\n\r\n", "Response body is too large"},
+		{"long line", "HTTP/1.1 200 OK\r\nX-Long: " + std::string(HttpResponseParser::kMaxHeaderSize, 'x'),
+			"Response line is too long"},
+		{"long head", longHeaders, "Response headers are too large"},
+		{"cut short", Reply("hello").substr(0, Reply("hello").size() - 2),
+			"Connection closed before the response was complete"},
+	};
+
+	HttpResponseParser parser;
+	for (const auto& error : errors) {
+		for (const std::vector<size_t>& cuts : Splits(error.bytes.size())) {
+			const std::string where = Where(error.name, cuts);
+			size_t consumed = 0;
+			parser.Reset(false);
+			ParseResult state = FeedReads(parser, error.bytes, cuts, consumed);
+			if (state == ParseResult::NeedMore) {
+				state = parser.Finish();
+			}
+
+			if (!Expect(result, state == ParseResult::Error, where + ": no error") ||
+				!Expect(result, std::string(parser.GetError()) == error.error, where + ": " + parser.GetError()) ||
+				!Expect(result, !parser.IsKeepAlive(), where + ": connection kept after an error")) {
+				return;
+			}
+			++splits;
+		}
+		++cases;
+	}
+}
+
+/**
+ * Scripted HTTP server on its own port, so each case gets a connection
+ * pool of its own in HttpClient.
+ */
+struct StandIn {
+	struct Peer {
+		std::string buffer;
+		size_t answered = 0;
+		std::vector<std::string> held;
+	};
+	using Handler = std::function<void(SocketBase* socket, Peer& peer, const std::string& path)>;
+
+	uint16_t port = 0;
+	size_t connections = 0;
+	std::unordered_map<cell_t, Peer> peers;
+	Handler handler;
+
+	[[nodiscard]] std::string Url(const char* path) const {
+		return "http://127.0.0.1:" + std::to_string(port) + path;
+	}
+};
+
+// Request target of a request head
+static std::string RequestPath(const std::string& head) {
+	const size_t start = head.find(' ') + 1;
+	return head.substr(start, head.find(' ', start) - start);
+}
+
+static StandIn* StartStandIn(const BenchOptions& options, BenchResult& result, std::deque<StandIn>& servers,
+	StandIn::Handler handler) {
+	StandIn& server = servers.emplace_back();
+	server.handler = std::move(handler);
+
+	// Requests are bodiless GETs, so a head is a whole request
+	BenchCallback* onRequest = MakeCallback([&server](const BenchArgs& args) {
+		SocketBase* socket = g_BenchHost.GetSocket(args.Cell(0));
+		if (!socket) return;
+
+		StandIn::Peer& peer = server.peers[args.Cell(0)];
+		peer.buffer.append(args.String(1), args.Length(1));
+		size_t end;
+		while ((end = peer.buffer.find("\r\n\r\n")) != std::string::npos) {
+			const std::string path = RequestPath(peer.buffer.substr(0, end));
+			peer.buffer.erase(0, end + 4);
+			server.handler(socket, peer, path);
+		}
+	});
+	BenchCallback* onIncoming = MakeCallback([&server, onRequest](const BenchArgs& args) {
+		if (SocketBase* peer = g_BenchHost.GetSocket(args.Cell(1))) {
+			SetCallback(peer, CallbackEvent::Receive, onRequest);
+			++server.connections;
+		}
+	});
+
+	TcpSocket* listener = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(listener, CallbackEvent::Incoming, onIncoming);
+	server.port = ListenLocal(options, listener, result);
+	return server.port ? &server : nullptr;
+}
+
+struct Response {
+	bool done = false;
+	int status = 0;
+	std::string headers;
+	std::string body;
+	std::string error;
+};
+
+/**
+ * Issue GETs for urls in one go and wait for every completion.
+ */
+static bool Fetch(const BenchOptions& options, BenchResult& result, const std::vector<std::string>& urls,
+	std::vector<Response>& responses) {
+	responses.assign(urls.size(), Response());
+	size_t completed = 0;
+
+	// (status, headers, body, size, error, data)
+	BenchCallback* onResponse = MakeCallback([&responses, &completed](const BenchArgs& args) {
+		Response& response = responses[static_cast<size_t>(args.Cell(5))];
+		response.done = true;
+		response.status = args.Cell(0);
+		response.headers = args.String(1);
+		response.body.assign(args.String(2), args.Length(2));
+		response.error = args.String(4);
+		++completed;
+	});
+
+	for (size_t i = 0; i < urls.size(); ++i) {
+		const char* error = nullptr;
+		if (!g_HttpClient.Request("GET", urls[i], std::string_view(), std::string_view(), onResponse,
+			static_cast<cell_t>(i), error)) {
+			result.Fail(error ? error : "Request could not be queued");
+			return false;
+		}
+	}
+	return Await(options, result, "HTTP responses", [&]() { return completed == urls.size(); });
+}
+
+static bool ExpectResponse(BenchResult& result, const Response& response, int status, const std::string& body,
+	const char* what) {
+	return Expect(result, response.status == status && response.body == body,
+		std::string(what) + ": status " + std::to_string(response.status) + " \"" + response.body + "\" " + response.error);
+}
+
+static void CheckClient(const BenchOptions& options, BenchResult& result, std::deque<StandIn>& servers, size_t& cases) {
+	std::vector<Response> responses;
+
+	// Whole scripted responses, one per path
+	StandIn* scripted = StartStandIn(options, result, servers, [](SocketBase* socket, StandIn::Peer& peer,
+		const std::string& path) {
+		if (path == "/chunked") {
+			// In three sends, so the reads may split it too
+			socket->Send("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5;name=value\r\nHello\r\n");
+			socket->Send("7\r\n, world\r\n0\r\n");
+			socket->Send("X-Checksum: 1\r\n\r\n");
+		} else if (path == "/interim") {
+			socket->Send("HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 103 Early Hints\r\nLink: </style.css>\r\n\r\n");
+			socket->Send(Reply("final"));
+		} else if (path == "/until-close") {
+			socket->Send("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nuntil ");
+			socket->Send("close");
+			// Both sends are queued on the UV thread ahead of the close job,
+			// so they reach the client before the FIN
+			socket->Disconnect();
+		} else if (path == "/malformed") {
+			socket->Send("HTTP/1.1 2x0 OK\r\nContent-Length: 0\r\n\r\n");
+		} else {
+			socket->Send("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+		}
+	});
+	if (!scripted) return;
+
+	if (!Fetch(options, result, {scripted->Url("/chunked")}, responses) ||
+		!ExpectResponse(result, responses[0], 200, "Hello, world", "Chunked response")) {
+		return;
+	}
+	++cases;
+	if (!Fetch(options, result, {scripted->Url("/interim")}, responses) ||
+		!ExpectResponse(result, responses[0], 200, "final", "Response after 1xx") ||
+		!Expect(result, responses[0].headers.find("Link:") == std::string::npos, "1xx headers leaked into the response")) {
+		return;
+	}
+	++cases;
+	if (!Fetch(options, result, {scripted->Url("/until-close")}, responses) ||
+		!ExpectResponse(result, responses[0], 200, "until close", "Response read until close")) {
+		return;
+	}
+	++cases;
+	if (!Fetch(options, result, {scripted->Url("/malformed")}, responses) ||
+		!ExpectResponse(result, responses[0], 0, "", "Malformed response") ||
+		!Expect(result, responses[0].error == "Malformed status line", "Wrong error: " + responses[0].error)) {
+		return;
+	}
+	++cases;
+
+	// One connection, kPipelineDepth requests written before any answer:
+	// the server holds its responses until it has them all
+	g_GlobalOptions.Set(SocketOption::HttpMaxConnections, 1);
+	g_GlobalOptions.Set(SocketOption::HttpPipelineDepth, kPipelineDepth);
+	size_t batch = 1;
+	StandIn* pipelined = StartStandIn(options, result, servers, [&batch](SocketBase* socket, StandIn::Peer& peer,
+		const std::string& path) {
+		peer.held.push_back(Reply(path));
+		if (peer.held.size() < batch) return;
+
+		std::string replies;
+		for (const std::string& reply : peer.held) {
+			replies += reply;
+		}
+		peer.held.clear();
+		socket->Send(replies);
+	});
+	if (!pipelined) return;
+
+	// Pipelining waits for a connection that kept a response alive
+	if (!Fetch(options, result, {pipelined->Url("/warm")}, responses) ||
+		!ExpectResponse(result, responses[0], 200, "/warm", "Warm-up request")) {
+		return;
+	}
+	batch = kPipelineDepth;
+	std::vector<std::string> urls;
+	for (int i = 0; i < kPipelineDepth; ++i) {
+		urls.push_back(pipelined->Url(("/pipelined/" + std::to_string(i)).c_str()));
+	}
+	if (!Fetch(options, result, urls, responses)) return;
+	for (int i = 0; i < kPipelineDepth; ++i) {
+		if (!ExpectResponse(result, responses[i], 200, "/pipelined/" + std::to_string(i), "Pipelined response")) return;
+	}
+	if (!Expect(result, pipelined->connections == 1,
+			"Pipelined requests used " + std::to_string(pipelined->connections) + " connections")) {
+		return;
+	}
+	++cases;
+
+	// The server drops a kept-alive connection as the next request arrives
+	bool dropped = false;
+	StandIn* dropping = StartStandIn(options, result, servers, [&dropped](SocketBase* socket, StandIn::Peer& peer,
+		const std::string& path) {
+		if (peer.answered > 0 && !dropped) {
+			dropped = true;
+			socket->Disconnect();
+			return;
+		}
+		++peer.answered;
+		socket->Send(Reply(path));
+	});
+	if (!dropping) return;
+
+	if (!Fetch(options, result, {dropping->Url("/warm")}, responses) ||
+		!Fetch(options, result, {dropping->Url("/retried")}, responses) ||
+		!ExpectResponse(result, responses[0], 200, "/retried", "Request retried after the connection closed") ||
+		!Expect(result, dropped && dropping->connections == 2,
+			"Retry used " + std::to_string(dropping->connections) + " connections")) {
+		return;
+	}
+	++cases;
+}
+
+void BenchHttpProtocol(const BenchOptions& options, BenchResult& result) {
+	size_t cases = 0;
+	size_t splits = 0;
+	std::deque<StandIn> servers;
+
+	CheckParserResponses(result, cases, splits);
+	if (result.ok) {
+		CheckParserErrors(result, cases, splits);
+	}
+	if (result.ok) {
+		CheckClient(options, result, servers, cases);
+	}
+
+	g_GlobalOptions.Set(SocketOption::HttpMaxConnections, 0);
+	g_GlobalOptions.Set(SocketOption::HttpPipelineDepth, 0);
+	// The stand-ins' callbacks must not outlive them
+	g_BenchHost.CloseAll();
+
+	result.Metric("cases_passed", static_cast<double>(cases));
+	result.Metric("splits_checked", static_cast<double>(splits));
+}
@@ -0,0 +1,98 @@
+#include "BenchRunner.h"
+#include "lockfree/MPSCQueue.h"
+#include "lockfree/SPSCQueue.h"
+#include "lockfree/QueueTypes.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Same ring size as EventLoop's job queue
+static constexpr size_t kRingSize = 1024;
+
+/**
+ * Push items jobs from producers threads and run them on this thread.
+ *
+ * @return Millions of jobs per second
+ */
+template<typename Push, typename Pop>
+static double MeasureJobs(size_t producers, size_t items, Push push, Pop pop) {
+	const size_t perProducer = items / producers;
+	const size_t total = perProducer * producers;
+
+	std::atomic<bool> go{false};
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < producers; ++i) {
+		threads.emplace_back([&]() {
+			while (!go.load(std::memory_order_acquire)) {
+				std::this_thread::yield();
+			}
+			for (size_t n = 0; n < perProducer; ++n) {
+				while (!push()) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	const double start = Now();
+	go.store(true, std::memory_order_release);
+	size_t executed = 0;
+	while (executed < total) {
+		if (pop()) {
+			++executed;
+		}
+	}
+	const double elapsed = Now() - start;
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	return total / elapsed / 1e6;
+}
+
+void BenchJobQueue(const BenchOptions& options, BenchResult& result) {
+	const size_t items = std::max<size_t>(options.messages * 10, 1000);
+	result.Param("jobs", static_cast<double>(items));
+
+	// Jobs run on the consumer thread, like UV thread jobs
+	uint64_t counter = 0;
+	auto makeJob = [&counter]() { return AsyncJob([&counter]() { ++counter; }); };
+
+	for (size_t producers : {1, 2, 4}) {
+		const std::string suffix = "_p" + std::to_string(producers) + "_mjobs_per_s";
+
+		// The SPSC ring is only correct with one producer, more take turns on a lock
+		auto spsc = std::make_unique<SPSCQueue<AsyncJob, kRingSize>>();
+		std::mutex lock;
+		double spscRate = MeasureJobs(producers, items,
+			[&]() {
+				if (producers == 1) {
+					return spsc->try_enqueue(makeJob());
+				}
+				std::lock_guard<std::mutex> guard(lock);
+				return spsc->try_enqueue(makeJob());
+			},
+			[&]() {
+				AsyncJob job;
+				if (!spsc->try_dequeue(job)) return false;
+				job();
+				return true;
+			});
+		result.Metric(((producers == 1 ? "spsc" : "spsc_locked") + suffix).c_str(), spscRate);
+
+		auto mpsc = std::make_unique<MPSCQueue<AsyncJob, kRingSize>>();
+		double mpscRate = MeasureJobs(producers, items,
+			[&]() { return mpsc->try_enqueue(makeJob()); },
+			[&]() {
+				AsyncJob job;
+				if (!mpsc->try_dequeue(job)) return false;
+				job();
+				return true;
+			});
+		result.Metric(("mpsc" + suffix).c_str(), mpscRate);
+	}
+}
@@ -0,0 +1,252 @@
+#include "BenchRunner.h"
+#include "core/CallbackManager.h"
+#include "core/LatencyHistogram.h"
+#include "socket/TcpSocket.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Bytes a throughput client keeps queued for sending
+static constexpr int64_t kSendWindow = 1 << 20;
+
+/**
+ * Connect count TCP clients to 127.0.0.1:port and wait until all are up.
+ *
+ * @param webSocket WebSocketMode for the clients
+ */
+static std::vector<TcpSocket*> ConnectClients(const BenchOptions& options, BenchResult& result, uint16_t port,
+	size_t count, WebSocketMode webSocket) {
+	std::vector<TcpSocket*> clients;
+	size_t connected = 0;
+	BenchCallback* onConnect = MakeCallback([&connected](const BenchArgs& args) { ++connected; });
+
+	for (size_t i = 0; i < count; ++i) {
+		TcpSocket* client = g_BenchHost.CreateSocket<TcpSocket>();
+		SetCallback(client, CallbackEvent::Connect, onConnect);
+		TrapErrors(client, result);
+		if (webSocket != WebSocketMode::None) {
+			client->SetOption(SocketOption::WebSocket, static_cast<int>(webSocket));
+		}
+		if (!client->Connect("127.0.0.1", port)) {
+			result.Fail("Connect failed");
+			break;
+		}
+		clients.push_back(client);
+	}
+
+	if (result.ok && !RunUntil(options, [&]() { return connected == clients.size() || !result.ok; })) {
+		result.Fail("Timed out connecting");
+	}
+
+	for (TcpSocket* client : clients) {
+		SetCallback(client, CallbackEvent::Connect, nullptr);
+	}
+	return clients;
+}
+
+void BenchTcpThroughput(const BenchOptions& options, BenchResult& result) {
+	const size_t connections = std::max<size_t>(options.connections, 1);
+	const size_t perConnection = std::max<size_t>(options.messages / connections, 1);
+	const std::string payload(std::max<size_t>(options.messageSize, 1), 'x');
+	const uint64_t expected = static_cast<uint64_t>(perConnection) * connections * payload.size();
+
+	result.Param("connections", static_cast<double>(connections));
+	result.Param("messages", static_cast<double>(perConnection * connections));
+	result.Param("message_size", static_cast<double>(payload.size()));
+
+	uint64_t received = 0;
+	BenchCallback* onReceive = MakeCallback([&received](const BenchArgs& args) {
+		received += static_cast<uint64_t>(args.Cell(2));
+	});
+	BenchCallback* onIncoming = MakeCallback([&](const BenchArgs& args) {
+		if (SocketBase* peer = g_BenchHost.GetSocket(args.Cell(1))) {
+			SetCallback(peer, CallbackEvent::Receive, onReceive);
+			TrapErrors(peer, result);
+		}
+	});
+
+	TcpSocket* listener = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(listener, CallbackEvent::Incoming, onIncoming);
+	uint16_t port = ListenLocal(options, listener, result);
+	if (!port) return;
+
+	std::vector<TcpSocket*> clients = ConnectClients(options, result, port, connections, WebSocketMode::None);
+	if (!result.ok) return;
+
+	std::vector<size_t> sent(connections, 0);
+	const double start = Now();
+	bool done = RunUntil(options, [&]() {
+		for (size_t i = 0; i < connections && result.ok; ++i) {
+			const SocketEventQueue& queue = *clients[i]->GetEventQueue();
+			while (sent[i] < perConnection && queue.sendBacklog.load(std::memory_order_relaxed) < kSendWindow) {
+				if (!clients[i]->Send(payload)) {
+					result.Fail("Send failed");
+					break;
+				}
+				++sent[i];
+			}
+		}
+		return received >= expected || !result.ok;
+	});
+	const double elapsed = Now() - start;
+
+	if (!done) {
+		result.Fail("Timed out after " + std::to_string(received) + " of " + std::to_string(expected) + " bytes");
+	}
+	if (!result.ok) return;
+
+	result.Metric("seconds", elapsed);
+	result.Metric("mb_per_s", expected / elapsed / 1e6);
+	result.Metric("messages_per_s", perConnection * connections / elapsed);
+}
+
+/**
+ * One client bouncing a message off an echo server, one message in flight.
+ */
+static void RunPingPong(const BenchOptions& options, BenchResult& result, WebSocketMode webSocket) {
+	const size_t rounds = std::max<size_t>(options.messages / 10, 1);
+	const std::string payload(std::max<size_t>(options.messageSize, 1), 'x');
+
+	result.Param("round_trips", static_cast<double>(rounds));
+	result.Param("message_size", static_cast<double>(payload.size()));
+
+	BenchCallback* onEcho = MakeCallback([&result](const BenchArgs& args) {
+		SocketBase* peer = g_BenchHost.GetSocket(args.Cell(0));
+		if (peer && !peer->Send(std::string_view(args.String(1), args.Length(1)))) {
+			result.Fail("Echo send failed");
+		}
+	});
+	BenchCallback* onIncoming = MakeCallback([&](const BenchArgs& args) {
+		if (SocketBase* peer = g_BenchHost.GetSocket(args.Cell(1))) {
+			SetCallback(peer, CallbackEvent::Receive, onEcho);
+			TrapErrors(peer, result);
+		}
+	});
+
+	TcpSocket* listener = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(listener, CallbackEvent::Incoming, onIncoming);
+	if (webSocket != WebSocketMode::None) {
+		listener->SetOption(SocketOption::WebSocket, static_cast<int>(webSocket));
+	}
+	uint16_t port = ListenLocal(options, listener, result);
+	if (!port) return;
+
+	std::vector<TcpSocket*> clients = ConnectClients(options, result, port, 1, webSocket);
+	if (!result.ok) return;
+	TcpSocket* client = clients[0];
+
+	LatencyHistogram rtt;
+	size_t completed = 0;
+	size_t pending = 0;
+	uint64_t sentAt = 0;
+
+	auto sendNext = [&]() {
+		pending = payload.size();
+		sentAt = uv_hrtime();
+		if (!client->Send(payload)) {
+			result.Fail("Send failed");
+		}
+	};
+
+	SetCallback(client, CallbackEvent::Receive, MakeCallback([&](const BenchArgs& args) {
+		// TCP may split or merge the echo, WebSocket delivers it whole
+		size_t length = args.Length(1);
+		pending -= std::min(pending, length);
+		if (pending) return;
+
+		rtt.Record(uv_hrtime() - sentAt);
+		if (++completed < rounds) {
+			sendNext();
+		}
+	}));
+
+	const double start = Now();
+	sendNext();
+	bool done = RunUntil(options, [&]() { return completed >= rounds || !result.ok; });
+	const double elapsed = Now() - start;
+
+	if (!done) {
+		result.Fail("Timed out after " + std::to_string(completed) + " of " + std::to_string(rounds) + " round trips");
+	}
+	if (!result.ok) return;
+
+	result.Metric("seconds", elapsed);
+	result.Metric("round_trips_per_s", rounds / elapsed);
+	RecordLatency(result, "rtt", rtt);
+}
+
+void BenchTcpLatency(const BenchOptions& options, BenchResult& result) {
+	RunPingPong(options, result, WebSocketMode::None);
+}
+
+void BenchWebSocketEcho(const BenchOptions& options, BenchResult& result) {
+	RunPingPong(options, result, WebSocketMode::Binary);
+}
+
+void BenchTcpChurn(const BenchOptions& options, BenchResult& result) {
+	const size_t total = std::max<size_t>(options.messages / 50, 1);
+	const size_t concurrency = std::max<size_t>(options.connections, 1);
+
+	result.Param("connections", static_cast<double>(total));
+	result.Param("concurrency", static_cast<double>(concurrency));
+
+	// Sockets are closed between frames, never from their own callback
+	std::vector<Handle_t> closing;
+
+	BenchCallback* onIncoming = MakeCallback([&closing](const BenchArgs& args) {
+		closing.push_back(static_cast<Handle_t>(args.Cell(1)));
+	});
+
+	TcpSocket* listener = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(listener, CallbackEvent::Incoming, onIncoming);
+	uint16_t port = ListenLocal(options, listener, result);
+	if (!port) return;
+
+	LatencyHistogram connectTime;
+	size_t started = 0;
+	size_t completed = 0;
+
+	BenchCallback* onConnect = MakeCallback([&](const BenchArgs& args) {
+		Handle_t handle = static_cast<Handle_t>(args.Cell(0));
+		if (SocketBase* client = g_BenchHost.GetSocket(handle)) {
+			connectTime.Record(client->GetEventQueue()->connectLatency.load(std::memory_order_relaxed) * 1000);
+		}
+		closing.push_back(handle);
+		++completed;
+	});
+	// Resets from the server closing first are expected, failed connects are not
+	BenchCallback* onError = MakeCallback([&result](const BenchArgs& args) {
+		if (args.Cell(1) == static_cast<cell_t>(SocketError::ConnectError)) {
+			result.Fail(std::string("Connect failed: ") + args.String(2));
+		}
+	});
+
+	const double start = Now();
+	bool done = RunUntil(options, [&]() {
+		for (Handle_t handle : closing) {
+			g_BenchHost.CloseSocket(handle);
+		}
+		closing.clear();
+
+		while (started < total && started - completed < concurrency && result.ok) {
+			TcpSocket* client = g_BenchHost.CreateSocket<TcpSocket>();
+			SetCallback(client, CallbackEvent::Connect, onConnect);
+			SetCallback(client, CallbackEvent::Error, onError);
+			if (!client->Connect("127.0.0.1", port)) {
+				result.Fail("Connect failed");
+			}
+			++started;
+		}
+		return completed >= total || !result.ok;
+	});
+	const double elapsed = Now() - start;
+
+	if (!done) {
+		result.Fail("Timed out after " + std::to_string(completed) + " of " + std::to_string(total) + " connections");
+	}
+	if (!result.ok) return;
+
+	result.Metric("seconds", elapsed);
+	result.Metric("connections_per_s", total / elapsed);
+	RecordLatency(result, "connect", connectTime);
+}
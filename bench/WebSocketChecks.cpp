@@ -0,0 +1,473 @@
+#include "BenchRunner.h"
+#include "core/BufferPool.h"
+#include "core/EventLoop.h"
+#include "socket/TcpSocket.h"
+#include "socket/WebSocketSession.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+// RFC 6455 section 1.3: the sample key and the accept value it must produce
+static constexpr char kSampleKey[] = "dGhlIHNhbXBsZSBub25jZQ==";
+static constexpr char kSampleAccept[] = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+// RFC 6455 section 5.7: a single-frame masked text message, "Hello"
+static const std::string kMaskedHello("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11);
+// Masking key of the frames built here, the key of the same example
+static const uint8_t kMask[4] = {0x37, 0xfa, 0x21, 0x3d};
+
+static constexpr uint16_t kCloseNormal = 1000;
+static constexpr uint16_t kCloseTooBig = 1009;
+// FramingMaxSize of the loopback server
+static constexpr int kServerMaxMessage = 1024;
+// Payload needing the 64-bit length form, and a limit that lets it through
+static constexpr size_t kLargeMessage = 70000;
+static constexpr int kLargeMaxMessage = 1 << 17;
+
+static std::string HandshakeRequest() {
+	return std::string("GET /bench HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Key: ") + kSampleKey + "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+}
+
+/**
+ * A client frame masked with kMask. Built here rather than with
+ * WebSocketSession::EncodeFrame, so a bug shared by both ends cannot
+ * cancel itself out.
+ */
+static std::string ClientFrame(uint8_t opcode, std::string_view payload, bool fin = true) {
+	const size_t length = payload.size();
+	std::string frame;
+	frame += static_cast<char>((fin ? 0x80 : 0) | opcode);
+	if (length < 126) {
+		frame += static_cast<char>(0x80 | length);
+	} else if (length <= 0xFFFF) {
+		frame += static_cast<char>(0x80 | 126);
+		frame += static_cast<char>(length >> 8);
+		frame += static_cast<char>(length & 0xFF);
+	} else {
+		frame += static_cast<char>(0x80 | 127);
+		for (int shift = 56; shift >= 0; shift -= 8) {
+			frame += static_cast<char>((static_cast<uint64_t>(length) >> shift) & 0xFF);
+		}
+	}
+
+	frame.append(reinterpret_cast<const char*>(kMask), sizeof(kMask));
+	for (size_t i = 0; i < length; ++i) {
+		frame += static_cast<char>(payload[i] ^ kMask[i & 3]);
+	}
+	return frame;
+}
+
+static std::string CloseStatus(uint16_t code) {
+	return {static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+}
+
+static std::string Pattern(size_t length) {
+	std::string payload(length, '\0');
+	for (size_t i = 0; i < length; ++i) {
+		payload[i] = static_cast<char>(i * 31 + 7);
+	}
+	return payload;
+}
+
+struct ServerFrame {
+	bool fin = false;
+	bool masked = false;
+	uint8_t opcode = 0;
+	std::string payload;
+};
+
+/**
+ * Take one complete server frame off the front of buffer.
+ *
+ * @return false if buffer does not hold a whole frame yet
+ */
+static bool TakeServerFrame(std::string& buffer, ServerFrame& frame) {
+	if (buffer.size() < 2) return false;
+
+	const auto first = static_cast<uint8_t>(buffer[0]);
+	const auto second = static_cast<uint8_t>(buffer[1]);
+	size_t header = 2;
+	uint64_t length = second & 0x7F;
+	if (length == 126) {
+		if (buffer.size() < 4) return false;
+		length = (static_cast<uint64_t>(static_cast<uint8_t>(buffer[2])) << 8) | static_cast<uint8_t>(buffer[3]);
+		header = 4;
+	} else if (length == 127) {
+		if (buffer.size() < 10) return false;
+		length = 0;
+		for (size_t i = 0; i < 8; ++i) {
+			length = (length << 8) | static_cast<uint8_t>(buffer[2 + i]);
+		}
+		header = 10;
+	}
+	if (second & 0x80) {
+		header += 4;
+	}
+	if (buffer.size() < header + length) return false;
+
+	frame.fin = (first & 0x80) != 0;
+	frame.masked = (second & 0x80) != 0;
+	frame.opcode = first & 0x0F;
+	frame.payload = buffer.substr(header, static_cast<size_t>(length));
+	buffer.erase(0, header + static_cast<size_t>(length));
+	return true;
+}
+
+/**
+ * Plain TCP connection that speaks hand-built WebSocket frames. Its
+ * callbacks hold on to it, so it must outlive the benchmark's sockets.
+ */
+struct RawPeer {
+	TcpSocket* socket = nullptr;
+	std::string received;
+	bool connected = false;
+};
+
+static RawPeer* ConnectRaw(const BenchOptions& options, BenchResult& result, std::deque<RawPeer>& peers, uint16_t port) {
+	RawPeer& peer = peers.emplace_back();
+	peer.socket = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(peer.socket, CallbackEvent::Connect, MakeCallback([&peer](const BenchArgs& args) {
+		peer.connected = true;
+	}));
+	SetCallback(peer.socket, CallbackEvent::Receive, MakeCallback([&peer](const BenchArgs& args) {
+		peer.received.append(args.String(1), args.Length(1));
+	}));
+	TrapErrors(peer.socket, result);
+
+	if (!Expect(result, peer.socket->Connect("127.0.0.1", port), "Connect failed") ||
+		!Await(options, result, "the raw connection", [&]() { return peer.connected; })) {
+		return nullptr;
+	}
+	return &peer;
+}
+
+/**
+ * Wait for the server's handshake response on peer and check it is the
+ * RFC 6455 sample answer.
+ */
+static bool ExpectHandshake(const BenchOptions& options, BenchResult& result, RawPeer& peer) {
+	if (!Await(options, result, "the handshake response", [&]() { return peer.received.find("\r\n\r\n") != std::string::npos; })) {
+		return false;
+	}
+
+	const size_t end = peer.received.find("\r\n\r\n") + 4;
+	const std::string head = peer.received.substr(0, end);
+	peer.received.erase(0, end);
+
+	return Expect(result, head.compare(0, 13, "HTTP/1.1 101 ") == 0,
+			"Server did not switch protocols: " + head.substr(0, head.find('\r'))) &&
+		Expect(result, head.find(std::string("\r\nSec-WebSocket-Accept: ") + kSampleAccept + "\r\n") != std::string::npos,
+			"Server sent a wrong Sec-WebSocket-Accept for the RFC 6455 sample key");
+}
+
+static bool ReadFrames(const BenchOptions& options, BenchResult& result, RawPeer& peer, size_t count,
+	std::vector<ServerFrame>& frames) {
+	frames.clear();
+	return Await(options, result, "server frames", [&]() {
+		ServerFrame frame;
+		while (frames.size() < count && TakeServerFrame(peer.received, frame)) {
+			if (!Expect(result, !frame.masked, "Server sent a masked frame")) break;
+			frames.push_back(std::move(frame));
+		}
+		return frames.size() >= count;
+	});
+}
+
+static bool ExpectFrame(BenchResult& result, const ServerFrame& frame, uint8_t opcode, const std::string& payload,
+	const char* what) {
+	return Expect(result, frame.fin && frame.opcode == opcode && frame.payload == payload,
+		std::string("Wrong ") + what + ": opcode " + std::to_string(frame.opcode) + ", " +
+		std::to_string(frame.payload.size()) + " bytes");
+}
+
+/**
+ * Feeds bytes to a socket's own WebSocket session on its UV thread, one
+ * read per Feed, so read boundaries fall exactly where chosen. Loopback
+ * TCP gives no such control.
+ */
+class SessionFeeder {
+public:
+	explicit SessionFeeder(TcpSocket* socket) : m_socket(socket) {}
+
+	/**
+	 * Consume bytes as one read and wait until that is done (game thread).
+	 *
+	 * @return false once the session failed or closed
+	 */
+	bool Feed(std::string_view bytes) {
+		m_chunk.assign(bytes.data(), bytes.size());
+		m_done.store(false, std::memory_order_relaxed);
+		if (!m_socket->GetEventLoop().Post([this]() { Run(); })) {
+			return false;
+		}
+		while (!m_done.load(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+		return m_open;
+	}
+
+private:
+	// UV thread
+	void Run() {
+		PooledBuffer* slab = AcquireBuffer(m_chunk.size());
+		if (slab) {
+			std::memcpy(slab->Data(), m_chunk.data(), m_chunk.size());
+			m_open = m_socket->ConsumeRead(slab, slab->Data(), m_chunk.size());
+		} else {
+			m_open = false;
+		}
+		m_done.store(true, std::memory_order_release);
+	}
+
+	TcpSocket* m_socket;
+	std::string m_chunk;
+	bool m_open = true;
+	std::atomic<bool> m_done{false};
+};
+
+/**
+ * The extension's server session against a hand-built client over
+ * loopback: handshake, fragmentation with an interleaved ping, the size
+ * limit and the close handshake.
+ */
+static void CheckLoopback(const BenchOptions& options, BenchResult& result, std::deque<RawPeer>& peers, size_t& cases) {
+	std::vector<std::string> serverErrors;
+	size_t serverDisconnects = 0;
+
+	BenchCallback* onEcho = MakeCallback([&result](const BenchArgs& args) {
+		SocketBase* peer = g_BenchHost.GetSocket(args.Cell(0));
+		Expect(result, peer && peer->Send(std::string_view(args.String(1), args.Length(1))), "Echo send failed");
+	});
+	BenchCallback* onServerError = MakeCallback([&serverErrors](const BenchArgs& args) {
+		serverErrors.emplace_back(args.String(2));
+	});
+	BenchCallback* onServerDisconnect = MakeCallback([&serverDisconnects](const BenchArgs& args) {
+		++serverDisconnects;
+	});
+	BenchCallback* onIncoming = MakeCallback([&](const BenchArgs& args) {
+		if (SocketBase* peer = g_BenchHost.GetSocket(args.Cell(1))) {
+			SetCallback(peer, CallbackEvent::Receive, onEcho);
+			SetCallback(peer, CallbackEvent::Error, onServerError);
+			SetCallback(peer, CallbackEvent::Disconnect, onServerDisconnect);
+		}
+	});
+
+	TcpSocket* listener = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(listener, CallbackEvent::Incoming, onIncoming);
+	listener->SetOption(SocketOption::WebSocket, static_cast<int>(WebSocketMode::Binary));
+	listener->SetOption(SocketOption::FramingMaxSize, kServerMaxMessage);
+	uint16_t port = ListenLocal(options, listener, result);
+	if (!port) return;
+
+	std::vector<ServerFrame> frames;
+
+	// Handshake, then a message in three fragments with a ping between them
+	RawPeer* peer = ConnectRaw(options, result, peers, port);
+	if (!peer) return;
+	RawPeer& client = *peer;
+	client.socket->Send(HandshakeRequest());
+	if (!ExpectHandshake(options, result, client)) return;
+	++cases;
+
+	client.socket->Send(ClientFrame(WebSocketSession::Text, "Hello, ", false));
+	client.socket->Send(ClientFrame(WebSocketSession::Ping, "are you there"));
+	client.socket->Send(ClientFrame(WebSocketSession::Continuation, "fragmented ", false));
+	client.socket->Send(ClientFrame(WebSocketSession::Continuation, "world"));
+	if (!ReadFrames(options, result, client, 2, frames)) return;
+	// The pong is sent from the UV thread, the echo a frame later
+	if (!ExpectFrame(result, frames[0], WebSocketSession::Pong, "are you there", "pong") ||
+		!ExpectFrame(result, frames[1], WebSocketSession::Binary, "Hello, fragmented world", "reassembled echo")) {
+		return;
+	}
+	++cases;
+
+	// Empty ping, and messages of every length form up to the limit
+	client.socket->Send(ClientFrame(WebSocketSession::Ping, ""));
+	if (!ReadFrames(options, result, client, 1, frames) ||
+		!ExpectFrame(result, frames[0], WebSocketSession::Pong, "", "empty pong")) {
+		return;
+	}
+	for (size_t length : {size_t(0), size_t(125), size_t(126), size_t(kServerMaxMessage)}) {
+		const std::string payload = Pattern(length);
+		client.socket->Send(ClientFrame(WebSocketSession::Binary, payload));
+		if (!ReadFrames(options, result, client, 1, frames) ||
+			!ExpectFrame(result, frames[0], WebSocketSession::Binary, payload, "echo")) {
+			return;
+		}
+	}
+	++cases;
+
+	// Close handshake: the status code comes back and the script hears of it
+	client.socket->Send(ClientFrame(WebSocketSession::Close, CloseStatus(kCloseNormal) + "bye"));
+	if (!ReadFrames(options, result, client, 1, frames) ||
+		!ExpectFrame(result, frames[0], WebSocketSession::Close, CloseStatus(kCloseNormal), "close echo") ||
+		!Await(options, result, "the server's disconnect", [&]() { return serverDisconnects == 1; })) {
+		return;
+	}
+	++cases;
+
+	// Over the limit in one frame, then in fragments that fit one by one
+	const std::string oversize[] = {
+		ClientFrame(WebSocketSession::Binary, Pattern(kServerMaxMessage + 1)),
+		ClientFrame(WebSocketSession::Binary, Pattern(kServerMaxMessage / 2 + 1), false) +
+			ClientFrame(WebSocketSession::Continuation, Pattern(kServerMaxMessage / 2 + 1)),
+	};
+	for (const std::string& frame : oversize) {
+		serverErrors.clear();
+
+		RawPeer* fresh = ConnectRaw(options, result, peers, port);
+		if (!fresh) return;
+		fresh->socket->Send(HandshakeRequest());
+		if (!ExpectHandshake(options, result, *fresh)) return;
+
+		fresh->socket->Send(frame);
+		if (!ReadFrames(options, result, *fresh, 1, frames) ||
+			!ExpectFrame(result, frames[0], WebSocketSession::Close, CloseStatus(kCloseTooBig), "close for an oversized message") ||
+			!Await(options, result, "the server's error", [&]() { return !serverErrors.empty(); }) ||
+			!Expect(result, serverErrors[0] == "WebSocket message exceeds the maximum size",
+				"Wrong server error for an oversized message: " + serverErrors[0])) {
+			return;
+		}
+	}
+	++cases;
+}
+
+/**
+ * Byte streams fed to a server session split at every offset, checking
+ * the messages reach the script intact each time.
+ */
+static void CheckSplits(const BenchOptions& options, BenchResult& result, std::deque<RawPeer>& peers, size_t& cases,
+	size_t& splits) {
+	std::vector<std::string> messages;
+	std::string lastError;
+	TcpSocket* server = nullptr;
+
+	BenchCallback* onIncoming = MakeCallback([&](const BenchArgs& args) {
+		if (SocketBase* peer = g_BenchHost.GetSocket(args.Cell(1))) {
+			server = static_cast<TcpSocket*>(peer);
+			peer->SetOption(SocketOption::FramingMaxSize, kLargeMaxMessage);
+			SetCallback(peer, CallbackEvent::Receive, MakeCallback([&messages](const BenchArgs& args) {
+				messages.emplace_back(args.String(1), args.Length(1));
+			}));
+			SetCallback(peer, CallbackEvent::Error, MakeCallback([&lastError](const BenchArgs& args) {
+				lastError = args.String(2);
+			}));
+		}
+	});
+
+	// The accepted socket gets its own session; the raw client only listens,
+	// so every byte that session sees comes from the feeder
+	TcpSocket* listener = g_BenchHost.CreateSocket<TcpSocket>();
+	SetCallback(listener, CallbackEvent::Incoming, onIncoming);
+	listener->SetOption(SocketOption::WebSocket, static_cast<int>(WebSocketMode::Binary));
+	uint16_t port = ListenLocal(options, listener, result);
+	if (!port) return;
+
+	RawPeer* peer = ConnectRaw(options, result, peers, port);
+	if (!peer || !Await(options, result, "the accepted connection", [&]() { return server != nullptr; })) {
+		return;
+	}
+	RawPeer& client = *peer;
+
+	SessionFeeder feeder(server);
+	const std::string handshake = HandshakeRequest();
+	if (!Expect(result, feeder.Feed(handshake.substr(0, 40)) && feeder.Feed(handshake.substr(40)), "Handshake failed: " + lastError) ||
+		!ExpectHandshake(options, result, client)) {
+		return;
+	}
+
+	const std::string large = Pattern(kLargeMessage);
+	struct Stream {
+		const char* name;
+		std::string bytes;
+		std::vector<std::string> expected;
+		// Pongs the stream makes the session send
+		size_t pongs;
+		// Split only within the first bytes (header and masking key)
+		size_t splitLimit;
+	};
+	const Stream streams[] = {
+		{"RFC 6455 masked Hello", kMaskedHello, {"Hello"}, 0, 0},
+		{"7-bit length", ClientFrame(WebSocketSession::Binary, Pattern(5)), {Pattern(5)}, 0, 0},
+		{"16-bit length", ClientFrame(WebSocketSession::Binary, Pattern(300)), {Pattern(300)}, 0, 0},
+		{"64-bit length", ClientFrame(WebSocketSession::Binary, large), {large}, 0, 32},
+		{"two messages", ClientFrame(WebSocketSession::Text, "Hello") + ClientFrame(WebSocketSession::Binary, Pattern(300)),
+			{"Hello", Pattern(300)}, 0, 0},
+		{"fragments and a ping", ClientFrame(WebSocketSession::Text, "Hel", false) + ClientFrame(WebSocketSession::Ping, "p") +
+			ClientFrame(WebSocketSession::Continuation, "lo, ", false) + ClientFrame(WebSocketSession::Continuation, "world"),
+			{"Hello, world"}, 1, 0},
+	};
+
+	std::vector<ServerFrame> frames;
+	for (const Stream& stream : streams) {
+		const size_t size = stream.bytes.size();
+		const size_t last = stream.splitLimit ? std::min(stream.splitLimit, size - 1) : size - 1;
+
+		// Offset 0 feeds the stream whole, the rest split it in two
+		for (size_t offset = 0; offset <= last; ++offset) {
+			messages.clear();
+			bool open = offset == 0
+				? feeder.Feed(stream.bytes)
+				: feeder.Feed(std::string_view(stream.bytes).substr(0, offset)) &&
+				  feeder.Feed(std::string_view(stream.bytes).substr(offset));
+
+			const std::string where = std::string(stream.name) + " split at " + std::to_string(offset);
+			if (!Expect(result, open, where + ": session failed: " + lastError) ||
+				!Await(options, result, "fed messages", [&]() { return messages.size() >= stream.expected.size(); }) ||
+				!Expect(result, messages == stream.expected, where + ": message corrupted")) {
+				return;
+			}
+			if (stream.pongs && (!ReadFrames(options, result, client, stream.pongs, frames) ||
+				!ExpectFrame(result, frames[0], WebSocketSession::Pong, "p", "pong"))) {
+				return;
+			}
+			++splits;
+		}
+		++cases;
+	}
+
+	// One byte per read
+	for (const Stream& stream : streams) {
+		if (stream.splitLimit) continue;
+
+		messages.clear();
+		bool open = true;
+		for (size_t i = 0; i < stream.bytes.size() && open; ++i) {
+			open = feeder.Feed(std::string_view(stream.bytes).substr(i, 1));
+		}
+
+		const std::string where = std::string(stream.name) + " fed bytewise";
+		if (!Expect(result, open, where + ": session failed: " + lastError) ||
+			!Await(options, result, "fed messages", [&]() { return messages.size() >= stream.expected.size(); }) ||
+			!Expect(result, messages == stream.expected, where + ": message corrupted")) {
+			return;
+		}
+		if (stream.pongs && (!ReadFrames(options, result, client, stream.pongs, frames) ||
+			!ExpectFrame(result, frames[0], WebSocketSession::Pong, "p", "pong"))) {
+			return;
+		}
+	}
+	++cases;
+}
+
+void BenchWebSocketProtocol(const BenchOptions& options, BenchResult& result) {
+	size_t cases = 0;
+	size_t splits = 0;
+	std::deque<RawPeer> peers;
+
+	CheckLoopback(options, result, peers, cases);
+	if (result.ok) {
+		g_BenchHost.CloseAll();
+		RunFor(options, 0.05);
+		CheckSplits(options, result, peers, cases, splits);
+	}
+	// The peers' callbacks must not outlive them
+	g_BenchHost.CloseAll();
+
+	result.Metric("cases_passed", static_cast<double>(cases));
+	result.Metric("splits_checked", static_cast<double>(splits));
+}
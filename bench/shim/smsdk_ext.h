@@ -0,0 +1,46 @@
+#pragma once
+
+/**
+ * Stand-in for SourceMod's smsdk_ext.h when the socket core is built
+ * without SourceMod (socket_bench).
+ *
+ * Declares only what the core uses once SocketHost covers the host
+ * services: cell and handle types, the string push flags and the
+ * IPluginFunction/IPluginContext calls that run callbacks. Method
+ * signatures match SourcePawn's so the core compiles unchanged.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+typedef int32_t cell_t;
+typedef uint32_t Handle_t;
+typedef uint32_t funcid_t;
+
+#define SM_PARAM_COPYBACK       (1 << 0)
+
+#define SM_PARAM_STRING_UTF8    (1 << 0)
+#define SM_PARAM_STRING_COPY    (1 << 1)
+#define SM_PARAM_STRING_BINARY  (1 << 2)
+
+/**
+ * Owner of callbacks, only compared by identity in the core.
+ */
+class IPluginContext {
+public:
+	virtual ~IPluginContext() = default;
+};
+
+/**
+ * Callback the core pushes arguments to and then executes.
+ */
+class IPluginFunction {
+public:
+	virtual ~IPluginFunction() = default;
+
+	virtual int PushCell(cell_t cell) = 0;
+	virtual int PushString(const char* string) = 0;
+	virtual int PushStringEx(char* buffer, size_t length, int stringFlags, int copyFlags) = 0;
+	virtual int Execute(cell_t* result) = 0;
+	virtual IPluginContext* GetParentContext() = 0;
+};
@@ -0,0 +1,298 @@
+/**
+ * socket_bench: runs the socket core outside SourceMod and reports
+ * loopback throughput, latency and connection churn as JSON.
+ *
+ * The main thread plays the game thread, running a "frame" of callbacks
+ * in a loop; the event loops run on their own threads as in the server.
+ */
+
+#include "BenchRunner.h"
+#include "core/CallbackManager.h"
+#include "core/HttpClient.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static const Benchmark kBenchmarks[] = {
+	{"job_queue", "EventLoop job ring (MPSC) against the SPSC ring, 1/2/4 producers", BenchJobQueue},
+	{"footprint", "Object sizes, and heap and RSS per socket over 10k open TCP sockets", BenchFootprint},
+	{"tcp_throughput", "Loopback TCP bulk transfer over --connections streams", BenchTcpThroughput},
+	{"tcp_latency", "Loopback TCP echo round trips, one message in flight", BenchTcpLatency},
+	{"tcp_churn", "TCP connect and close, --connections at a time", BenchTcpChurn},
+	{"websocket_echo", "Loopback WebSocket echo round trips", BenchWebSocketEcho},
+	{"websocket_protocol", "WebSocket fragments, control frames, size limit and read splits", BenchWebSocketProtocol},
+	{"udp_throughput", "Loopback UDP datagrams to one receiver", BenchUdpThroughput},
+	{"udp_sendto", "One payload to --targets receivers with looped SendTo", BenchUdpSendTo},
+	{"udp_sendtomany", "One payload to --targets receivers with SendToMany", BenchUdpSendToMany},
+	{"http_keepalive", "HTTP client GETs against a keep-alive stand-in server", BenchHttpKeepAlive},
+	{"http_protocol", "HTTP parser read splits and errors, client pipelining, 1xx and retry", BenchHttpProtocol},
+};
+
+static void PrintUsage() {
+	fprintf(stderr,
+		"Usage: socket_bench [options] [benchmark...]\n"
+		"\n"
+		"Runs every benchmark, or those named, and writes the results as JSON.\n"
+		"\n"
+		"Options:\n"
+		"  --list                     List the benchmarks\n"
+		"  --loops N[,N...]           Event loops (SocketEventLoops, default 1); a list runs\n"
+		"                             the benchmarks once per count, smallest first\n"
+		"  --messages N               Messages per run (default 100000)\n"
+		"  --size N                   Message size in bytes (default 256)\n"
+		"  --connections N            Parallel connections or requests (default 8)\n"
+		"  --targets N                UDP fan-out destinations (default 64)\n"
+		"  --frame-us N               Game frame interval, 0 for back to back (default 0)\n"
+		"  --callbacks-per-frame N    CallbacksPerFrame (default 1024)\n"
+		"  --timeout S                Seconds before a benchmark fails (default 30)\n"
+		"  --output FILE              Write JSON to FILE instead of stdout\n");
+}
+
+static void WriteJsonString(FILE* out, const std::string& value) {
+	fputc('"', out);
+	for (unsigned char c : value) {
+		switch (c) {
+			case '"': fputs("\\\"", out); break;
+			case '\\': fputs("\\\\", out); break;
+			case '\n': fputs("\\n", out); break;
+			case '\r': fputs("\\r", out); break;
+			case '\t': fputs("\\t", out); break;
+			default:
+				if (c < 0x20) {
+					fprintf(out, "\\u%04x", c);
+				} else {
+					fputc(c, out);
+				}
+				break;
+		}
+	}
+	fputc('"', out);
+}
+
+static void WriteJsonNumbers(FILE* out, const std::vector<std::pair<std::string, double>>& values) {
+	fputc('{', out);
+	for (size_t i = 0; i < values.size(); ++i) {
+		fputs(i ? ", " : "", out);
+		WriteJsonString(out, values[i].first);
+		// JSON has no NaN or infinity
+		fprintf(out, ": %.6g", std::isfinite(values[i].second) ? values[i].second : 0.0);
+	}
+	fputc('}', out);
+}
+
+static void WriteJson(FILE* out, const BenchOptions& options, const std::vector<BenchResult>& results) {
+	fprintf(out, "{\n  \"options\": ");
+	WriteJsonNumbers(out, {
+		{"messages", static_cast<double>(options.messages)},
+		{"size", static_cast<double>(options.messageSize)},
+		{"connections", static_cast<double>(options.connections)},
+		{"targets", static_cast<double>(options.targets)},
+		{"frame_us", static_cast<double>(options.frameMicroseconds)},
+		{"callbacks_per_frame", static_cast<double>(options.callbacksPerFrame)},
+	});
+	fprintf(out, ",\n  \"results\": [");
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult& result = results[i];
+		fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+		WriteJsonString(out, result.name);
+		fprintf(out, ", \"loops\": %zu, \"ok\": %s", result.loops, result.ok ? "true" : "false");
+		if (!result.ok) {
+			fprintf(out, ", \"error\": ");
+			WriteJsonString(out, result.error);
+		}
+		fprintf(out, ", \"params\": ");
+		WriteJsonNumbers(out, result.params);
+		fprintf(out, ", \"metrics\": ");
+		WriteJsonNumbers(out, result.metrics);
+		fputc('}', out);
+	}
+	fprintf(out, "\n  ]\n}\n");
+}
+
+/**
+ * Queue wait of Receive events during the run, from the histograms
+ * behind "sm socket latency".
+ */
+static void RecordQueueWait(BenchResult& result) {
+	for (size_t type = 0; type < CallbackManager::kEventTypeCount; ++type) {
+		if (strcmp(CallbackManager::GetEventTypeName(type), "Receive") != 0) continue;
+
+		const LatencyHistogram& wait = g_CallbackManager.GetQueueLatency(type);
+		if (wait.GetCount()) {
+			RecordLatency(result, "receive_queue_wait", wait);
+		}
+	}
+}
+
+static bool ParseSize(const char* value, size_t& out) {
+	char* end = nullptr;
+	unsigned long long parsed = strtoull(value, &end, 10);
+	if (!value[0] || *end) return false;
+	out = static_cast<size_t>(parsed);
+	return true;
+}
+
+/**
+ * Parse a comma separated list of loop counts into ascending order.
+ * The loop pool can only grow, so a sweep runs smallest first.
+ */
+static bool ParseLoopCounts(const char* value, std::vector<size_t>& out) {
+	out.clear();
+	std::string list(value);
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos) {
+			end = list.size();
+		}
+
+		size_t count = 0;
+		if (!ParseSize(list.substr(start, end - start).c_str(), count) || count < 1 || count > kMaxEventLoops) {
+			return false;
+		}
+		out.push_back(count);
+		start = end + 1;
+	}
+
+	std::sort(out.begin(), out.end());
+	out.erase(std::unique(out.begin(), out.end()), out.end());
+	return true;
+}
+
+static std::vector<BenchResult> RunBenchmarks(const BenchOptions& options, const std::vector<std::string>& selected) {
+	std::vector<BenchResult> results;
+	for (const Benchmark& benchmark : kBenchmarks) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), benchmark.name) == selected.end()) {
+			continue;
+		}
+
+		fprintf(stderr, "[bench] %s (%zu loops)...\n", benchmark.name, options.loops);
+		BenchResult result;
+		result.name = benchmark.name;
+		result.loops = options.loops;
+		g_CallbackManager.ResetLatency();
+
+		benchmark.run(options, result);
+
+		// Callbacks go only after nothing can call them any more
+		g_BenchHost.CloseAll();
+		g_HttpClient.CancelRequests(GetBenchContext());
+		ReleaseCallbacks();
+
+		if (result.ok) {
+			RecordQueueWait(result);
+		} else {
+			fprintf(stderr, "[bench] %s failed: %s\n", benchmark.name, result.error.c_str());
+		}
+		results.push_back(std::move(result));
+
+		// Let closes finish before the next run
+		RunFor(options, 0.05);
+	}
+	return results;
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options;
+	std::vector<size_t> loopCounts{options.loops};
+	std::vector<std::string> selected;
+	const char* outputPath = nullptr;
+
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		size_t number = 0;
+
+		if (strcmp(arg, "--list") == 0) {
+			for (const Benchmark& benchmark : kBenchmarks) {
+				printf("%-16s %s\n", benchmark.name, benchmark.description);
+			}
+			return 0;
+		} else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+			PrintUsage();
+			return 0;
+		} else if (strcmp(arg, "--output") == 0 && value) {
+			outputPath = value;
+		} else if (strcmp(arg, "--loops") == 0 && value) {
+			if (!ParseLoopCounts(value, loopCounts)) {
+				fprintf(stderr, "--loops takes counts from 1 to %d, e.g. 1,2,4\n", static_cast<int>(kMaxEventLoops));
+				return 2;
+			}
+		} else if (strcmp(arg, "--timeout") == 0 && value) {
+			options.timeoutSeconds = atof(value);
+		} else if (arg[0] == '-' && arg[1] == '-' && value && ParseSize(value, number)) {
+			if (strcmp(arg, "--messages") == 0) {
+				options.messages = number;
+			} else if (strcmp(arg, "--size") == 0) {
+				options.messageSize = number;
+			} else if (strcmp(arg, "--connections") == 0) {
+				options.connections = number;
+			} else if (strcmp(arg, "--targets") == 0) {
+				options.targets = number;
+			} else if (strcmp(arg, "--frame-us") == 0) {
+				options.frameMicroseconds = static_cast<int>(number);
+			} else if (strcmp(arg, "--callbacks-per-frame") == 0) {
+				options.callbacksPerFrame = static_cast<int>(number);
+			} else {
+				fprintf(stderr, "Unknown option %s\n", arg);
+				PrintUsage();
+				return 2;
+			}
+		} else if (arg[0] != '-') {
+			selected.emplace_back(arg);
+			continue;
+		} else {
+			fprintf(stderr, "Invalid option %s\n", arg);
+			PrintUsage();
+			return 2;
+		}
+		++i;
+	}
+
+	for (const std::string& name : selected) {
+		bool known = false;
+		for (const Benchmark& benchmark : kBenchmarks) {
+			known = known || name == benchmark.name;
+		}
+		if (!known) {
+			fprintf(stderr, "Unknown benchmark %s, see --list\n", name.c_str());
+			return 2;
+		}
+	}
+
+	FILE* out = stdout;
+	if (outputPath && !(out = fopen(outputPath, "w"))) {
+		fprintf(stderr, "Could not open %s\n", outputPath);
+		return 2;
+	}
+
+	g_GlobalOptions.Set(SocketOption::CallbackBudgetMode, static_cast<int>(CallbackBudgetMode::Count));
+	g_GlobalOptions.Set(SocketOption::CallbacksPerFrame, options.callbacksPerFrame);
+
+	// Starting again with a larger count adds loops to the running pool
+	std::vector<BenchResult> results;
+	for (size_t loops : loopCounts) {
+		options.loops = loops;
+		g_BenchHost.SetConfigValue("SocketEventLoops", std::to_string(loops));
+		g_SocketManager.Start();
+
+		std::vector<BenchResult> run = RunBenchmarks(options, selected);
+		std::move(run.begin(), run.end(), std::back_inserter(results));
+	}
+	const bool failed = std::any_of(results.begin(), results.end(), [](const BenchResult& result) { return !result.ok; });
+
+	g_HttpClient.Shutdown();
+	RunFor(options, 0.05);
+	g_SocketManager.Shutdown();
+
+	WriteJson(out, options, results);
+	if (out != stdout) {
+		fclose(out);
+	}
+	return failed ? 1 : 0;
+}
@@ -1,15 +1,55 @@
 #include "extension.h"
 #include "core/SocketManager.h"
 #include "core/CallbackManager.h"
+#include "core/EventLoop.h"
+#include "core/BufferPool.h"
+#include "core/SocketHost.h"
+#include "core/HttpClient.h"
 #include "socket/SocketBase.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 
 SocketExtension g_SocketExt;
 SMEXT_LINK(&g_SocketExt);
 
 HandleType_t g_SocketHandleType;
 
+/**
+ * Socket core services backed by SourceMod.
+ */
+class SourceModHost : public SocketHost {
+public:
+	const char* GetConfigValue(const char* key) override {
+		return smutils->GetCoreConfigValue(key);
+	}
+
+	void LogError(const char* format, ...) override {
+		char message[1024];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(message, sizeof(message), format, args);
+		va_end(args);
+		smutils->LogError(myself, "%s", message);
+	}
+
+	Handle_t CreateSocketHandle(SocketBase* socket, IPluginFunction* owner) override {
+		return handlesys->CreateHandle(g_SocketHandleType, socket, owner->GetParentContext()->GetIdentity(),
+			myself->GetIdentity(), nullptr);
+	}
+
+	void FreeSocketHandle(SocketBase* socket, IPluginFunction* owner) override {
+		HandleSecurity security(owner->GetParentContext()->GetIdentity(), myself->GetIdentity());
+		handlesys->FreeHandle(socket->m_smHandle, &security);
+	}
+};
+
+static SourceModHost s_SourceModHost;
+SocketHost* g_SocketHost = &s_SourceModHost;
+
 static void OnGameFrame(bool simulating) {
 	g_CallbackManager.ProcessPendingCallbacks();
+	g_HttpClient.ProcessCompletions();
 }
 
 bool SocketExtension::SDK_OnLoad(char* error, size_t maxlen, bool late) {
@@ -27,6 +67,8 @@ bool SocketExtension::SDK_OnLoad(char* error, size_t maxlen, bool late) {
 	sharesys->RegisterLibrary(myself, "socket");
 
 	smutils->AddGameFrameHook(&OnGameFrame);
+	plsys->AddPluginsListener(this);
+	rootconsole->AddRootConsoleCommand3("socket", "Socket extension statistics", this);
 	g_SocketManager.Start();
 
 	return true;
@@ -34,7 +76,10 @@ bool SocketExtension::SDK_OnLoad(char* error, size_t maxlen, bool late) {
 
 void SocketExtension::SDK_OnUnload() {
 	smutils->RemoveGameFrameHook(&OnGameFrame);
+	plsys->RemovePluginsListener(this);
+	rootconsole->RemoveRootConsoleCommand("socket", this);
 	handlesys->RemoveType(g_SocketHandleType, myself->GetIdentity());
+	g_HttpClient.Shutdown();
 	g_SocketManager.Shutdown();
 }
 
@@ -42,4 +87,80 @@ void SocketExtension::OnHandleDestroy(HandleType_t type, void* object) {
 	if (object != nullptr) {
 		g_SocketManager.DestroySocket(static_cast<SocketBase*>(object));
 	}
-}
\ No newline at end of file
+}
+
+void SocketExtension::OnPluginUnloaded(IPlugin* plugin) {
+	// HTTP requests are not handles, so drop their callbacks by hand
+	g_HttpClient.CancelRequests(plugin->GetBaseContext());
+}
+
+static void PrintStats() {
+	uint64_t poolHits = 0;
+	uint64_t poolMisses = 0;
+	for (const ReceivePools& pools : g_ReceivePools) {
+		poolHits += pools.GetHits();
+		poolMisses += pools.GetMisses();
+	}
+
+	rootconsole->ConsolePrint("[Socket] Callbacks: %zu pending (high water %zu), %zu sockets ready, %llu hand-overs delayed, %llu events dropped",
+		g_CallbackManager.GetPendingCount(), g_CallbackManager.GetPendingHighWater(),
+		g_CallbackManager.GetReadyQueueDepth(),
+		static_cast<unsigned long long>(g_CallbackManager.GetReadyQueueFull()),
+		static_cast<unsigned long long>(g_CallbackManager.GetDroppedEvents()));
+	rootconsole->ConsolePrint("[Socket] Receive buffers: %llu pooled, %llu allocated",
+		static_cast<unsigned long long>(poolHits), static_cast<unsigned long long>(poolMisses));
+
+	for (size_t i = 0; i < g_EventLoops.GetCount(); ++i) {
+		EventLoop& loop = g_EventLoops.Get(i);
+		DnsCache& dns = loop.GetDnsCache();
+		rootconsole->ConsolePrint("[Socket] Loop %zu: %zu sockets, %zu jobs (high water %zu, %llu overflowed), %llu send allocations, DNS %llu hits / %llu misses",
+			i, g_SocketManager.GetLoopSocketCount(i),
+			loop.GetJobQueueDepth(), loop.GetJobQueueHighWater(),
+			static_cast<unsigned long long>(loop.GetOverflowCount()),
+			static_cast<unsigned long long>(loop.GetSendPool().GetAllocations()),
+			static_cast<unsigned long long>(dns.GetHits()), static_cast<unsigned long long>(dns.GetMisses()));
+	}
+}
+
+static void PrintLatency(const char* name, const LatencyHistogram& histogram) {
+	if (!histogram.GetCount()) return;
+
+	rootconsole->ConsolePrint("    %-10s %10llu  p50 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f",
+		name, static_cast<unsigned long long>(histogram.GetCount()),
+		histogram.Percentile(0.5) / 1000.0, histogram.Percentile(0.99) / 1000.0,
+		histogram.Percentile(0.999) / 1000.0, histogram.GetMax() / 1000.0);
+}
+
+static void PrintLatencies() {
+	rootconsole->ConsolePrint("[Socket] Queue wait, enqueue to dispatch (us):");
+	for (size_t type = 0; type < CallbackManager::kEventTypeCount; ++type) {
+		PrintLatency(CallbackManager::GetEventTypeName(type), g_CallbackManager.GetQueueLatency(type));
+	}
+	rootconsole->ConsolePrint("[Socket] Callback time (us):");
+	for (size_t type = 0; type < CallbackManager::kEventTypeCount; ++type) {
+		PrintLatency(CallbackManager::GetEventTypeName(type), g_CallbackManager.GetCallbackLatency(type));
+	}
+}
+
+void SocketExtension::OnRootConsoleCommand(const char* cmdname, const ICommandArgs* args) {
+	if (args->ArgC() >= 3) {
+		const char* command = args->Arg(2);
+		if (strcmp(command, "stats") == 0) {
+			PrintStats();
+			return;
+		}
+		if (strcmp(command, "latency") == 0) {
+			if (args->ArgC() >= 4 && strcmp(args->Arg(3), "reset") == 0) {
+				g_CallbackManager.ResetLatency();
+				rootconsole->ConsolePrint("[Socket] Latency histograms cleared");
+			} else {
+				PrintLatencies();
+			}
+			return;
+		}
+	}
+
+	rootconsole->ConsolePrint("SourceMod Socket Extension Menu:");
+	rootconsole->DrawGenericOption("stats", "Show event loop, queue and buffer pool statistics");
+	rootconsole->DrawGenericOption("latency", "Show event queue wait and callback time percentiles (\"reset\" clears them)");
+}
@@ -3,11 +3,13 @@
 
 #include "smsdk_ext.h"
 
-class SocketExtension : public SDKExtension, public IHandleTypeDispatch {
+class SocketExtension : public SDKExtension, public IHandleTypeDispatch, public IPluginsListener, public IRootConsoleCommand {
 public:
 	bool SDK_OnLoad(char* error, size_t maxlen, bool late) override;
 	void SDK_OnUnload() override;
 	void OnHandleDestroy(HandleType_t type, void* object) override;
+	void OnPluginUnloaded(IPlugin* plugin) override;
+	void OnRootConsoleCommand(const char* cmdname, const ICommandArgs* args) override;
 };
 
 extern HandleType_t g_SocketHandleType;
@@ -0,0 +1,139 @@
+#include "core/BufferPool.h"
+#include "core/EventLoop.h"
+#include <new>
+
+ReceivePools g_ReceivePools[kMaxEventLoops];
+
+ReceivePools& GetReceivePools() {
+	return g_ReceivePools[EventLoop::Current()->GetIndex()];
+}
+
+uint64_t ReceivePools::GetHits() const {
+	uint64_t hits = datagram.GetHits() + datagramBatch.GetHits() + smallDatagram.GetHits();
+	for (const BufferPool& pool : stream) {
+		hits += pool.GetHits();
+	}
+	return hits;
+}
+
+uint64_t ReceivePools::GetMisses() const {
+	uint64_t misses = datagram.GetMisses() + datagramBatch.GetMisses() + smallDatagram.GetMisses();
+	for (const BufferPool& pool : stream) {
+		misses += pool.GetMisses();
+	}
+	return misses;
+}
+
+void PooledBuffer::Release() {
+	if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		if (pool) {
+			pool->Recycle(this);
+		} else {
+			BufferPool::Free(this);
+		}
+	}
+}
+
+BufferPool::BufferPool(size_t slabSize, size_t maxCached)
+	: m_slabSize(slabSize), m_freeList(maxCached) {}
+
+BufferPool::~BufferPool() {
+	PooledBuffer* buffer = m_freeList.TakeAll();
+	while (buffer) {
+		PooledBuffer* next = buffer->next;
+		Free(buffer);
+		buffer = next;
+	}
+}
+
+PooledBuffer* BufferPool::Acquire() {
+	if (PooledBuffer* buffer = m_freeList.Pop()) {
+		m_hits.fetch_add(1, std::memory_order_relaxed);
+		buffer->refs.store(1, std::memory_order_relaxed);
+		return buffer;
+	}
+
+	m_misses.fetch_add(1, std::memory_order_relaxed);
+
+	// Header + payload + terminator byte
+	void* memory = ::operator new(sizeof(PooledBuffer) + m_slabSize + 1, std::nothrow);
+	if (!memory) {
+		return nullptr;
+	}
+
+	auto* buffer = new (memory) PooledBuffer;
+	buffer->pool = this;
+	return buffer;
+}
+
+void BufferPool::Recycle(PooledBuffer* buffer) {
+	if (!m_freeList.Push(buffer)) {
+		Free(buffer);
+	}
+}
+
+void BufferPool::Free(PooledBuffer* buffer) {
+	buffer->~PooledBuffer();
+	::operator delete(buffer);
+}
+
+PooledBuffer* AcquireBuffer(size_t length) {
+	for (BufferPool& pool : GetReceivePools().stream) {
+		if (pool.GetSlabSize() >= length) {
+			return pool.Acquire();
+		}
+	}
+
+	void* memory = ::operator new(sizeof(PooledBuffer) + length + 1, std::nothrow);
+	if (!memory) {
+		return nullptr;
+	}
+	return new (memory) PooledBuffer;
+}
+
+PooledBuffer* ReceiveSizer::Acquire(int chunkSize, size_t& length) {
+	m_adaptive = chunkSize < 0;
+
+	BufferPool* pools = GetReceivePools().stream;
+
+	size_t sizeClass = kDefaultStreamSizeClass;
+	if (m_adaptive) {
+		sizeClass = m_class;
+	} else if (chunkSize > 0) {
+		sizeClass = 0;
+		while (sizeClass + 1 < kStreamSizeClasses && pools[sizeClass].GetSlabSize() < static_cast<size_t>(chunkSize)) {
+			++sizeClass;
+		}
+	}
+
+	BufferPool& pool = pools[sizeClass];
+	length = pool.GetSlabSize();
+	if (chunkSize > 0 && static_cast<size_t>(chunkSize) < length) {
+		length = static_cast<size_t>(chunkSize);
+	}
+
+	return pool.Acquire();
+}
+
+void ReceiveSizer::Record(size_t bytesRead, size_t length) {
+	if (!m_adaptive) {
+		return;
+	}
+
+	if (bytesRead >= length) {
+		if (m_class + 1u < kStreamSizeClasses) {
+			++m_class;
+		}
+		m_shrinkStreak = 0;
+		return;
+	}
+
+	if (m_class > 0 && bytesRead <= GetReceivePools().stream[m_class - 1].GetSlabSize()) {
+		if (++m_shrinkStreak >= 2) {
+			--m_class;
+			m_shrinkStreak = 0;
+		}
+	} else {
+		m_shrinkStreak = 0;
+	}
+}
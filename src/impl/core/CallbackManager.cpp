@@ -1,44 +1,75 @@
 #include "core/CallbackManager.h"
+#include "core/BufferPool.h"
+#include "core/EventLoop.h"
+#include "core/SocketHost.h"
 #include "socket/SocketBase.h"
-#include "extension.h"
+#include <chrono>
+#include <climits>
 #include <cstring>
-#include <cstdlib>
+#include <new>
+#include <type_traits>
 
 CallbackManager g_CallbackManager;
 
+SocketEventQueue::~SocketEventQueue() {
+	// Events that were never dispatched still own their payloads
+	while (EventNode* node = events.pop()) {
+		g_CallbackManager.DiscardNode(node);
+	}
+}
+
+CallbackManager::CallbackManager() {
+	m_loops[0] = std::make_unique<LoopQueues>();
+}
+
+CallbackManager::~CallbackManager() {
+	// Drop the scheduler's queue references while the node pools are still alive
+	QueueRef queue;
+	for (auto& loop : m_loops) {
+		while (loop && loop->ready.try_dequeue(queue)) {
+			queue.reset();
+		}
+	}
+	m_active.clear();
+	m_direct.clear();
+
+	for (auto& loop : m_loops) {
+		if (!loop) continue;
+		EventNode* node = loop->nodes.TakeAll();
+		while (node) {
+			EventNode* next = node->freeNext;
+			delete node;
+			node = next;
+		}
+	}
+}
+
+void CallbackManager::ReserveLoops(size_t count) {
+	for (size_t i = 0; i < count && i < kMaxEventLoops; ++i) {
+		if (!m_loops[i]) {
+			m_loops[i] = std::make_unique<LoopQueues>();
+		}
+	}
+}
+
 void CallbackManager::EnqueueConnect(SocketBase* socket, const RemoteEndpoint& endpoint) {
 	QueuedConnectEvent event;
 	event.socket = socket;
 	event.remoteEndpoint = endpoint;
-
-	if (!m_connectQueue.try_enqueue(std::move(event))) {
-		if (g_GlobalOptions.Get(SocketOption::DebugMode)) {
-			smutils->LogError(myself, "[Socket] Connect queue full, dropping event");
-		}
-	}
+	Enqueue(socket, std::move(event));
 }
 
 void CallbackManager::EnqueueDisconnect(SocketBase* socket) {
 	QueuedDisconnectEvent event;
 	event.socket = socket;
-
-	if (!m_disconnectQueue.try_enqueue(std::move(event))) {
-		if (g_GlobalOptions.Get(SocketOption::DebugMode)) {
-			smutils->LogError(myself, "[Socket] Disconnect queue full, dropping event");
-		}
-	}
+	Enqueue(socket, std::move(event));
 }
 
 void CallbackManager::EnqueueListen(SocketBase* socket, const RemoteEndpoint& localEndpoint) {
 	QueuedListenEvent event;
 	event.socket = socket;
 	event.localEndpoint = localEndpoint;
-
-	if (!m_listenQueue.try_enqueue(std::move(event))) {
-		if (g_GlobalOptions.Get(SocketOption::DebugMode)) {
-			smutils->LogError(myself, "[Socket] Listen queue full, dropping event");
-		}
-	}
+	Enqueue(socket, std::move(event));
 }
 
 void CallbackManager::EnqueueIncoming(SocketBase* socket, SocketBase* newSocket, const RemoteEndpoint& remoteEndpoint) {
@@ -46,58 +77,191 @@ void CallbackManager::EnqueueIncoming(SocketBase* socket, SocketBase* newSocket,
 	event.socket = socket;
 	event.newSocket = newSocket;
 	event.remoteEndpoint = remoteEndpoint;
-
-	if (!m_incomingQueue.try_enqueue(std::move(event))) {
-		if (g_GlobalOptions.Get(SocketOption::DebugMode)) {
-			smutils->LogError(myself, "[Socket] Incoming queue full, dropping event");
-		}
-	}
+	Enqueue(socket, std::move(event));
 }
 
-void CallbackManager::EnqueueReceive(SocketBase* socket, const char* data, size_t length) {
+void CallbackManager::EnqueueReceive(SocketBase* socket, PooledBuffer* buffer, char* data, size_t length) {
 	RemoteEndpoint emptyEndpoint;
-	EnqueueReceive(socket, data, length, emptyEndpoint);
+	EnqueueReceive(socket, buffer, data, length, emptyEndpoint);
 }
 
-void CallbackManager::EnqueueReceive(SocketBase* socket, const char* data, size_t length, const RemoteEndpoint& sender) {
-	// Allocate buffer for data (consumer will free)
-	char* dataCopy = static_cast<char*>(malloc(length + 1));
-	if (!dataCopy) {
-		if (g_GlobalOptions.Get(SocketOption::DebugMode)) {
-			smutils->LogError(myself, "[Socket] Failed to allocate memory for receive data");
-		}
-		return;
-	}
-	memcpy(dataCopy, data, length);
-	dataCopy[length] = '\0';
-
+void CallbackManager::EnqueueReceive(SocketBase* socket, PooledBuffer* buffer, char* data, size_t length, const RemoteEndpoint& sender) {
 	QueuedDataEvent event;
 	event.socket = socket;
-	event.data = dataCopy;
+	event.buffer = buffer;
+	event.data = data;
 	event.length = length;
 	event.sender = sender;
-
-	if (!m_dataQueue.try_enqueue(std::move(event))) {
-		free(dataCopy);
-		if (g_GlobalOptions.Get(SocketOption::DebugMode)) {
-			smutils->LogError(myself, "[Socket] Data queue full, dropping event");
-		}
-	}
+	Enqueue(socket, std::move(event));
 }
 
 void CallbackManager::EnqueueError(SocketBase* socket, SocketError errorType, const char* errorMsg) {
+	// Counted even if the event itself is dropped
+	if (errorType == SocketError::SendError) {
+		socket->GetEventQueue()->sendErrors.fetch_add(1, std::memory_order_relaxed);
+	} else if (errorType == SocketError::RecvError) {
+		socket->GetEventQueue()->receiveErrors.fetch_add(1, std::memory_order_relaxed);
+	}
+
 	QueuedErrorEvent event;
 	event.socket = socket;
 	event.errorType = errorType;
 	event.errorMsg = errorMsg;
+	Enqueue(socket, std::move(event));
+}
+
+void CallbackManager::Enqueue(SocketBase* socket, QueuedEvent&& event) {
+	const QueueRef& queue = socket->GetEventQueue();
+
+	auto* data = std::get_if<QueuedDataEvent>(&event);
+	const size_t length = data ? data->length : 0;
+
+	// Stream sockets are paused well before this; datagrams keep drop semantics
+	bool full = queue->pending.load(std::memory_order_relaxed) >= kMaxPendingPerSocket;
+	if (!full && data && socket->GetType() == SocketType::Udp) {
+		full = queue->pendingBytes.load(std::memory_order_relaxed) + length > GetHighWatermark(socket);
+	}
 
-	if (!m_errorQueue.try_enqueue(std::move(event))) {
+	// The producing loop, not the socket's: ReusePort listeners receive on every loop
+	EventLoop* current = EventLoop::Current();
+	const uint8_t loop = current ? current->GetIndex() : socket->GetEventLoop().GetIndex();
+	EventNode* node = full ? nullptr : AllocateNode(loop);
+	if (!node) {
+		ReleasePayload(event);
+		queue->droppedEvents.fetch_add(1, std::memory_order_relaxed);
+		m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
 		if (g_GlobalOptions.Get(SocketOption::DebugMode)) {
-			smutils->LogError(myself, "[Socket] Error queue full, dropping event");
+			g_SocketHost->LogError("[Socket] Event queue full for socket, dropping event");
 		}
+		return;
+	}
+
+	node->event = std::move(event);
+	node->enqueueTime = uv_hrtime();
+	queue->pending.fetch_add(1, std::memory_order_relaxed);
+	queue->pendingBytes.fetch_add(length, std::memory_order_relaxed);
+	if (data) {
+		queue->bytesReceived.fetch_add(length, std::memory_order_relaxed);
+		queue->messagesReceived.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	size_t pending = m_pendingEvents.fetch_add(1, std::memory_order_relaxed) + 1;
+	size_t highWater = m_pendingHighWater.load(std::memory_order_relaxed);
+	while (pending > highWater && !m_pendingHighWater.compare_exchange_weak(highWater, pending, std::memory_order_relaxed)) {
+	}
+
+	queue->events.push(node);
+
+	// Pairs with the fence in SetIdle: either the game thread sees this node
+	// when it goes idle, or we see the queue unscheduled and hand it over
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (!queue->scheduled.exchange(true, std::memory_order_acq_rel)) {
+		if (!m_loops[loop]->ready.try_enqueue(QueueRef(queue))) {
+			// Retried by the next event on this socket
+			queue->scheduled.store(false, std::memory_order_release);
+			m_readyQueueFull.fetch_add(1, std::memory_order_relaxed);
+			if (g_GlobalOptions.Get(SocketOption::DebugMode)) {
+				g_SocketHost->LogError("[Socket] Ready queue full, deferring socket");
+			}
+		}
+	}
+}
+
+bool CallbackManager::PauseIfBacklogged(SocketBase* socket) {
+	SocketEventQueue& queue = *socket->GetEventQueue();
+
+	if (queue.pendingBytes.load(std::memory_order_relaxed) <= GetHighWatermark(socket) &&
+	    queue.pending.load(std::memory_order_relaxed) < kPauseEventCount) {
+		return false;
+	}
+
+	// seq_cst pairs with Unaccount/ResumeIfDrained: either the game thread
+	// sees the flag on a later dispatch, or we see its final decrement here
+	if (queue.receivePaused.exchange(true, std::memory_order_seq_cst)) {
+		return false;
+	}
+
+	queue.receivePauses.fetch_add(1, std::memory_order_relaxed);
+
+	// The game thread drained everything before it could see the flag
+	if (queue.pending.load(std::memory_order_seq_cst) == 0) {
+		queue.receivePaused.store(false, std::memory_order_release);
+		return false;
+	}
+	return true;
+}
+
+void CallbackManager::Unaccount(SocketEventQueue& queue, const QueuedEvent& event) {
+	queue.pending.fetch_sub(1, std::memory_order_seq_cst);
+	m_pendingEvents.fetch_sub(1, std::memory_order_relaxed);
+	if (auto* data = std::get_if<QueuedDataEvent>(&event)) {
+		queue.pendingBytes.fetch_sub(data->length, std::memory_order_relaxed);
 	}
 }
 
+void CallbackManager::ResumeIfDrained(SocketEventQueue& queue) {
+	if (!queue.receivePaused.load(std::memory_order_seq_cst)) return;
+	if (queue.detached.load(std::memory_order_relaxed)) return;
+
+	if (queue.pendingBytes.load(std::memory_order_relaxed) > GetLowWatermark(queue.owner) ||
+	    queue.pending.load(std::memory_order_relaxed) > kResumeEventCount) {
+		return;
+	}
+
+	if (queue.receivePaused.exchange(false, std::memory_order_acq_rel)) {
+		queue.owner->ResumeReceiving();
+	}
+}
+
+size_t CallbackManager::GetHighWatermark(SocketBase* socket) {
+	int high = socket->GetOption(SocketOption::BackpressureHigh);
+	return high > 0 ? static_cast<size_t>(high) : kDefaultHighWatermark;
+}
+
+size_t CallbackManager::GetLowWatermark(SocketBase* socket) {
+	size_t high = GetHighWatermark(socket);
+	int low = socket->GetOption(SocketOption::BackpressureLow);
+	if (low <= 0) return high / 4;
+	return static_cast<size_t>(low) < high ? static_cast<size_t>(low) : high;
+}
+
+EventNode* CallbackManager::AllocateNode(uint8_t loop) {
+	EventNode* node = m_loops[loop]->nodes.Pop();
+	if (!node) {
+		node = new (std::nothrow) EventNode;
+		if (node) {
+			node->loop = loop;
+		}
+	}
+	return node;
+}
+
+void CallbackManager::FreeNode(EventNode* node) {
+	// Drop any strings held by the event before caching the node
+	node->event = QueuedEvent{};
+	if (!m_loops[node->loop]->nodes.Push(node)) {
+		delete node;
+	}
+}
+
+void CallbackManager::DiscardNode(EventNode* node) {
+	m_pendingEvents.fetch_sub(1, std::memory_order_relaxed);
+	ReleasePayload(node->event);
+	FreeNode(node);
+}
+
+void CallbackManager::ReleasePayload(QueuedEvent& event) {
+	if (auto* data = std::get_if<QueuedDataEvent>(&event)) {
+		data->buffer->Release();
+	}
+}
+
+bool CallbackManager::IsDirectDispatch(SocketBase* socket) const {
+	return socket->GetOption(SocketOption::DirectDispatch) &&
+	       !g_GlobalOptions.Get(SocketOption::ForceFrameLock);
+}
+
 bool CallbackManager::IsSocketValid(SocketBase* socket) const {
 	if (!socket) return false;
 	if (socket->IsDeleted()) return false;
@@ -105,80 +269,289 @@ bool CallbackManager::IsSocketValid(SocketBase* socket) const {
 }
 
 bool CallbackManager::HasPendingCallbacks() const {
-	return !m_connectQueue.empty() ||
-	       !m_disconnectQueue.empty() ||
-	       !m_listenQueue.empty() ||
-	       !m_incomingQueue.empty() ||
-	       !m_dataQueue.empty() ||
-	       !m_errorQueue.empty();
+	return m_pendingEvents.load(std::memory_order_relaxed) > 0;
 }
 
-void CallbackManager::ProcessPendingCallbacks() {
-	int maxCallbacks = g_GlobalOptions.Get(SocketOption::CallbacksPerFrame);
-	int processed = 0;
+size_t CallbackManager::GetPendingCount() const {
+	return m_pendingEvents.load(std::memory_order_relaxed);
+}
+
+size_t CallbackManager::GetReadyQueueDepth() const {
+	size_t depth = 0;
+	for (const auto& loop : m_loops) {
+		if (loop) {
+			depth += loop->ready.size_approx();
+		}
+	}
+	return depth;
+}
 
-	// Process callbacks in round-robin fashion across all queues
-	// Order: Connect -> Listen -> Incoming -> Data -> Disconnect -> Error
-	while (processed < maxCallbacks) {
-		bool anyProcessed = false;
+const char* CallbackManager::GetEventTypeName(size_t type) {
+	// Same order as the QueuedEvent alternatives
+	static const char* const kNames[kEventTypeCount] = {
+		"Connect",
+		"Disconnect",
+		"Listen",
+		"Incoming",
+		"Receive",
+		"Error",
+	};
+	return type < kEventTypeCount ? kNames[type] : "Unknown";
+}
 
-		// Connect events
-		QueuedConnectEvent connectEvent;
-		if (m_connectQueue.try_dequeue(connectEvent)) {
-			ExecuteConnect(connectEvent);
-			++processed;
-			anyProcessed = true;
-			if (processed >= maxCallbacks) break;
+void CallbackManager::ResetLatency() {
+	for (size_t type = 0; type < kEventTypeCount; ++type) {
+		m_queueLatency[type].Reset();
+		m_callbackLatency[type].Reset();
+	}
+}
+
+int64_t CallbackManager::GetEventCost(const QueuedEvent& event) {
+	if (auto* data = std::get_if<QueuedDataEvent>(&event)) {
+		return kEventBaseCost + static_cast<int64_t>(data->length);
+	}
+	return kEventBaseCost;
+}
+
+void CallbackManager::CollectReadyQueues() {
+	QueueRef queue;
+	for (auto& loop : m_loops) {
+		if (!loop) continue;
+		while (loop->ready.try_dequeue(queue)) {
+			Activate(std::move(queue));
 		}
+	}
+}
 
-		// Listen events
-		QueuedListenEvent listenEvent;
-		if (m_listenQueue.try_dequeue(listenEvent)) {
-			ExecuteListen(listenEvent);
-			++processed;
-			anyProcessed = true;
-			if (processed >= maxCallbacks) break;
+void CallbackManager::Activate(QueueRef&& queue) {
+	// The socket is gone, its queue frees the remaining events on release
+	if (queue->detached.load(std::memory_order_relaxed)) return;
+
+	// Accepted sockets wait for their Incoming callback, see ReleaseHeld
+	if (queue->held.load(std::memory_order_acquire)) {
+		queue->parked = true;
+		return;
+	}
+
+	if (IsDirectDispatch(queue->owner)) {
+		m_direct.push_back(std::move(queue));
+	} else {
+		m_active.push_back(std::move(queue));
+	}
+}
+
+void CallbackManager::SetIdle(QueueRef&& queue) {
+	queue->deficit = 0;
+	queue->scheduled.store(false, std::memory_order_relaxed);
+
+	// Pairs with the fence in Enqueue
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (queue->events.front() && !queue->scheduled.exchange(true, std::memory_order_acq_rel)) {
+		Activate(std::move(queue));
+	}
+}
+
+void CallbackManager::ReleaseHeld(const QueueRef& queue) {
+	queue->held.store(false, std::memory_order_release);
+	if (queue->parked) {
+		queue->parked = false;
+		Activate(QueueRef(queue));
+	}
+}
+
+int64_t CallbackManager::DispatchNext(SocketEventQueue& queue, size_t concatLimit) {
+	EventNode* node = queue.events.pop();
+	if (!node) return -1;
+
+	Unaccount(queue, node->event);
+
+	// Merged receives count as the oldest event's type and wait
+	const size_t type = node->event.index();
+	const uint64_t start = uv_hrtime();
+	m_queueLatency[type].Record(start - node->enqueueTime);
+
+	int64_t cost;
+	auto* data = std::get_if<QueuedDataEvent>(&node->event);
+	if (data && concatLimit) {
+		cost = ExecuteConcatenatedReceive(queue, *data, concatLimit);
+	} else {
+		cost = GetEventCost(node->event);
+		ExecuteEvent(node->event);
+	}
+	m_callbackLatency[type].Record(uv_hrtime() - start);
+
+	// Payload was released by the Execute call
+	FreeNode(node);
+	ResumeIfDrained(queue);
+	return cost;
+}
+
+void CallbackManager::ProcessDirectQueues(size_t concatLimit) {
+	for (size_t count = m_direct.size(); count > 0 && !m_direct.empty(); --count) {
+		QueueRef queue = std::move(m_direct.front());
+		m_direct.pop_front();
+
+		if (queue->detached.load(std::memory_order_relaxed)) continue;
+
+		// DirectDispatch was turned off or ForceFrameLock turned on
+		if (!IsDirectDispatch(queue->owner)) {
+			m_active.push_back(std::move(queue));
+			continue;
 		}
 
-		// Incoming connection events
-		QueuedIncomingEvent incomingEvent;
-		if (m_incomingQueue.try_dequeue(incomingEvent)) {
-			ExecuteIncoming(incomingEvent);
-			++processed;
-			anyProcessed = true;
-			if (processed >= maxCallbacks) break;
+		// Only drain what is already queued so a flooding peer cannot pin the frame
+		size_t pending = queue->pending.load(std::memory_order_relaxed);
+		while (pending-- > 0 && !queue->detached.load(std::memory_order_relaxed)) {
+			if (DispatchNext(*queue, concatLimit) < 0) break;
 		}
 
-		// Data receive events
-		QueuedDataEvent dataEvent;
-		if (m_dataQueue.try_dequeue(dataEvent)) {
-			ExecuteReceive(dataEvent);
-			++processed;
-			anyProcessed = true;
-			if (processed >= maxCallbacks) break;
+		if (queue->detached.load(std::memory_order_relaxed)) continue;
+
+		if (queue->events.front()) {
+			m_direct.push_back(std::move(queue));
+		} else {
+			SetIdle(std::move(queue));
 		}
+	}
+}
 
-		// Disconnect events
-		QueuedDisconnectEvent disconnectEvent;
-		if (m_disconnectQueue.try_dequeue(disconnectEvent)) {
-			ExecuteDisconnect(disconnectEvent);
-			++processed;
-			anyProcessed = true;
-			if (processed >= maxCallbacks) break;
+void CallbackManager::ProcessPendingCallbacks() {
+	using Clock = std::chrono::steady_clock;
+
+	CollectReadyQueues();
+
+	// ConcatenateCallbacks: max merged chunk size for stream sockets (0 = disabled)
+	size_t concatLimit = 0;
+	if (int concatenate = g_GlobalOptions.Get(SocketOption::ConcatenateCallbacks); concatenate > 0) {
+		concatLimit = static_cast<size_t>(concatenate);
+		if (concatLimit < kMinConcatenateSize) concatLimit = kMinConcatenateSize;
+	}
+
+	ProcessDirectQueues(concatLimit);
+
+	auto mode = static_cast<CallbackBudgetMode>(g_GlobalOptions.Get(SocketOption::CallbackBudgetMode));
+	const int timeSliceUs = g_GlobalOptions.Get(SocketOption::CallbackTimeSlice);
+	const auto timeSlice = std::chrono::microseconds(timeSliceUs > 0 ? timeSliceUs : 1);
+	const auto start = Clock::now();
+
+	int maxCallbacks;
+	switch (mode) {
+		case CallbackBudgetMode::TimeSlice:
+			maxCallbacks = INT_MAX;
+			break;
+		case CallbackBudgetMode::Adaptive:
+			if (m_adaptiveBudget < 1) m_adaptiveBudget = 1;
+			maxCallbacks = m_adaptiveBudget;
+			break;
+		default:
+			maxCallbacks = g_GlobalOptions.Get(SocketOption::CallbacksPerFrame);
+			mode = CallbackBudgetMode::Count;
+			break;
+	}
+
+	int processed = 0;
+	bool outOfTime = false;
+
+	// Count mode never reads the clock; the other modes always make progress
+	// on at least one event per frame even if the slice is tiny
+	auto budgetExhausted = [&]() {
+		if (processed >= maxCallbacks) return true;
+		if (mode != CallbackBudgetMode::Count && Clock::now() - start >= timeSlice) {
+			outOfTime = true;
+			return true;
+		}
+		return false;
+	};
+
+	// Queues whose next event is still being linked in by a producer
+	std::vector<QueueRef> stalled;
+
+	// Deficit round robin: every visit grants a queue one quantum of credit and
+	// each event is charged by size, a queue keeps its unspent credit only while
+	// it still has events
+	bool exhausted = processed >= maxCallbacks;
+	while (!exhausted && !m_active.empty()) {
+		QueueRef queue = std::move(m_active.front());
+		m_active.pop_front();
+
+		if (queue->detached.load(std::memory_order_relaxed)) continue;
+
+		// DirectDispatch was turned on, serve it from the next frame's direct pass
+		if (IsDirectDispatch(queue->owner)) {
+			m_direct.push_back(std::move(queue));
+			continue;
 		}
 
-		// Error events
-		QueuedErrorEvent errorEvent;
-		if (m_errorQueue.try_dequeue(errorEvent)) {
-			ExecuteError(errorEvent);
+		queue->deficit += kSchedulerQuantum;
+
+		bool isStalled = false;
+		while (queue->deficit > 0) {
+			int64_t cost = DispatchNext(*queue, concatLimit);
+			if (cost < 0) {
+				isStalled = true;
+				break;
+			}
+
+			queue->deficit -= cost;
 			++processed;
-			anyProcessed = true;
-			if (processed >= maxCallbacks) break;
+
+			if (queue->detached.load(std::memory_order_relaxed)) break;
+			if (budgetExhausted()) {
+				exhausted = true;
+				break;
+			}
+		}
+
+		if (queue->detached.load(std::memory_order_relaxed)) continue;
+
+		if (!queue->events.front()) {
+			SetIdle(std::move(queue));
+		} else if (isStalled) {
+			stalled.push_back(std::move(queue));
+		} else if (exhausted && queue->deficit > 0) {
+			// Interrupted mid-turn, resume it first next frame
+			m_active.push_front(std::move(queue));
+		} else {
+			m_active.push_back(std::move(queue));
 		}
+	}
 
-		// No more events in any queue
-		if (!anyProcessed) break;
+	for (QueueRef& queue : stalled) {
+		m_active.push_back(std::move(queue));
 	}
+
+	if (mode == CallbackBudgetMode::Adaptive) {
+		if (outOfTime) {
+			// Frame time is tight, back off
+			m_adaptiveBudget = processed > 1 ? processed / 2 : 1;
+		} else if (processed >= maxCallbacks && GetPendingCount() > 0) {
+			// Budget ran out with time to spare and work left, grow with the backlog
+			m_adaptiveBudget = m_adaptiveBudget < kMaxAdaptiveBudget / 2 ? m_adaptiveBudget * 2 : kMaxAdaptiveBudget;
+		}
+	}
+}
+
+void CallbackManager::ExecuteEvent(QueuedEvent& event) {
+	std::visit([this](auto& typedEvent) {
+		using T = std::decay_t<decltype(typedEvent)>;
+		if constexpr (std::is_same_v<T, QueuedConnectEvent>) {
+			ExecuteConnect(typedEvent);
+		} else if constexpr (std::is_same_v<T, QueuedDisconnectEvent>) {
+			ExecuteDisconnect(typedEvent);
+		} else if constexpr (std::is_same_v<T, QueuedListenEvent>) {
+			ExecuteListen(typedEvent);
+		} else if constexpr (std::is_same_v<T, QueuedIncomingEvent>) {
+			// The accepted socket's own events wait until it has a handle
+			QueueRef accepted = typedEvent.newSocket ? typedEvent.newSocket->GetEventQueue() : nullptr;
+			ExecuteIncoming(typedEvent);
+			if (accepted) ReleaseHeld(accepted);
+		} else if constexpr (std::is_same_v<T, QueuedDataEvent>) {
+			ExecuteReceive(typedEvent);
+		} else if constexpr (std::is_same_v<T, QueuedErrorEvent>) {
+			ExecuteError(typedEvent);
+		}
+	}, event);
 }
 
 void CallbackManager::ExecuteConnect(const QueuedConnectEvent& event) {
@@ -203,8 +576,7 @@ void CallbackManager::ExecuteDisconnect(const QueuedDisconnectEvent& event) {
 	callbackInfo.function->Execute(nullptr);
 
 	if (event.socket->GetOption(SocketOption::AutoFreeHandle) && event.socket->m_smHandle) {
-		HandleSecurity security(callbackInfo.function->GetParentContext()->GetIdentity(), myself->GetIdentity());
-		handlesys->FreeHandle(event.socket->m_smHandle, &security);
+		g_SocketHost->FreeSocketHandle(event.socket, callbackInfo.function);
 	}
 }
 
@@ -228,12 +600,7 @@ void CallbackManager::ExecuteIncoming(const QueuedIncomingEvent& event) {
 	auto& callbackInfo = event.socket->GetCallback(CallbackEvent::Incoming);
 	if (!callbackInfo.function) return;
 
-	event.newSocket->m_smHandle = handlesys->CreateHandle(
-		g_SocketHandleType,
-		event.newSocket,
-		callbackInfo.function->GetParentContext()->GetIdentity(),
-		myself->GetIdentity(),
-		nullptr);
+	event.newSocket->m_smHandle = g_SocketHost->CreateSocketHandle(event.newSocket, callbackInfo.function);
 
 	callbackInfo.function->PushCell(event.socket->m_smHandle);
 	callbackInfo.function->PushCell(event.newSocket->m_smHandle);
@@ -245,19 +612,79 @@ void CallbackManager::ExecuteIncoming(const QueuedIncomingEvent& event) {
 
 void CallbackManager::ExecuteReceive(const QueuedDataEvent& event) {
 	if (IsSocketValid(event.socket)) {
-		auto& callbackInfo = event.socket->GetCallback(CallbackEvent::Receive);
-		if (callbackInfo.function) {
-			callbackInfo.function->PushCell(event.socket->m_smHandle);
-			callbackInfo.function->PushStringEx(event.data, event.length + 1,
-				SM_PARAM_STRING_COPY | SM_PARAM_STRING_BINARY, 0);
-			callbackInfo.function->PushCell(static_cast<cell_t>(event.length));
-			callbackInfo.function->PushString(event.sender.address.c_str());
-			callbackInfo.function->PushCell(event.sender.port);
-			callbackInfo.function->PushCell(callbackInfo.data);
-			callbackInfo.function->Execute(nullptr);
-		}
+		// The slab always has one spare byte past the payload; terminate in place
+		// and restore it afterwards since other events may share the slab
+		char saved = event.data[event.length];
+		event.data[event.length] = '\0';
+		DispatchReceive(event.socket, event.data, event.length, event.sender);
+		event.data[event.length] = saved;
+	}
+	event.buffer->Release();
+}
+
+int64_t CallbackManager::ExecuteConcatenatedReceive(SocketEventQueue& queue, const QueuedDataEvent& event, size_t maxLength) {
+	const int64_t singleCost = kEventBaseCost + static_cast<int64_t>(event.length);
+
+	// Datagrams and framed messages are delivered one callback each
+	if (!IsSocketValid(event.socket) || event.socket->GetType() == SocketType::Udp ||
+		event.socket->GetOption(SocketOption::FramingMode) != 0 ||
+		event.socket->GetOption(SocketOption::WebSocket) != 0) {
+		ExecuteReceive(event);
+		return singleCost;
+	}
+
+	// Only merge if the very next event on this socket is more data
+	auto nextData = [&queue]() -> QueuedDataEvent* {
+		EventNode* node = queue.events.front();
+		return node ? std::get_if<QueuedDataEvent>(&node->event) : nullptr;
+	};
+
+	QueuedDataEvent* next = nextData();
+	if (!next || event.length + next->length > maxLength) {
+		ExecuteReceive(event);
+		return singleCost;
+	}
+
+	if (m_concatBuffer.size() < maxLength + 1) {
+		m_concatBuffer.resize(maxLength + 1);
 	}
-	free(event.data);
+
+	char* merged = m_concatBuffer.data();
+	size_t length = event.length;
+	std::memcpy(merged, event.data, event.length);
+	event.buffer->Release();
+
+	while (next && length + next->length <= maxLength) {
+		EventNode* node = queue.events.pop();
+		if (!node) break;
+
+		Unaccount(queue, node->event);
+
+		std::memcpy(merged + length, next->data, next->length);
+		length += next->length;
+		next->buffer->Release();
+		FreeNode(node);
+
+		next = nextData();
+	}
+
+	merged[length] = '\0';
+	DispatchReceive(event.socket, merged, length, event.sender);
+	return kEventBaseCost + static_cast<int64_t>(length);
+}
+
+void CallbackManager::DispatchReceive(SocketBase* socket, char* data, size_t length, const RemoteEndpoint& sender) {
+	auto& callbackInfo = socket->GetCallback(CallbackEvent::Receive);
+	if (!callbackInfo.function) return;
+
+	callbackInfo.function->PushCell(socket->m_smHandle);
+	callbackInfo.function->PushStringEx(data, length + 1,
+		SM_PARAM_STRING_COPY | SM_PARAM_STRING_BINARY, 0);
+	callbackInfo.function->PushCell(static_cast<cell_t>(length));
+	callbackInfo.function->PushString(sender.address.c_str());
+	callbackInfo.function->PushCell(sender.port);
+	callbackInfo.function->PushCell(callbackInfo.data);
+	callbackInfo.function->Execute(nullptr);
 }
 
 void CallbackManager::ExecuteError(const QueuedErrorEvent& event) {
@@ -273,7 +700,6 @@ void CallbackManager::ExecuteError(const QueuedErrorEvent& event) {
 	callbackInfo.function->Execute(nullptr);
 
 	if (event.socket->GetOption(SocketOption::AutoFreeHandle) && event.socket->m_smHandle) {
-		HandleSecurity security(callbackInfo.function->GetParentContext()->GetIdentity(), myself->GetIdentity());
-		handlesys->FreeHandle(event.socket->m_smHandle, &security);
+		g_SocketHost->FreeSocketHandle(event.socket, callbackInfo.function);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "core/DnsCache.h"
+#include "core/EventLoop.h"
+#include <cstring>
+#include <new>
+
+bool DnsCache::ParseNumeric(const char* host, uint16_t port, sockaddr_storage& address) {
+	if (!host || !*host) {
+		return false;
+	}
+
+	std::memset(&address, 0, sizeof(address));
+	if (uv_ip4_addr(host, port, reinterpret_cast<sockaddr_in*>(&address)) == 0) {
+		return true;
+	}
+	if (std::strchr(host, ':') && uv_ip6_addr(host, port, reinterpret_cast<sockaddr_in6*>(&address)) == 0) {
+		return true;
+	}
+	return false;
+}
+
+bool DnsCache::Resolve(const char* host, uint16_t port, Callback callback, void* data) {
+	struct Query {
+		std::string host;
+		uint16_t port;
+		Callback callback;
+		void* data;
+	};
+
+	auto* query = new (std::nothrow) Query{host ? host : "", port, callback, data};
+	if (!query) {
+		return false;
+	}
+
+	bool posted = m_loop.Post([this, query]() {
+		Lookup(query->host, query->port, query->callback, query->data);
+		delete query;
+	});
+
+	if (!posted) {
+		delete query;
+		return false;
+	}
+	return true;
+}
+
+void DnsCache::Lookup(const std::string& host, uint16_t port, Callback callback, void* data) {
+	Waiter waiter{port, callback, data};
+
+	sockaddr_storage address;
+	if (ParseNumeric(host.c_str(), port, address)) {
+		callback(data, 0, &address);
+		return;
+	}
+
+	auto entry = m_entries.find(host);
+	if (entry != m_entries.end()) {
+		if (entry->second.expires > uv_now(m_loop.GetLoop())) {
+			m_hits.fetch_add(1, std::memory_order_relaxed);
+			Complete(waiter, entry->second.address);
+			return;
+		}
+		m_entries.erase(entry);
+	}
+
+	m_misses.fetch_add(1, std::memory_order_relaxed);
+
+	auto pending = m_pending.find(host);
+	if (pending != m_pending.end()) {
+		pending->second->waiters.push_back(waiter);
+		return;
+	}
+
+	auto* lookup = new PendingLookup;
+	lookup->request.data = lookup;
+	lookup->cache = this;
+	lookup->host = host;
+	lookup->waiters.push_back(waiter);
+
+	// The socket type only keeps getaddrinfo from listing every address
+	// once per protocol, any of them serves both TCP and UDP
+	struct addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	int result = uv_getaddrinfo(m_loop.GetLoop(), &lookup->request, OnResolved,
+		host.c_str(), nullptr, &hints);
+
+	if (result != 0) {
+		delete lookup;
+		callback(data, result, nullptr);
+		return;
+	}
+
+	m_pending.emplace(host, lookup);
+}
+
+void DnsCache::OnResolved(uv_getaddrinfo_t* request, int status, struct addrinfo* addressInfo) {
+	auto* lookup = static_cast<PendingLookup*>(request->data);
+	DnsCache* cache = lookup->cache;
+	cache->m_pending.erase(lookup->host);
+
+	if (status == 0 && !addressInfo) {
+		status = UV_EAI_NONAME;
+	}
+
+	if (status == 0) {
+		sockaddr_storage address{};
+		std::memcpy(&address, addressInfo->ai_addr, addressInfo->ai_addrlen);
+		cache->Store(lookup->host, address);
+
+		for (const Waiter& waiter : lookup->waiters) {
+			Complete(waiter, address);
+		}
+	} else {
+		for (const Waiter& waiter : lookup->waiters) {
+			waiter.callback(waiter.data, status, nullptr);
+		}
+	}
+
+	if (addressInfo) uv_freeaddrinfo(addressInfo);
+	delete lookup;
+}
+
+void DnsCache::Complete(const Waiter& waiter, const sockaddr_storage& address) {
+	sockaddr_storage result = address;
+	if (result.ss_family == AF_INET6) {
+		reinterpret_cast<sockaddr_in6*>(&result)->sin6_port = htons(waiter.port);
+	} else {
+		reinterpret_cast<sockaddr_in*>(&result)->sin_port = htons(waiter.port);
+	}
+	waiter.callback(waiter.data, 0, &result);
+}
+
+void DnsCache::Store(const std::string& host, const sockaddr_storage& address) {
+	uint64_t now = uv_now(m_loop.GetLoop());
+
+	if (m_entries.size() >= kMaxEntries) {
+		for (auto it = m_entries.begin(); it != m_entries.end();) {
+			if (it->second.expires <= now) {
+				it = m_entries.erase(it);
+			} else {
+				++it;
+			}
+		}
+		// Still full of live names, start over rather than track recency
+		if (m_entries.size() >= kMaxEntries) {
+			m_entries.clear();
+		}
+	}
+
+	m_entries[host] = Entry{address, now + kTtlMs};
+}
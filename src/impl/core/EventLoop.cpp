@@ -1,21 +1,40 @@
 #include "core/EventLoop.h"
+#include <new>
 
-EventLoop g_EventLoop;
+EventLoopPool g_EventLoops;
 
-// Helper struct for std::function wrapper
-struct FunctionWrapper {
-	std::function<void()> func;
-};
+// Loop running on this thread, set once its thread starts
+static thread_local EventLoop* t_currentLoop = nullptr;
 
-static void ExecuteFunctionWrapper(void* data) {
-	auto* wrapper = static_cast<FunctionWrapper*>(data);
-	if (wrapper) {
-		wrapper->func();
-		delete wrapper;
+EventLoopPool::EventLoopPool() {
+	m_loops[0] = std::make_unique<EventLoop>(0);
+}
+
+void EventLoopPool::Start(size_t count) {
+	if (count < 1) count = 1;
+	if (count > kMaxEventLoops) count = kMaxEventLoops;
+
+	for (size_t i = 1; i < count; ++i) {
+		if (!m_loops[i]) {
+			m_loops[i] = std::make_unique<EventLoop>(static_cast<uint8_t>(i));
+		}
+	}
+	if (count > m_count) {
+		m_count = count;
+	}
+
+	for (size_t i = 0; i < m_count; ++i) {
+		m_loops[i]->Start();
 	}
 }
 
-EventLoop::EventLoop() {
+void EventLoopPool::Stop() {
+	for (size_t i = 0; i < m_count; ++i) {
+		m_loops[i]->Stop();
+	}
+}
+
+EventLoop::EventLoop(uint8_t index) : m_index(index) {
 	m_loop = new uv_loop_t;
 	uv_loop_init(m_loop);
 
@@ -34,6 +53,11 @@ EventLoop::~EventLoop() {
 		uv_run(m_loop, UV_RUN_NOWAIT);
 	}
 
+	// Jobs that never ran own nothing we can release safely, just free the nodes
+	while (OverflowJob* node = m_overflow.pop()) {
+		delete node;
+	}
+
 	if (m_loop) {
 		uv_loop_close(m_loop);
 		delete m_loop;
@@ -58,11 +82,9 @@ void EventLoop::Stop() {
 
 	m_stopping.store(true, std::memory_order_release);
 
+	// uv_stop is not thread-safe; wake the loop and let OnAsync stop it
 	uv_async_send(m_async);
 
-	// Stop the loop
-	uv_stop(m_loop);
-
 	if (m_thread.joinable()) {
 		m_thread.join();
 	}
@@ -70,20 +92,32 @@ void EventLoop::Stop() {
 	m_running.store(false, std::memory_order_release);
 }
 
+EventLoop* EventLoop::Current() {
+	return t_currentLoop;
+}
+
 void EventLoop::Run() {
-	while (!m_stopping.load(std::memory_order_acquire)) {
-		uv_run(m_loop, UV_RUN_DEFAULT);
+	t_currentLoop = this;
 
-		if (!m_stopping.load(std::memory_order_acquire)) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
-		}
-	}
+	// m_async stays referenced for the loop's whole lifetime, so uv_run blocks
+	// until I/O, a timer or a Post() arrives and only returns once OnAsync
+	// has called uv_stop
+	uv_run(m_loop, UV_RUN_DEFAULT);
 }
 
 bool EventLoop::Post(void (*callback)(void*), void* data) {
-	AsyncJob job(callback, data);
+	return Post(AsyncJob([callback, data]() { callback(data); }));
+}
+
+bool EventLoop::Post(AsyncJob&& job) {
+	// A full ring leaves the job untouched for the overflow path
+	uint64_t state = m_overflowState.load(std::memory_order_acquire);
+	bool queued = !(state & kOverflowActive) && m_jobQueue.try_enqueue(std::move(job));
+	if (!queued) {
+		queued = PostOverflow(std::move(job), state);
+	}
 
-	if (!m_jobQueue.try_enqueue(std::move(job))) {
+	if (!queued) {
 		return false;
 	}
 
@@ -91,28 +125,152 @@ bool EventLoop::Post(void (*callback)(void*), void* data) {
 	return true;
 }
 
-bool EventLoop::Post(std::function<void()> callback) {
-	// Allocate wrapper on heap (will be freed by ExecuteFunctionWrapper)
-	auto* wrapper = new FunctionWrapper{std::move(callback)};
-
-	if (!Post(ExecuteFunctionWrapper, wrapper)) {
-		delete wrapper;
+bool EventLoop::PostOverflow(AsyncJob&& job, uint64_t state) {
+	auto* node = new (std::nothrow) OverflowJob;
+	if (!node) {
 		return false;
 	}
+	node->job = std::move(job);
+
+	// Setting the overflow bit and counting the push is one atomic step, so the
+	// UV thread can never leave overflow mode with this job still unaccounted
+	for (;;) {
+		if (!(state & kOverflowActive) && m_jobQueue.try_enqueue(std::move(node->job))) {
+			// The UV thread left overflow mode meanwhile and the ring has room
+			delete node;
+			return true;
+		}
+		if (m_overflowState.compare_exchange_weak(state, (state + kOverflowPush) | kOverflowActive,
+			std::memory_order_acq_rel, std::memory_order_acquire)) {
+			break;
+		}
+	}
+	m_overflow.push(node);
+
+	m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+
+	// Depth including this job
+	uint64_t pushed = state / kOverflowPush + 1;
+	uint64_t popped = m_overflowPoppedShared.load(std::memory_order_relaxed);
+	auto depth = static_cast<size_t>(pushed > popped ? pushed - popped : 0);
+
+	size_t highWater = m_overflowHighWater.load(std::memory_order_relaxed);
+	while (depth > highWater && !m_overflowHighWater.compare_exchange_weak(highWater, depth, std::memory_order_relaxed)) {
+	}
 
 	return true;
 }
 
+void EventLoop::TryLeaveOverflow() {
+	// Only once every spilled job has run; a producer that has not counted its
+	// push yet fails its own CAS against the cleared bit and uses the ring
+	uint64_t expected = kOverflowActive | (m_overflowPopped * kOverflowPush);
+	m_overflowState.compare_exchange_strong(expected, m_overflowPopped * kOverflowPush,
+		std::memory_order_acq_rel, std::memory_order_relaxed);
+}
+
+size_t EventLoop::GetJobQueueDepth() const {
+	uint64_t pushed = m_overflowState.load(std::memory_order_relaxed) / kOverflowPush;
+	uint64_t popped = m_overflowPoppedShared.load(std::memory_order_relaxed);
+	return m_jobQueue.size_approx() + static_cast<size_t>(pushed > popped ? pushed - popped : 0);
+}
+
 void EventLoop::OnAsync(uv_async_t* handle) {
 	auto* self = static_cast<EventLoop*>(handle->data);
 
-	// Process all pending jobs
+	// Jobs posted before Stop() still run below, uv_run returns after this pass
+	if (self->m_stopping.load(std::memory_order_acquire)) {
+		uv_stop(handle->loop);
+	}
+
+	self->m_runningJobs = true;
+	self->RunJobs();
+	self->m_runningJobs = false;
+
+	self->RunDeferred();
+}
+
+void EventLoop::Defer(void (*callback)(void*), void* data) {
+	m_deferred.emplace_back(callback, data);
+
+	// Outside a job pass nothing would pick this up until the next wakeup
+	if (!m_runningJobs) {
+		uv_async_send(m_async);
+	}
+}
+
+void EventLoop::RunDeferred() {
+	if (m_deferred.empty()) {
+		return;
+	}
+
+	// Callbacks may defer again, those run on the next pass
+	m_runningDeferred.swap(m_deferred);
+	for (auto& [callback, data] : m_runningDeferred) {
+		callback(data);
+	}
+	m_runningDeferred.clear();
+}
+
+void EventLoop::RunJobs() {
+	// Process pending jobs, at most one queue's worth per wakeup so jobs
+	// that keep posting more jobs cannot starve socket I/O
+	size_t depth = GetJobQueueDepth();
+	if (depth > m_jobHighWater.load(std::memory_order_relaxed)) {
+		m_jobHighWater.store(depth, std::memory_order_relaxed);
+	}
+
 	AsyncJob job;
-	while (self->m_jobQueue.try_dequeue(job)) {
-		if (job.callback) {
-			job.callback(job.data);
+	size_t budget = kJobQueueSize;
+	while (budget > 0) {
+		if (m_jobQueue.try_dequeue(job)) {
+			--budget;
+			if (job) {
+				job();
+			}
+			continue;
+		}
+
+		// Ring jobs always predate spilled ones. A producer still writing its
+		// slot will wake us again once it is published.
+		if (!m_jobQueue.drained()) {
+			return;
+		}
+
+		OverflowJob* node = m_overflow.front();
+		if (!node) {
+			break;
+		}
+
+		// Seeing the node makes its producer's earlier ring claims visible
+		if (!m_jobQueue.drained()) {
+			continue;
+		}
+
+		node = m_overflow.pop();
+		if (!node) {
+			// Next node is still being linked in, its producer will wake us
+			return;
+		}
+
+		++m_overflowPopped;
+		m_overflowPoppedShared.store(m_overflowPopped, std::memory_order_relaxed);
+
+		--budget;
+		job = std::move(node->job);
+		delete node;
+		if (job) {
+			job();
 		}
 	}
+
+	if (m_overflowState.load(std::memory_order_relaxed) & kOverflowActive) {
+		TryLeaveOverflow();
+	}
+
+	if (!m_jobQueue.empty() || m_overflow.front()) {
+		uv_async_send(m_async);
+	}
 }
 
 void EventLoop::OnClose(uv_handle_t* handle) {
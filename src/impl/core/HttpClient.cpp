@@ -0,0 +1,599 @@
+#include "core/HttpClient.h"
+#include "core/HttpHeaders.h"
+#include "core/DnsCache.h"
+#include "core/EventLoop.h"
+#include "core/SendRequest.h"
+#include "socket/SocketTypes.h"
+#include <cstring>
+#include <new>
+
+HttpClient g_HttpClient;
+
+static bool IsIdempotent(std::string_view method) {
+	return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" ||
+	       method == "OPTIONS" || method == "TRACE";
+}
+
+// Split an http:// URL into host, port and request target
+static const char* ParseUrl(std::string_view url, std::string& host, uint16_t& port, std::string& authority, std::string& target) {
+	static constexpr std::string_view kScheme = "http://";
+	if (url.size() >= 8 && EqualsIgnoreCase(url.substr(0, 8), "https://")) {
+		return "HTTPS is not supported";
+	}
+	if (url.size() < kScheme.size() || !EqualsIgnoreCase(url.substr(0, kScheme.size()), kScheme)) {
+		return "URL must start with http://";
+	}
+	url.remove_prefix(kScheme.size());
+
+	size_t authorityEnd = url.find_first_of("/?#");
+	std::string_view hostPort = url.substr(0, authorityEnd);
+	std::string_view path = authorityEnd == std::string_view::npos ? std::string_view() : url.substr(authorityEnd);
+	path = path.substr(0, path.find('#'));
+
+	if (hostPort.find('@') != std::string_view::npos) {
+		return "URLs with credentials are not supported";
+	}
+
+	std::string_view portText;
+	if (!hostPort.empty() && hostPort.front() == '[') {
+		// IPv6 literal
+		size_t close = hostPort.find(']');
+		if (close == std::string_view::npos) {
+			return "Invalid URL host";
+		}
+		host = hostPort.substr(1, close - 1);
+		std::string_view rest = hostPort.substr(close + 1);
+		if (!rest.empty()) {
+			if (rest.front() != ':') {
+				return "Invalid URL host";
+			}
+			portText = rest.substr(1);
+		}
+	} else {
+		size_t colon = hostPort.find(':');
+		host = hostPort.substr(0, colon);
+		if (colon != std::string_view::npos) {
+			portText = hostPort.substr(colon + 1);
+		}
+	}
+	if (host.empty()) {
+		return "Invalid URL host";
+	}
+
+	port = 80;
+	if (!portText.empty()) {
+		uint32_t value = 0;
+		for (char c : portText) {
+			if (c < '0' || c > '9' || value > 65535) {
+				return "Invalid URL port";
+			}
+			value = value * 10 + static_cast<uint32_t>(c - '0');
+		}
+		if (value == 0 || value > 65535) {
+			return "Invalid URL port";
+		}
+		port = static_cast<uint16_t>(value);
+	}
+
+	authority = hostPort;
+	if (path.empty()) {
+		target = "/";
+	} else if (path.front() == '?') {
+		target = "/";
+		target += path;
+	} else {
+		target = path;
+	}
+
+	for (char c : target) {
+		if (c == ' ' || c == '\r' || c == '\n') {
+			return "URL contains invalid characters";
+		}
+	}
+	return nullptr;
+}
+
+HttpClient::~HttpClient() {
+	// The event loop has stopped, nothing else references the requests
+	while (HttpRequest* request = m_completions.pop()) {
+		m_pending.erase(request);
+		delete request;
+	}
+	for (HttpRequest* request : m_pending) {
+		delete request;
+	}
+	m_pending.clear();
+}
+
+bool HttpClient::Request(std::string_view method, std::string_view url, std::string_view headers, std::string_view body,
+	IPluginFunction* callback, cell_t data, const char*& error) {
+	error = nullptr;
+
+	if (method.empty() || method.find_first_of(" \r\n") != std::string_view::npos) {
+		error = "Invalid HTTP method";
+		return false;
+	}
+
+	auto* request = new (std::nothrow) HttpRequest;
+	if (!request) {
+		return false;
+	}
+
+	std::string authority;
+	std::string target;
+	error = ParseUrl(url, request->host, request->port, authority, target);
+	if (error) {
+		delete request;
+		return false;
+	}
+
+	// Trailing line breaks would end the head early
+	while (!headers.empty() && (headers.back() == '\r' || headers.back() == '\n')) {
+		headers.remove_suffix(1);
+	}
+	if (headers.find("\r\n\r\n") != std::string_view::npos || headers.find("\n\n") != std::string_view::npos) {
+		error = "Headers must not contain empty lines";
+		delete request;
+		return false;
+	}
+
+	std::string& message = request->message;
+	message.reserve(method.size() + target.size() + authority.size() + headers.size() + body.size() + 64);
+	message.append(method.data(), method.size());
+	message += ' ';
+	message += target;
+	message += " HTTP/1.1\r\n";
+	if (!headers.empty()) {
+		message.append(headers.data(), headers.size());
+		message += "\r\n";
+	}
+	if (FindHeader(message, "Host").empty()) {
+		message += "Host: ";
+		message += authority;
+		message += "\r\n";
+	}
+	if ((!body.empty() || method == "POST" || method == "PUT" || method == "PATCH") &&
+	    FindHeader(message, "Content-Length").empty()) {
+		message += "Content-Length: ";
+		message += std::to_string(body.size());
+		message += "\r\n";
+	}
+	message += "\r\n";
+	message.append(body.data(), body.size());
+
+	request->callback = callback;
+	request->context = callback->GetParentContext();
+	request->data = data;
+	request->head = method == "HEAD";
+	request->idempotent = IsIdempotent(method);
+
+	if (!g_EventLoops.GetPrimary().Post([this, request]() { Dispatch(request); })) {
+		delete request;
+		return false;
+	}
+
+	m_pending.insert(request);
+	return true;
+}
+
+void HttpClient::ProcessCompletions() {
+	while (HttpRequest* request = m_completions.pop()) {
+		m_pending.erase(request);
+
+		if (IPluginFunction* callback = request->callback) {
+			callback->PushCell(request->status);
+			callback->PushString(request->headers.c_str());
+			callback->PushStringEx(&request->body[0], request->body.size() + 1,
+				SM_PARAM_STRING_COPY | SM_PARAM_STRING_BINARY, 0);
+			callback->PushCell(static_cast<cell_t>(request->body.size()));
+			callback->PushString(request->error.c_str());
+			callback->PushCell(request->data);
+			callback->Execute(nullptr);
+		}
+
+		delete request;
+	}
+}
+
+void HttpClient::CancelRequests(IPluginContext* context) {
+	for (HttpRequest* request : m_pending) {
+		if (request->context == context) {
+			request->callback = nullptr;
+		}
+	}
+}
+
+void HttpClient::Shutdown() {
+	g_EventLoops.GetPrimary().Post([this]() { CloseAll(); });
+}
+
+void HttpClient::Dispatch(HttpRequest* request) {
+	if (m_shutdown) {
+		Fail(request, "HTTP client is shutting down");
+		return;
+	}
+
+	std::string key = request->host;
+	key += ':';
+	key += std::to_string(request->port);
+
+	std::unique_ptr<HostPool>& pool = m_pools[key];
+	if (!pool) {
+		pool = std::make_unique<HostPool>();
+		pool->host = request->host;
+		pool->port = request->port;
+	}
+
+	pool->waiting.push_back(request);
+	Pump(pool.get());
+}
+
+void HttpClient::Pump(HostPool* pool) {
+	int maxConnections = g_GlobalOptions.Get(SocketOption::HttpMaxConnections);
+	if (maxConnections <= 0) maxConnections = kDefaultMaxConnections;
+	int pipelineDepth = g_GlobalOptions.Get(SocketOption::HttpPipelineDepth);
+	if (pipelineDepth <= 0) pipelineDepth = kDefaultPipelineDepth;
+
+	while (!m_shutdown && !pool->waiting.empty()) {
+		HttpRequest* request = pool->waiting.front();
+		Connection* target = nullptr;
+
+		for (Connection* connection : pool->connections) {
+			if (connection->inFlight.empty()) {
+				target = connection;
+				break;
+			}
+		}
+
+		bool opened = false;
+		if (!target && pool->connections.size() < static_cast<size_t>(maxConnections)) {
+			target = Open(pool);
+			if (!target) {
+				pool->waiting.pop_front();
+				Fail(request, "Out of memory");
+				continue;
+			}
+			opened = true;
+		}
+
+		// Pipeline behind idempotent requests only, on the least loaded
+		// connection that has proven to keep responses alive
+		if (!target && request->idempotent && pipelineDepth > 1) {
+			for (Connection* connection : pool->connections) {
+				if (!connection->reused || connection->inFlight.size() >= static_cast<size_t>(pipelineDepth)) continue;
+				if (target && connection->inFlight.size() >= target->inFlight.size()) continue;
+
+				bool idempotent = true;
+				for (HttpRequest* queued : connection->inFlight) {
+					idempotent = idempotent && queued->idempotent;
+				}
+				if (idempotent) {
+					target = connection;
+				}
+			}
+		}
+
+		if (!target) {
+			break;
+		}
+
+		pool->waiting.pop_front();
+		Assign(target, request);
+		if (opened) {
+			Connect(target);
+		}
+	}
+}
+
+HttpClient::Connection* HttpClient::Open(HostPool* pool) {
+	auto* connection = new (std::nothrow) Connection;
+	if (!connection) {
+		return nullptr;
+	}
+
+	connection->client = this;
+	connection->pool = pool;
+	uv_tcp_init(g_EventLoops.GetPrimary().GetLoop(), &connection->tcp);
+	uv_timer_init(g_EventLoops.GetPrimary().GetLoop(), &connection->timer);
+	connection->tcp.data = connection;
+	connection->timer.data = connection;
+	connection->openHandles = 2;
+
+	pool->connections.push_back(connection);
+	return connection;
+}
+
+void HttpClient::Connect(Connection* connection) {
+	// The timeout covers name resolution and the connect as well
+	StartTimer(connection, GetTimeout());
+	connection->resolving = true;
+	g_EventLoops.GetPrimary().GetDnsCache().Lookup(connection->pool->host, connection->pool->port, OnResolved, connection);
+}
+
+void HttpClient::Assign(Connection* connection, HttpRequest* request) {
+	if (connection->inFlight.empty()) {
+		connection->parser.Reset(request->head);
+		if (connection->connected) {
+			StartTimer(connection, GetTimeout());
+		}
+	}
+
+	connection->inFlight.push_back(request);
+	if (connection->connected) {
+		Write(connection, request);
+	}
+}
+
+void HttpClient::Write(Connection* connection, HttpRequest* request) {
+	SendRequest* send = SendRequest::Create(nullptr, request->message.size());
+	if (!send) {
+		Close(connection, "Out of memory");
+		return;
+	}
+	std::memcpy(send->data, request->message.data(), request->message.size());
+	send->write.data = send;
+
+	uv_buf_t buffer = send->Buffer();
+	int result = uv_write(&send->write, reinterpret_cast<uv_stream_t*>(&connection->tcp), &buffer, 1, OnWrite);
+	if (result != 0) {
+		send->Release();
+		Close(connection, uv_strerror(result));
+	}
+}
+
+void HttpClient::OnData(Connection* connection, const char* data, size_t length) {
+	HostPool* pool = connection->pool;
+	size_t offset = 0;
+
+	while (offset < length) {
+		if (connection->inFlight.empty()) {
+			Close(connection, nullptr);
+			break;
+		}
+
+		size_t consumed = 0;
+		HttpResponseParser& parser = connection->parser;
+		HttpResponseParser::Result result = parser.Feed(data + offset, length - offset, consumed);
+		offset += consumed;
+
+		if (result == HttpResponseParser::Result::Error) {
+			Close(connection, parser.GetError());
+			break;
+		}
+		if (result == HttpResponseParser::Result::NeedMore) {
+			StartTimer(connection, GetTimeout());
+			break;
+		}
+
+		HttpRequest* request = connection->inFlight.front();
+		connection->inFlight.pop_front();
+		request->status = parser.GetStatus();
+		request->headers = std::move(parser.GetHeaders());
+		request->body = std::move(parser.GetBody());
+		Complete(request);
+
+		if (!parser.IsKeepAlive()) {
+			// Requests pipelined behind this one are retried elsewhere
+			connection->reused = true;
+			Close(connection, "Connection closed by server", true);
+			break;
+		}
+		connection->reused = true;
+
+		if (!connection->inFlight.empty()) {
+			parser.Reset(connection->inFlight.front()->head);
+			StartTimer(connection, GetTimeout());
+		} else {
+			StartTimer(connection, kIdleTimeoutMs);
+		}
+	}
+
+	Pump(pool);
+}
+
+void HttpClient::Close(Connection* connection, const char* error, bool retry) {
+	if (connection->closing) {
+		return;
+	}
+	connection->closing = true;
+
+	HostPool* pool = connection->pool;
+	for (size_t i = 0; i < pool->connections.size(); ++i) {
+		if (pool->connections[i] == connection) {
+			pool->connections[i] = pool->connections.back();
+			pool->connections.pop_back();
+			break;
+		}
+	}
+
+	// A reused connection may have been closed by the server just as the
+	// requests went out; retry those that saw no response yet, in order
+	retry = retry && connection->reused && !m_shutdown;
+	std::deque<HttpRequest*> retries;
+	for (size_t i = 0; i < connection->inFlight.size(); ++i) {
+		HttpRequest* request = connection->inFlight[i];
+		bool answered = i == 0 && connection->parser.HasStarted();
+		if (retry && request->idempotent && !request->retried && !answered) {
+			request->retried = true;
+			retries.push_back(request);
+		} else {
+			Fail(request, error ? error : "Connection closed");
+		}
+	}
+	connection->inFlight.clear();
+	pool->waiting.insert(pool->waiting.begin(), retries.begin(), retries.end());
+
+	// A pending lookup still holds the connection, OnResolved closes it
+	if (!connection->resolving) {
+		uv_close(reinterpret_cast<uv_handle_t*>(&connection->tcp), OnClose);
+		uv_close(reinterpret_cast<uv_handle_t*>(&connection->timer), OnClose);
+	}
+}
+
+void HttpClient::Fail(HttpRequest* request, const char* error) {
+	request->status = 0;
+	request->error = error;
+	Complete(request);
+}
+
+void HttpClient::Complete(HttpRequest* request) {
+	std::string().swap(request->message);
+	m_completions.push(request);
+}
+
+void HttpClient::CloseAll() {
+	m_shutdown = true;
+
+	for (auto& entry : m_pools) {
+		HostPool* pool = entry.second.get();
+		while (!pool->waiting.empty()) {
+			Fail(pool->waiting.front(), "HTTP client is shutting down");
+			pool->waiting.pop_front();
+		}
+		while (!pool->connections.empty()) {
+			Close(pool->connections.back(), "HTTP client is shutting down");
+		}
+	}
+}
+
+HttpClient::Connection* HttpClient::FromHandle(void* handle) {
+	return static_cast<Connection*>(static_cast<uv_handle_t*>(handle)->data);
+}
+
+void HttpClient::StartTimer(Connection* connection, uint64_t timeoutMs) {
+	uv_timer_start(&connection->timer, OnTimer, timeoutMs, 0);
+}
+
+uint64_t HttpClient::GetTimeout() {
+	int timeout = g_GlobalOptions.Get(SocketOption::HttpTimeout);
+	return timeout > 0 ? static_cast<uint64_t>(timeout) : kDefaultTimeoutMs;
+}
+
+void HttpClient::OnResolved(void* data, int status, const sockaddr_storage* address) {
+	auto* connection = static_cast<Connection*>(data);
+	HttpClient* client = connection->client;
+	connection->resolving = false;
+
+	if (connection->closing) {
+		uv_close(reinterpret_cast<uv_handle_t*>(&connection->tcp), OnClose);
+		uv_close(reinterpret_cast<uv_handle_t*>(&connection->timer), OnClose);
+		return;
+	}
+
+	int result = status;
+	if (result == 0) {
+		connection->connectRequest.data = connection;
+		result = uv_tcp_connect(&connection->connectRequest, &connection->tcp,
+			reinterpret_cast<const sockaddr*>(address), OnConnect);
+	}
+
+	if (result != 0) {
+		HostPool* pool = connection->pool;
+		client->Close(connection, uv_strerror(result));
+		client->Pump(pool);
+	}
+}
+
+void HttpClient::OnConnect(uv_connect_t* request, int status) {
+	auto* connection = static_cast<Connection*>(request->data);
+	HttpClient* client = connection->client;
+	HostPool* pool = connection->pool;
+
+	if (connection->closing) {
+		return;
+	}
+
+	if (status != 0) {
+		client->Close(connection, uv_strerror(status));
+		client->Pump(pool);
+		return;
+	}
+
+	connection->connected = true;
+	uv_tcp_nodelay(&connection->tcp, 1);
+	uv_read_start(reinterpret_cast<uv_stream_t*>(&connection->tcp), OnAllocBuffer, OnRead);
+
+	// Everything assigned while connecting goes out now
+	for (size_t i = 0; i < connection->inFlight.size() && !connection->closing; ++i) {
+		client->Write(connection, connection->inFlight[i]);
+	}
+	if (connection->closing) {
+		client->Pump(pool);
+	}
+}
+
+void HttpClient::OnAllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer) {
+	Connection* connection = FromHandle(handle);
+
+	size_t length;
+	PooledBuffer* slab = connection->receiveSizer.Acquire(0, length);
+	if (!slab) {
+		*buffer = uv_buf_init(nullptr, 0);
+		return;
+	}
+	*buffer = uv_buf_init(slab->Data(), static_cast<unsigned int>(length));
+}
+
+void HttpClient::OnRead(uv_stream_t* stream, ssize_t bytesRead, const uv_buf_t* buffer) {
+	Connection* connection = FromHandle(stream);
+	HttpClient* client = connection->client;
+	PooledBuffer* slab = PooledBuffer::FromData(buffer->base);
+
+	if (bytesRead > 0 && !connection->closing) {
+		connection->receiveSizer.Record(static_cast<size_t>(bytesRead), buffer->len);
+		client->OnData(connection, buffer->base, static_cast<size_t>(bytesRead));
+	}
+	if (slab) slab->Release();
+
+	if (bytesRead >= 0 || bytesRead == UV_ECANCELED || connection->closing) {
+		return;
+	}
+
+	HostPool* pool = connection->pool;
+
+	// A body delimited by the connection closing ends here
+	if (bytesRead == UV_EOF && !connection->inFlight.empty() &&
+	    connection->parser.Finish() == HttpResponseParser::Result::Complete) {
+		HttpRequest* request = connection->inFlight.front();
+		connection->inFlight.pop_front();
+		request->status = connection->parser.GetStatus();
+		request->headers = std::move(connection->parser.GetHeaders());
+		request->body = std::move(connection->parser.GetBody());
+		client->Complete(request);
+	}
+
+	client->Close(connection, bytesRead == UV_EOF ? "Connection closed by server" : uv_strerror(static_cast<int>(bytesRead)), true);
+	client->Pump(pool);
+}
+
+void HttpClient::OnWrite(uv_write_t* request, int status) {
+	auto* send = static_cast<SendRequest*>(request->data);
+	Connection* connection = FromHandle(request->handle);
+	send->Release();
+
+	if (status != 0 && status != UV_ECANCELED && !connection->closing) {
+		HostPool* pool = connection->pool;
+		connection->client->Close(connection, uv_strerror(status), true);
+		connection->client->Pump(pool);
+	}
+}
+
+void HttpClient::OnTimer(uv_timer_t* timer) {
+	Connection* connection = FromHandle(timer);
+	HttpClient* client = connection->client;
+	HostPool* pool = connection->pool;
+
+	// Idle connections just go away, busy ones fail their requests
+	bool idle = connection->inFlight.empty();
+	client->Close(connection, idle ? nullptr : "Request timed out");
+	if (!idle) {
+		client->Pump(pool);
+	}
+}
+
+void HttpClient::OnClose(uv_handle_t* handle) {
+	Connection* connection = FromHandle(handle);
+	if (--connection->openHandles == 0) {
+		delete connection;
+	}
+}
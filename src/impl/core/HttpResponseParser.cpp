@@ -0,0 +1,300 @@
+#include "core/HttpResponseParser.h"
+#include "core/HttpHeaders.h"
+#include <cstring>
+
+void HttpResponseParser::Reset(bool headRequest) {
+	m_state = State::StatusLine;
+	m_headRequest = headRequest;
+	m_started = false;
+	m_keepAlive = false;
+	m_chunked = false;
+	m_hasLength = false;
+	m_status = 0;
+	m_contentLength = 0;
+	m_remaining = 0;
+	m_line.clear();
+	m_headers.clear();
+	m_body.clear();
+	m_error = nullptr;
+}
+
+HttpResponseParser::Result HttpResponseParser::Feed(const char* data, size_t length, size_t& consumed) {
+	size_t position = 0;
+
+	if (m_error) {
+		consumed = 0;
+		return Result::Error;
+	}
+	if (length > 0) {
+		m_started = true;
+	}
+
+	while (position < length && m_state != State::Done) {
+		switch (m_state) {
+			case State::Body:
+			case State::ChunkData: {
+				size_t take = length - position;
+				if (take > m_remaining) {
+					take = static_cast<size_t>(m_remaining);
+				}
+				m_body.append(data + position, take);
+				position += take;
+				m_remaining -= take;
+				if (m_remaining == 0) {
+					m_state = m_state == State::Body ? State::Done : State::ChunkEnd;
+				}
+				break;
+			}
+			case State::UntilClose: {
+				size_t take = length - position;
+				if (m_body.size() + take > kMaxBodySize) {
+					consumed = position;
+					Fail("Response body is too large");
+					return Result::Error;
+				}
+				m_body.append(data + position, take);
+				position = length;
+				break;
+			}
+			default: {
+				const char* start = data + position;
+				auto* newline = static_cast<const char*>(std::memchr(start, '\n', length - position));
+				size_t take = newline ? static_cast<size_t>(newline - start) + 1 : length - position;
+
+				if (m_line.size() + take > kMaxHeaderSize) {
+					consumed = position;
+					Fail("Response line is too long");
+					return Result::Error;
+				}
+				position += take;
+
+				// Lines that lie within one read are parsed in place
+				std::string_view line;
+				if (m_line.empty() && newline) {
+					line = std::string_view(start, take);
+				} else {
+					m_line.append(start, take);
+					if (!newline) {
+						break;
+					}
+					line = m_line;
+				}
+
+				line.remove_suffix(1);
+				if (!line.empty() && line.back() == '\r') {
+					line.remove_suffix(1);
+				}
+
+				bool valid = ParseLine(line);
+				m_line.clear();
+				if (!valid) {
+					consumed = position;
+					return Result::Error;
+				}
+				break;
+			}
+		}
+	}
+
+	consumed = position;
+	return m_state == State::Done ? Result::Complete : Result::NeedMore;
+}
+
+HttpResponseParser::Result HttpResponseParser::Finish() {
+	if (m_error) {
+		return Result::Error;
+	}
+	if (m_state == State::UntilClose) {
+		m_state = State::Done;
+	}
+	if (m_state == State::Done) {
+		return Result::Complete;
+	}
+
+	Fail("Connection closed before the response was complete");
+	return Result::Error;
+}
+
+bool HttpResponseParser::ParseLine(std::string_view line) {
+	switch (m_state) {
+		case State::StatusLine:
+			// Tolerate stray empty lines before the status line
+			return line.empty() || ParseStatusLine(line);
+		case State::Headers:
+			return line.empty() ? EndHeaders() : ParseHeader(line);
+		case State::ChunkSize:
+			return ParseChunkSize(line);
+		case State::ChunkEnd:
+			if (!line.empty()) {
+				return Fail("Malformed chunked body");
+			}
+			m_state = State::ChunkSize;
+			return true;
+		case State::Trailers:
+			// Trailer fields are not exposed
+			if (line.empty()) {
+				m_state = State::Done;
+			}
+			return true;
+		default:
+			return true;
+	}
+}
+
+bool HttpResponseParser::ParseStatusLine(std::string_view line) {
+	// HTTP/1.x SSS reason
+	if (line.size() < 12 || line.substr(0, 7) != "HTTP/1." || line[8] != ' ') {
+		return Fail("Malformed status line");
+	}
+
+	int status = 0;
+	for (size_t i = 9; i < 12; ++i) {
+		if (line[i] < '0' || line[i] > '9') {
+			return Fail("Malformed status line");
+		}
+		status = status * 10 + (line[i] - '0');
+	}
+	if (status < 100 || (line.size() > 12 && line[12] != ' ')) {
+		return Fail("Malformed status line");
+	}
+
+	// HTTP/1.1 keeps the connection unless told otherwise, HTTP/1.0 the reverse
+	m_status = status;
+	m_keepAlive = line[7] != '0';
+	m_chunked = false;
+	m_hasLength = false;
+	m_contentLength = 0;
+	m_headers.clear();
+	m_state = State::Headers;
+	return true;
+}
+
+bool HttpResponseParser::ParseHeader(std::string_view line) {
+	if (m_headers.size() + line.size() + 2 > kMaxHeaderSize) {
+		return Fail("Response headers are too large");
+	}
+
+	size_t colon = line.find(':');
+	if (colon == std::string_view::npos || colon == 0) {
+		return Fail("Malformed response header");
+	}
+
+	std::string_view name = TrimWhitespace(line.substr(0, colon));
+	std::string_view value = TrimWhitespace(line.substr(colon + 1));
+
+	if (EqualsIgnoreCase(name, "Content-Length")) {
+		if (value.empty()) {
+			return Fail("Invalid Content-Length");
+		}
+		uint64_t contentLength = 0;
+		for (char c : value) {
+			if (c < '0' || c > '9') {
+				return Fail("Invalid Content-Length");
+			}
+			if (contentLength > kMaxBodySize) {
+				return Fail("Response body is too large");
+			}
+			contentLength = contentLength * 10 + static_cast<uint64_t>(c - '0');
+		}
+		if (m_hasLength && contentLength != m_contentLength) {
+			return Fail("Conflicting Content-Length headers");
+		}
+		m_contentLength = contentLength;
+		m_hasLength = true;
+	} else if (EqualsIgnoreCase(name, "Transfer-Encoding")) {
+		if (HasHeaderToken(value, "chunked")) {
+			m_chunked = true;
+		}
+	} else if (EqualsIgnoreCase(name, "Connection")) {
+		if (HasHeaderToken(value, "close")) {
+			m_keepAlive = false;
+		} else if (HasHeaderToken(value, "keep-alive")) {
+			m_keepAlive = true;
+		}
+	}
+
+	m_headers.append(line.data(), line.size());
+	m_headers += "\r\n";
+	return true;
+}
+
+bool HttpResponseParser::EndHeaders() {
+	if (m_status < 200) {
+		// Interim response, the final one follows on the same connection
+		if (m_status == 101) {
+			return Fail("Unexpected protocol switch");
+		}
+		m_state = State::StatusLine;
+		return true;
+	}
+
+	if (m_headRequest || m_status == 204 || m_status == 304) {
+		m_state = State::Done;
+		return true;
+	}
+
+	// Transfer-Encoding overrides Content-Length
+	if (m_chunked) {
+		m_state = State::ChunkSize;
+		return true;
+	}
+
+	if (m_hasLength) {
+		if (m_contentLength > kMaxBodySize) {
+			return Fail("Response body is too large");
+		}
+		m_body.reserve(static_cast<size_t>(m_contentLength));
+		m_remaining = m_contentLength;
+		m_state = m_remaining > 0 ? State::Body : State::Done;
+		return true;
+	}
+
+	// No length given, the body ends when the server closes
+	m_keepAlive = false;
+	m_state = State::UntilClose;
+	return true;
+}
+
+bool HttpResponseParser::ParseChunkSize(std::string_view line) {
+	// Chunk extensions are ignored
+	line = TrimWhitespace(line.substr(0, line.find(';')));
+	if (line.empty()) {
+		return Fail("Malformed chunk size");
+	}
+
+	uint64_t size = 0;
+	for (char c : line) {
+		int digit;
+		if (c >= '0' && c <= '9') {
+			digit = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			digit = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			digit = c - 'A' + 10;
+		} else {
+			return Fail("Malformed chunk size");
+		}
+		if (size > kMaxBodySize) {
+			return Fail("Response body is too large");
+		}
+		size = size * 16 + static_cast<uint64_t>(digit);
+	}
+
+	if (size == 0) {
+		m_state = State::Trailers;
+		return true;
+	}
+	if (m_body.size() + size > kMaxBodySize) {
+		return Fail("Response body is too large");
+	}
+
+	m_remaining = size;
+	m_state = State::ChunkData;
+	return true;
+}
+
+bool HttpResponseParser::Fail(const char* error) {
+	m_error = error;
+	m_keepAlive = false;
+	return false;
+}
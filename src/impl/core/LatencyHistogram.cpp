@@ -0,0 +1,37 @@
+#include "core/LatencyHistogram.h"
+#include <cmath>
+
+uint64_t LatencyHistogram::Percentile(double fraction) const {
+	if (!m_total) return 0;
+
+	uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(m_total)));
+	if (rank < 1) rank = 1;
+
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+		seen += m_counts[bucket];
+		if (seen >= rank) {
+			// No sample exceeds the maximum, even if its bucket does
+			uint64_t bound = UpperBound(bucket);
+			return bound < m_max ? bound : m_max;
+		}
+	}
+	return m_max;
+}
+
+void LatencyHistogram::Reset() {
+	for (auto& count : m_counts) {
+		count = 0;
+	}
+	m_total = 0;
+	m_max = 0;
+}
+
+uint64_t LatencyHistogram::UpperBound(size_t bucket) {
+	if (bucket < kSubBuckets) {
+		return bucket;
+	}
+	unsigned shift = static_cast<unsigned>(bucket / kSubBuckets) - 1;
+	uint64_t sub = bucket % kSubBuckets;
+	return ((kSubBuckets + sub + 1) << shift) - 1;
+}
@@ -0,0 +1,123 @@
+#include "core/SendRequest.h"
+#include "core/CallbackManager.h"
+#include "socket/SocketBase.h"
+#include <cstring>
+#include <new>
+
+SendRequest* SendRequest::Create(SocketBase* socket, size_t length) {
+	auto* request = new (std::nothrow) SendRequest;
+	if (!request) {
+		return nullptr;
+	}
+
+	if (length) {
+		request->data = new (std::nothrow) char[length];
+		if (!request->data) {
+			delete request;
+			return nullptr;
+		}
+	}
+	request->length = length;
+	request->capacity = length;
+	request->socket = socket;
+	if (socket) {
+		request->backlog = socket->GetEventQueue();
+		request->backlog->sendBacklog.fetch_add(static_cast<int64_t>(length), std::memory_order_relaxed);
+	}
+	return request;
+}
+
+void SendRequest::Release() {
+	if (pool) {
+		pool->Recycle(this);
+	} else {
+		SendRequestPool::Free(this);
+	}
+}
+
+SendRequestPool::SendRequestPool(size_t maxCached) : m_freeList(maxCached) {}
+
+SendRequestPool::~SendRequestPool() {
+	SendRequest* request = m_freeList.TakeAll();
+	while (request) {
+		SendRequest* next = request->next;
+		Free(request);
+		request = next;
+	}
+}
+
+SendRequest* SendRequestPool::Acquire(SocketBase* socket, std::string_view payload) {
+	SendRequest* request = Acquire(socket, payload.length());
+	if (request && !payload.empty()) {
+		std::memcpy(request->data, payload.data(), payload.length());
+	}
+	return request;
+}
+
+SendRequest* SendRequestPool::Acquire(SocketBase* socket, size_t length) {
+	SendRequest* request = m_freeList.Pop();
+	if (!request) {
+		request = new (std::nothrow) SendRequest;
+		if (!request) {
+			return nullptr;
+		}
+		request->pool = this;
+		m_allocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (length > request->capacity) {
+		size_t capacity = request->capacity ? request->capacity : kMinCapacity;
+		while (capacity < length) {
+			capacity *= 2;
+		}
+
+		char* data = new (std::nothrow) char[capacity];
+		if (!data) {
+			Recycle(request);
+			return nullptr;
+		}
+		m_allocations.fetch_add(1, std::memory_order_relaxed);
+
+		delete[] request->data;
+		request->data = data;
+		request->capacity = capacity;
+	}
+
+	request->length = length;
+	request->socket = socket;
+	if (socket) {
+		request->backlog = socket->GetEventQueue();
+		request->backlog->sendBacklog.fetch_add(static_cast<int64_t>(length), std::memory_order_relaxed);
+	}
+	return request;
+}
+
+void SendRequestPool::Recycle(SendRequest* request) {
+	// Pooled requests count towards their socket's send backlog until here.
+	// The socket itself may be gone, so only the queue is touched.
+	if (request->backlog) {
+		request->backlog->sendBacklog.fetch_sub(static_cast<int64_t>(request->length), std::memory_order_relaxed);
+		request->backlog.reset();
+	}
+	request->socket = nullptr;
+	request->length = 0;
+
+	// Don't let one huge message pin its buffer in the pool
+	if (request->capacity > kMaxPooledCapacity) {
+		delete[] request->data;
+		request->data = nullptr;
+		request->capacity = 0;
+	}
+
+	if (!m_freeList.Push(request)) {
+		Free(request);
+	}
+}
+
+void SendRequestPool::Free(SendRequest* request) {
+	if (request->backlog) {
+		request->backlog->sendBacklog.fetch_sub(static_cast<int64_t>(request->length), std::memory_order_relaxed);
+	}
+	delete[] request->data;
+	delete request;
+}
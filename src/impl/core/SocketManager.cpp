@@ -1,5 +1,17 @@
 #include "core/SocketManager.h"
 #include "core/EventLoop.h"
+#include "core/CallbackManager.h"
+#include "core/SocketHost.h"
+#include <cstdlib>
+
+// One socket object exists per connection, idle or not. Receive buffers are
+// pooled and only held while data is queued, so keep the objects themselves
+// to a few hundred bytes.
+static_assert(sizeof(TcpSocket) <= 640, "TcpSocket grew past its footprint budget");
+static_assert(sizeof(UdpSocket) <= 640, "UdpSocket grew past its footprint budget");
+#ifndef _WIN32
+static_assert(sizeof(UnixSocket) <= 640, "UnixSocket grew past its footprint budget");
+#endif
 
 SocketManager g_SocketManager;
 
@@ -12,11 +24,31 @@ SocketManager::~SocketManager() {
 void SocketManager::Shutdown() {
 	Stop();
 
-	// Delete all sockets
+	// Delete all sockets, no loop is left to accept new ones
 	for (auto* socket : m_sockets) {
 		delete socket;
 	}
 	m_sockets.clear();
+	for (auto& count : m_loopSockets) {
+		count = 0;
+	}
+}
+
+void SocketManager::Register(SocketBase* socket, EventLoop* loop) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!loop) {
+		loop = &g_EventLoops.GetPrimary();
+		for (size_t i = 1; i < g_EventLoops.GetCount(); ++i) {
+			if (m_loopSockets[i] < m_loopSockets[loop->GetIndex()]) {
+				loop = &g_EventLoops.Get(i);
+			}
+		}
+	}
+
+	socket->SetEventLoop(*loop);
+	++m_loopSockets[loop->GetIndex()];
+	m_sockets.insert(socket);
 }
 
 void SocketManager::DestroySocket(SocketBase* socket) {
@@ -26,16 +58,40 @@ void SocketManager::DestroySocket(SocketBase* socket) {
 	socket->MarkDeleted();
 
 	// Remove from set
-	m_sockets.erase(socket);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_sockets.erase(socket)) {
+			--m_loopSockets[socket->GetEventLoop().GetIndex()];
+		}
+	}
 
 	// Delete socket
 	delete socket;
 }
 
 void SocketManager::Start() {
-	g_EventLoop.Start();
+	size_t count = 1;
+	if (const char* value = g_SocketHost->GetConfigValue("SocketEventLoops")) {
+		int configured = atoi(value);
+		if (configured > 0) {
+			count = static_cast<size_t>(configured);
+		}
+	}
+	if (count > kMaxEventLoops) {
+		g_SocketHost->LogError("[Socket] SocketEventLoops is limited to %d loops", static_cast<int>(kMaxEventLoops));
+		count = kMaxEventLoops;
+	}
+
+	// Every loop needs its ready queue before its first event
+	g_CallbackManager.ReserveLoops(count);
+	g_EventLoops.Start(count);
 }
 
 void SocketManager::Stop() {
-	g_EventLoop.Stop();
-}
\ No newline at end of file
+	g_EventLoops.Stop();
+}
+
+size_t SocketManager::GetLoopSocketCount(size_t index) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return index < kMaxEventLoops ? m_loopSockets[index] : 0;
+}
@@ -0,0 +1,52 @@
+#include "socket/ListenShards.h"
+#include "core/EventLoop.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+bool ListenShards::Prepare(uv_handle_t* primary) {
+	m_prepared = EnableReusePort(primary);
+	return m_prepared;
+}
+
+bool ListenShards::EnableReusePort(uv_handle_t* handle) {
+#ifdef SO_REUSEPORT
+	uv_os_fd_t fd;
+	if (uv_fileno(handle, &fd) != 0) {
+		return false;
+	}
+
+	int enable = 1;
+	return setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0;
+#else
+	// Windows has no load-balancing equivalent
+	return false;
+#endif
+}
+
+void ListenShards::Set(size_t index, uv_handle_t* handle, uv_close_cb onClose) {
+	m_handles[index].store(handle, std::memory_order_seq_cst);
+
+	// Pairs with Close(): either it takes the handle, or we see it ran
+	if (m_closed.load(std::memory_order_seq_cst)) {
+		if (uv_handle_t* late = m_handles[index].exchange(nullptr, std::memory_order_acq_rel)) {
+			uv_close(late, onClose);
+		}
+	}
+}
+
+void ListenShards::Close(uv_close_cb onClose) {
+	m_closed.store(true, std::memory_order_seq_cst);
+
+	for (size_t i = 0; i < kMaxEventLoops; ++i) {
+		uv_handle_t* handle = m_handles[i].exchange(nullptr, std::memory_order_acq_rel);
+		if (!handle) continue;
+
+		g_EventLoops.Get(i).Post([handle, onClose]() {
+			if (!uv_is_closing(handle)) {
+				uv_close(handle, onClose);
+			}
+		});
+	}
+}
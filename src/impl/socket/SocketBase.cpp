@@ -1,4 +1,5 @@
 #include "socket/SocketBase.h"
+#include "core/CallbackManager.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -10,16 +11,25 @@
 #include <netinet/tcp.h>
 #endif
 
-SocketBase::SocketBase(SocketType type) : m_type(type) {}
+SocketBase::SocketBase(SocketType type)
+	: m_type(type), m_events(std::make_shared<SocketEventQueue>(this)) {}
 
 SocketBase::~SocketBase() {
 	// Mark as deleted so UV thread will skip any pending callbacks
 	MarkDeleted();
+}
 
-	// Clear pending options
-	while (!m_pendingOptions.empty()) {
-		m_pendingOptions.pop();
-	}
+void SocketBase::MarkDeleted() {
+	m_deleted.store(true, std::memory_order_release);
+
+	// Events still queued for this socket are discarded by the scheduler,
+	// and work that outlives the socket checks the queue instead of it
+	m_events->detached.store(true, std::memory_order_release);
+}
+
+void SocketBase::RecordSent(size_t bytes, size_t messages) {
+	m_events->bytesSent.fetch_add(bytes, std::memory_order_relaxed);
+	m_events->messagesSent.fetch_add(messages, std::memory_order_relaxed);
 }
 
 void SocketBase::QueueOption(SocketOption option, int value) {
@@ -27,7 +37,7 @@ void SocketBase::QueueOption(SocketOption option, int value) {
 	StoreOption(option, value);
 
 	// Also queue for socket-level application
-	m_pendingOptions.emplace(option, value);
+	m_pendingOptions.emplace_back(option, value);
 }
 
 bool SocketBase::SetSocketOption(uv_os_sock_t socketFd, SocketOption option, int value) {
@@ -84,10 +94,26 @@ void SocketBase::ApplyPendingOptions(uv_handle_t* handle) {
 
 	uv_os_sock_t socketFd;
 	if (uv_fileno(handle, reinterpret_cast<uv_os_fd_t*>(&socketFd)) == 0) {
-		while (!m_pendingOptions.empty()) {
-			auto& option = m_pendingOptions.front();
+		for (const PendingOption& option : m_pendingOptions) {
 			SetSocketOption(socketFd, option.option, option.value);
-			m_pendingOptions.pop();
+		}
+		// Applied options are not kept, release the storage as well
+		std::vector<PendingOption>().swap(m_pendingOptions);
+	}
+}
+
+void SocketBase::ApplyStoredOptions(uv_handle_t* handle) {
+	uv_os_sock_t socketFd;
+	if (uv_fileno(handle, reinterpret_cast<uv_os_fd_t*>(&socketFd)) != 0) {
+		return;
+	}
+
+	for (size_t i = 1; i < kMaxOptions; ++i) {
+		auto option = static_cast<SocketOption>(i);
+		int value = GetOption(option);
+		// Unset options keep the system default, non socket level ones are ignored
+		if (value != 0 && !IsExtensionOption(option)) {
+			SetSocketOption(socketFd, option, value);
 		}
 	}
 }
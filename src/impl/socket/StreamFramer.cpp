@@ -0,0 +1,271 @@
+#include "socket/StreamFramer.h"
+#include "socket/SocketBase.h"
+#include "core/CallbackManager.h"
+#include "core/BufferPool.h"
+#include <cstring>
+
+static const char* FindDelimiter(const char* data, size_t length, const char* delimiter, size_t delimiterLength) {
+	if (length < delimiterLength) {
+		return nullptr;
+	}
+
+	const char* last = data + length - delimiterLength;
+	for (const char* cursor = data; cursor <= last;) {
+		cursor = static_cast<const char*>(std::memchr(cursor, delimiter[0], static_cast<size_t>(last - cursor) + 1));
+		if (!cursor) {
+			return nullptr;
+		}
+		if (std::memcmp(cursor, delimiter, delimiterLength) == 0) {
+			return cursor;
+		}
+		++cursor;
+	}
+	return nullptr;
+}
+
+static size_t DecodePrefix(const char* data, size_t width, bool bigEndian) {
+	const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+	size_t value = 0;
+	for (size_t i = 0; i < width; ++i) {
+		size_t shift = bigEndian ? (width - 1 - i) * 8 : i * 8;
+		value |= static_cast<size_t>(bytes[i]) << shift;
+	}
+	return value;
+}
+
+bool StreamFramer::SetDelimiter(const char* delimiter, size_t length) {
+	if (length == 0 || length > kMaxDelimiterLength) {
+		return false;
+	}
+
+	std::memcpy(m_delimiter, delimiter, length);
+	m_delimiterLength = static_cast<uint8_t>(length);
+	return true;
+}
+
+bool StreamFramer::IsEnabled(const SocketBase* socket) {
+	Config config;
+	return ReadConfig(socket, config);
+}
+
+bool StreamFramer::ReadConfig(const SocketBase* socket, Config& config) {
+	config.mode = static_cast<FramingMode>(socket->GetOption(SocketOption::FramingMode));
+	if (config.mode == FramingMode::None) {
+		return false;
+	}
+
+	int size = socket->GetOption(SocketOption::FramingSize);
+	int maxSize = socket->GetOption(SocketOption::FramingMaxSize);
+	config.size = size > 0 ? static_cast<size_t>(size) : 0;
+	config.maxSize = maxSize > 0 ? static_cast<size_t>(maxSize) : kDefaultMaxFrameSize;
+
+	// Misconfigured framing passes the stream through unchanged
+	switch (config.mode) {
+		case FramingMode::Fixed:
+			return config.size > 0;
+		case FramingMode::PrefixBigEndian:
+		case FramingMode::PrefixLittleEndian:
+			return config.size == 1 || config.size == 2 || config.size == 4;
+		case FramingMode::Delimiter:
+			return true;
+		default:
+			return false;
+	}
+}
+
+StreamFramer::ParseResult StreamFramer::Parse(const Config& config, const char* data, size_t length, Frame& frame) const {
+	switch (config.mode) {
+		case FramingMode::Fixed:
+			if (config.size > config.maxSize) return ParseResult::TooLarge;
+			if (length < config.size) return ParseResult::NeedMore;
+			frame = Frame{0, config.size, config.size};
+			return ParseResult::Complete;
+
+		case FramingMode::PrefixBigEndian:
+		case FramingMode::PrefixLittleEndian: {
+			if (length < config.size) return ParseResult::NeedMore;
+			size_t body = DecodePrefix(data, config.size, config.mode == FramingMode::PrefixBigEndian);
+			if (body > config.maxSize) return ParseResult::TooLarge;
+			if (length - config.size < body) return ParseResult::NeedMore;
+			frame = Frame{config.size, body, config.size + body};
+			return ParseResult::Complete;
+		}
+
+		default: {
+			const char* found = FindDelimiter(data, length, m_delimiter, m_delimiterLength);
+			if (!found) {
+				// Everything but a possible delimiter start already belongs to the message
+				return length - (length < m_delimiterLength ? length : m_delimiterLength - 1u) > config.maxSize
+					? ParseResult::TooLarge
+					: ParseResult::NeedMore;
+			}
+			size_t body = static_cast<size_t>(found - data);
+			if (body > config.maxSize) return ParseResult::TooLarge;
+			frame = Frame{0, body, body + m_delimiterLength};
+			return ParseResult::Complete;
+		}
+	}
+}
+
+size_t StreamFramer::Missing(const Config& config, const char* data, size_t length, bool& tooLarge) const {
+	const size_t buffered = m_partial.size();
+	size_t need = 0;
+
+	switch (config.mode) {
+		case FramingMode::Fixed:
+			need = config.size - buffered;
+			break;
+
+		case FramingMode::PrefixBigEndian:
+		case FramingMode::PrefixLittleEndian:
+			if (buffered < config.size) {
+				need = config.size - buffered;
+			} else {
+				size_t body = DecodePrefix(m_partial.data(), config.size, config.mode == FramingMode::PrefixBigEndian);
+				if (body > config.maxSize) {
+					tooLarge = true;
+					return 0;
+				}
+				need = config.size + body - buffered;
+			}
+			break;
+
+		default: {
+			// A delimiter may straddle the end of the buffered bytes, check
+			// the earliest possible start first
+			for (size_t carried = m_delimiterLength - 1u; carried > 0; --carried) {
+				size_t rest = m_delimiterLength - carried;
+				if (carried <= buffered && rest <= length &&
+					std::memcmp(m_partial.data() + buffered - carried, m_delimiter, carried) == 0 &&
+					std::memcmp(data, m_delimiter + carried, rest) == 0) {
+					return rest;
+				}
+			}
+
+			const char* found = FindDelimiter(data, length, m_delimiter, m_delimiterLength);
+			if (found) {
+				need = static_cast<size_t>(found - data) + m_delimiterLength;
+			} else if (buffered + length > config.maxSize + m_delimiterLength - 1u) {
+				tooLarge = true;
+				return 0;
+			}
+			break;
+		}
+	}
+
+	return need <= length ? need : 0;
+}
+
+bool StreamFramer::Consume(SocketBase* socket, PooledBuffer* slab, char* data, size_t length, const RemoteEndpoint& sender) {
+	Config config;
+	if (!ReadConfig(socket, config)) {
+		if (!m_partial.empty()) {
+			EnqueueCopy(socket, m_partial.data(), m_partial.size(), sender);
+			m_partial.clear();
+		}
+		g_CallbackManager.EnqueueReceive(socket, slab, data, length, sender);
+		return true;
+	}
+
+	size_t position = 0;
+
+	// Finish the message an earlier read left incomplete. Prefix framing
+	// can take two steps, first the prefix and then the body.
+	while (!m_partial.empty() && position < length) {
+		bool tooLarge = false;
+		size_t need = Missing(config, data + position, length - position, tooLarge);
+		if (tooLarge) {
+			slab->Release();
+			Fail(socket);
+			return false;
+		}
+
+		if (need == 0) {
+			m_partial.insert(m_partial.end(), data + position, data + length);
+			position = length;
+			break;
+		}
+
+		m_partial.insert(m_partial.end(), data + position, data + position + need);
+		position += need;
+
+		Frame frame;
+		ParseResult result = Parse(config, m_partial.data(), m_partial.size(), frame);
+		if (result == ParseResult::TooLarge) {
+			slab->Release();
+			Fail(socket);
+			return false;
+		}
+		if (result == ParseResult::Complete) {
+			EnqueueCopy(socket, m_partial.data() + frame.offset, frame.length, sender);
+			m_partial.clear();
+		}
+	}
+
+	// Messages within this read are delivered in place. A message is only
+	// enqueued once the bytes after it have been parsed, because the game
+	// thread null-terminates it by writing the byte that follows.
+	bool hasPending = false;
+	Frame pending{};
+	bool failed = false;
+
+	while (position < length) {
+		Frame frame;
+		ParseResult result = Parse(config, data + position, length - position, frame);
+		if (result == ParseResult::NeedMore) {
+			break;
+		}
+		if (result == ParseResult::TooLarge) {
+			failed = true;
+			break;
+		}
+
+		if (hasPending) {
+			// A fixed-size message is directly followed by the next one
+			if (config.mode == FramingMode::Fixed) {
+				EnqueueCopy(socket, data + pending.offset, pending.length, sender);
+			} else {
+				slab->Retain();
+				g_CallbackManager.EnqueueReceive(socket, slab, data + pending.offset, pending.length, sender);
+			}
+		}
+
+		pending = Frame{position + frame.offset, frame.length, position + frame.end};
+		hasPending = true;
+		position += frame.end;
+	}
+
+	if (!failed && position < length) {
+		m_partial.assign(data + position, data + length);
+	}
+
+	if (hasPending) {
+		slab->Retain();
+		g_CallbackManager.EnqueueReceive(socket, slab, data + pending.offset, pending.length, sender);
+	}
+	slab->Release();
+
+	if (failed) {
+		Fail(socket);
+		return false;
+	}
+	return true;
+}
+
+void StreamFramer::EnqueueCopy(SocketBase* socket, const char* data, size_t length, const RemoteEndpoint& sender) {
+	PooledBuffer* buffer = AcquireBuffer(length);
+	if (!buffer) {
+		g_CallbackManager.EnqueueError(socket, SocketError::RecvError, "Out of memory");
+		return;
+	}
+
+	if (length) {
+		std::memcpy(buffer->Data(), data, length);
+	}
+	g_CallbackManager.EnqueueReceive(socket, buffer, buffer->Data(), length, sender);
+}
+
+void StreamFramer::Fail(SocketBase* socket) {
+	m_partial.clear();
+	g_CallbackManager.EnqueueError(socket, SocketError::RecvError, "Message exceeds the maximum frame size");
+}
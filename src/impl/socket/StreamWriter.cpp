@@ -0,0 +1,172 @@
+#include "socket/StreamWriter.h"
+#include "core/EventLoop.h"
+#include "core/CallbackManager.h"
+#include "core/SendRequest.h"
+#include <new>
+
+StreamWriter* StreamWriter::Attach(std::atomic<StreamWriter*>& slot, uv_stream_t* stream) {
+	StreamWriter* writer = slot.load(std::memory_order_acquire);
+	if (writer) {
+		return writer;
+	}
+
+	writer = new (std::nothrow) StreamWriter(stream);
+	if (!writer) {
+		return nullptr;
+	}
+
+	StreamWriter* expected = nullptr;
+	if (!slot.compare_exchange_strong(expected, writer, std::memory_order_acq_rel, std::memory_order_acquire)) {
+		delete writer;
+		return expected;
+	}
+	return writer;
+}
+
+void StreamWriter::Queue(SendRequest* request, int corkMs) {
+	request->next = nullptr;
+	if (m_tail) {
+		m_tail->next = request;
+	} else {
+		m_head = request;
+	}
+	m_tail = request;
+	++m_count;
+	m_bytes += request->length;
+
+	if (m_count >= kMaxBatch || m_bytes >= kMaxBatchBytes) {
+		Flush();
+		return;
+	}
+
+	if (corkMs > 0) {
+		if (!m_corkTimer) {
+			m_corkTimer = new (std::nothrow) uv_timer_t;
+			if (!m_corkTimer) {
+				Flush();
+				return;
+			}
+			uv_timer_init(m_stream->loop, m_corkTimer);
+			m_corkTimer->data = this;
+		}
+
+		// The window opens with the first queued message and is not extended
+		if (!uv_is_active(reinterpret_cast<uv_handle_t*>(m_corkTimer))) {
+			uv_timer_start(m_corkTimer, OnCorkTimer, static_cast<uint64_t>(corkMs), 0);
+		}
+		return;
+	}
+
+	if (!m_flushDeferred) {
+		m_flushDeferred = true;
+		EventLoop::Current()->Defer(OnDeferredFlush, this);
+	}
+}
+
+void StreamWriter::Flush() {
+	if (m_corkTimer) {
+		uv_timer_stop(m_corkTimer);
+	}
+
+	while (m_head) {
+		uv_buf_t buffers[kMaxBatch];
+		unsigned int count = 0;
+
+		// The first request carries the uv_write for the whole batch and keeps
+		// the rest linked behind it until the write completes
+		SendRequest* batch = m_head;
+		SendRequest* last = nullptr;
+		size_t bytes = 0;
+		for (SendRequest* request = m_head; request && count < kMaxBatch; request = request->next) {
+			buffers[count++] = request->Buffer();
+			bytes += request->length;
+			last = request;
+		}
+
+		m_head = last->next;
+		if (!m_head) {
+			m_tail = nullptr;
+		}
+		m_count -= count;
+		m_bytes -= bytes;
+		last->next = nullptr;
+
+		batch->write.data = batch;
+		int result = uv_write(&batch->write, m_stream, buffers, count, OnWrite);
+		if (result != 0) {
+			OnWrite(&batch->write, result);
+		}
+	}
+}
+
+void StreamWriter::Close() {
+	Flush();
+	Shutdown();
+}
+
+void StreamWriter::Discard() {
+	while (m_head) {
+		SendRequest* next = m_head->next;
+		m_head->Release();
+		m_head = next;
+	}
+	m_tail = nullptr;
+	m_count = 0;
+	m_bytes = 0;
+
+	Shutdown();
+}
+
+void StreamWriter::Shutdown() {
+	m_closed = true;
+
+	if (m_corkTimer) {
+		uv_close(reinterpret_cast<uv_handle_t*>(m_corkTimer), [](uv_handle_t* handle) {
+			delete reinterpret_cast<uv_timer_t*>(handle);
+		});
+		m_corkTimer = nullptr;
+	}
+
+	ReleaseIfIdle();
+}
+
+void StreamWriter::ReleaseIfIdle() {
+	// A deferred flush still holds a pointer to us
+	if (m_closed && !m_flushDeferred) {
+		delete this;
+	}
+}
+
+void StreamWriter::OnDeferredFlush(void* data) {
+	auto* writer = static_cast<StreamWriter*>(data);
+	writer->m_flushDeferred = false;
+
+	if (writer->m_closed) {
+		writer->ReleaseIfIdle();
+		return;
+	}
+
+	writer->Flush();
+}
+
+void StreamWriter::OnCorkTimer(uv_timer_t* timer) {
+	static_cast<StreamWriter*>(timer->data)->Flush();
+}
+
+void StreamWriter::OnWrite(uv_write_t* request, int status) {
+	auto* batch = static_cast<SendRequest*>(request->data);
+
+	// The socket may already be destroyed, only its event queue is safe to read
+	if (status != 0 && status != UV_ECANCELED) {
+		const SocketEventQueue* events = batch->backlog.get();
+		if (events && !events->detached.load(std::memory_order_acquire)) {
+			g_CallbackManager.EnqueueError(events->owner, SocketError::SendError, uv_strerror(status));
+		}
+	}
+
+	while (batch) {
+		SendRequest* next = batch->next;
+		batch->Release();
+		batch = next;
+	}
+}
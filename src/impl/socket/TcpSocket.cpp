@@ -2,38 +2,54 @@
 #include "core/EventLoop.h"
 #include "core/CallbackManager.h"
 #include "core/SocketManager.h"
+#include "core/BufferPool.h"
+#include "core/DnsCache.h"
+#include "core/SendRequest.h"
 #include <cstring>
 #include <atomic>
 
 struct TcpConnectContext {
 	uv_connect_t connectRequest;
-	uv_getaddrinfo_t resolverRequest;
-	TcpSocket* socket;
-};
-
-struct TcpWriteContext {
-	uv_write_t writeRequest;
-	std::unique_ptr<char[]> buffer;
-	size_t length;
 	TcpSocket* socket;
+	// uv_hrtime() when Connect was called, for SocketStat::ConnectLatency
+	uint64_t startTime;
 };
 
 TcpSocket::TcpSocket() : SocketBase(SocketType::Tcp) {}
 
 TcpSocket::~TcpSocket() {
-	Disconnect();
+	if (m_shards) {
+		m_shards->Close(OnClose);
+	}
+
+	// Jobs still queued see the socket deleted, so the handles go to a job
+	// that does not touch the socket
+	uv_tcp_t* socketToClose = m_socket.exchange(nullptr, std::memory_order_acq_rel);
+	uv_tcp_t* acceptorToClose = m_acceptor.exchange(nullptr, std::memory_order_acq_rel);
+	StreamWriter* writerToClose = m_writer.exchange(nullptr, std::memory_order_acq_rel);
+	SendRequest* closeFrame = socketToClose ? CreateCloseFrame() : nullptr;
+
+	if (socketToClose || acceptorToClose) {
+		bool posted = GetEventLoop().Post([socketToClose, acceptorToClose, writerToClose, closeFrame]() {
+			CloseStream(socketToClose, writerToClose, closeFrame);
+			if (acceptorToClose && !uv_is_closing(reinterpret_cast<uv_handle_t*>(acceptorToClose))) {
+				uv_close(reinterpret_cast<uv_handle_t*>(acceptorToClose), OnClose);
+			}
+		});
+		if (!posted && closeFrame) {
+			closeFrame->Release();
+		}
+	}
 }
 
 void TcpSocket::InitSocket() {
 	uv_tcp_t* expected = nullptr;
-	uv_tcp_t* newSocket = new uv_tcp_t;
-	uv_tcp_init(g_EventLoop.GetLoop(), newSocket);
-	newSocket->data = this;
+	uv_tcp_t* newSocket = NewStream(GetEventLoop().GetLoop(), GetEventQueue());
 
 	if (!m_socket.compare_exchange_strong(expected, newSocket,
 		std::memory_order_release, std::memory_order_acquire)) {
 		// Another thread already initialized the socket
-		uv_close(reinterpret_cast<uv_handle_t*>(newSocket), OnClose);
+		uv_close(reinterpret_cast<uv_handle_t*>(newSocket), OnStreamClose);
 		return;
 	}
 
@@ -44,7 +60,27 @@ void TcpSocket::InitSocket() {
 	ApplyPendingOptions(reinterpret_cast<uv_handle_t*>(newSocket));
 }
 
+uv_tcp_t* TcpSocket::NewStream(uv_loop_t* loop, std::shared_ptr<SocketEventQueue> events) {
+	auto* stream = new Stream{};
+	stream->events = std::move(events);
+	uv_tcp_init(loop, &stream->tcp);
+	stream->tcp.data = stream;
+	return &stream->tcp;
+}
+
+TcpSocket* TcpSocket::FromStream(uv_handle_t* handle) {
+	const SocketEventQueue* events = static_cast<Stream*>(handle->data)->events.get();
+	if (!events || events->detached.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+	return static_cast<TcpSocket*>(events->owner);
+}
+
 bool TcpSocket::IsOpen() const {
+	if (m_closing.load(std::memory_order_acquire)) {
+		return false;
+	}
+
 	uv_tcp_t* socket = m_socket.load(std::memory_order_acquire);
 	return socket != nullptr && uv_is_active(reinterpret_cast<uv_handle_t*>(socket));
 }
@@ -54,6 +90,17 @@ bool TcpSocket::Bind(const char* hostname, uint16_t port, bool async) {
 		return false;
 	}
 
+	sockaddr_storage address;
+	if (DnsCache::ParseNumeric(hostname, port, address)) {
+		m_localAddr = address;
+		m_localAddrSet = true;
+		return true;
+	}
+
+	if (async) {
+		return GetEventLoop().GetDnsCache().Resolve(hostname, port, OnBindResolved, this);
+	}
+
 	struct addrinfo hints{};
 	hints.ai_family = AF_UNSPEC;
 	hints.ai_socktype = SOCK_STREAM;
@@ -62,68 +109,51 @@ bool TcpSocket::Bind(const char* hostname, uint16_t port, bool async) {
 	char portString[6];
 	snprintf(portString, sizeof(portString), "%hu", port);
 
-	if (async) {
-		auto* request = new uv_getaddrinfo_t;
-		request->data = this;
+	struct addrinfo* addressInfo = nullptr;
+	int result = getaddrinfo(hostname, portString, &hints, &addressInfo);
+	if (result != 0 || !addressInfo) {
+		return false;
+	}
 
-		int result = uv_getaddrinfo(g_EventLoop.GetLoop(), request,
-			[](uv_getaddrinfo_t* request, int status, struct addrinfo* addressInfo) {
-				auto* socket = static_cast<TcpSocket*>(request->data);
+	std::memcpy(&m_localAddr, addressInfo->ai_addr, addressInfo->ai_addrlen);
+	m_localAddrSet = true;
+	freeaddrinfo(addressInfo);
 
-				if (socket->IsDeleted()) {
-					if (addressInfo) uv_freeaddrinfo(addressInfo);
-					delete request;
-					return;
-				}
+	return true;
+}
 
-				if (status == 0 && addressInfo) {
-					std::memcpy(&socket->m_localAddr, addressInfo->ai_addr, addressInfo->ai_addrlen);
-					socket->m_localAddrSet = true;
-					uv_freeaddrinfo(addressInfo);
-				} else {
-					g_CallbackManager.EnqueueError(socket, SocketError::BindError, uv_strerror(status));
-				}
+void TcpSocket::OnBindResolved(void* data, int status, const sockaddr_storage* address) {
+	auto* socket = static_cast<TcpSocket*>(data);
 
-				delete request;
-			},
-			hostname, portString, &hints);
+	if (socket->IsDeleted()) return;
 
-		if (result != 0) {
-			delete request;
-			return false;
-		}
+	if (status == 0) {
+		socket->m_localAddr = *address;
+		socket->m_localAddrSet = true;
 	} else {
-		struct addrinfo* addressInfo = nullptr;
-		int result = getaddrinfo(hostname, portString, &hints, &addressInfo);
-		if (result != 0 || !addressInfo) {
-			return false;
-		}
-
-		std::memcpy(&m_localAddr, addressInfo->ai_addr, addressInfo->ai_addrlen);
-		m_localAddrSet = true;
-		freeaddrinfo(addressInfo);
+		g_CallbackManager.EnqueueError(socket, SocketError::BindError, uv_strerror(status));
 	}
-
-	return true;
 }
 
 bool TcpSocket::Connect(const char* hostname, uint16_t port, bool async) {
-	char portString[6];
-	snprintf(portString, sizeof(portString), "%hu", port);
-
-	struct addrinfo hints{};
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
+	// Reconnecting after Disconnect(), whose job runs before the new handle is made
+	m_closing.store(false, std::memory_order_release);
+
+	if (GetOption(SocketOption::WebSocket) != 0 && !m_webSocket) {
+		std::string host = hostname;
+		if (port != 80) {
+			host += ':';
+			host += std::to_string(port);
+		}
+		m_webSocket = std::make_unique<WebSocketSession>(WebSocketSession::Role::Client, std::move(host),
+			m_webSocketPath.empty() ? std::string("/") : m_webSocketPath);
+	}
 
 	auto* context = new TcpConnectContext;
 	context->socket = this;
-	context->resolverRequest.data = context;
+	context->startTime = uv_hrtime();
 
-	int result = uv_getaddrinfo(g_EventLoop.GetLoop(), &context->resolverRequest, OnResolved,
-		hostname, portString, &hints);
-
-	if (result != 0) {
+	if (!GetEventLoop().GetDnsCache().Resolve(hostname, port, OnResolved, context)) {
 		delete context;
 		return false;
 	}
@@ -131,20 +161,18 @@ bool TcpSocket::Connect(const char* hostname, uint16_t port, bool async) {
 	return true;
 }
 
-void TcpSocket::OnResolved(uv_getaddrinfo_t* request, int status, struct addrinfo* addressInfo) {
-	auto* context = static_cast<TcpConnectContext*>(request->data);
+void TcpSocket::OnResolved(void* data, int status, const sockaddr_storage* address) {
+	auto* context = static_cast<TcpConnectContext*>(data);
 	auto* socket = context->socket;
 
 	if (socket->IsDeleted()) {
 		delete context;
-		if (addressInfo) uv_freeaddrinfo(addressInfo);
 		return;
 	}
 
-	if (status != 0 || !addressInfo) {
+	if (status != 0) {
 		g_CallbackManager.EnqueueError(socket, SocketError::ConnectError, uv_strerror(status));
 		delete context;
-		if (addressInfo) uv_freeaddrinfo(addressInfo);
 		return;
 	}
 
@@ -152,8 +180,8 @@ void TcpSocket::OnResolved(uv_getaddrinfo_t* request, int status, struct addrinf
 		socket->InitSocket();
 	}
 
-	if (addressInfo->ai_family == AF_INET || addressInfo->ai_family == AF_INET6) {
-		socket->m_remoteEndpoint = ExtractEndpoint(addressInfo->ai_addr);
+	if (address->ss_family == AF_INET || address->ss_family == AF_INET6) {
+		socket->m_remoteEndpoint = ExtractEndpoint(reinterpret_cast<const sockaddr*>(address));
 		std::atomic_thread_fence(std::memory_order_release);
 		socket->m_remoteEndpointSet.store(true, std::memory_order_release);
 	}
@@ -164,12 +192,10 @@ void TcpSocket::OnResolved(uv_getaddrinfo_t* request, int status, struct addrinf
 	if (!tcpSocket) {
 		g_CallbackManager.EnqueueError(socket, SocketError::ConnectError, "Socket was closed");
 		delete context;
-		uv_freeaddrinfo(addressInfo);
 		return;
 	}
 
-	int result = uv_tcp_connect(&context->connectRequest, tcpSocket, addressInfo->ai_addr, OnConnect);
-	uv_freeaddrinfo(addressInfo);
+	int result = uv_tcp_connect(&context->connectRequest, tcpSocket, reinterpret_cast<const sockaddr*>(address), OnConnect);
 
 	if (result != 0) {
 		g_CallbackManager.EnqueueError(socket, SocketError::ConnectError, uv_strerror(result));
@@ -180,7 +206,7 @@ void TcpSocket::OnResolved(uv_getaddrinfo_t* request, int status, struct addrinf
 	int connectTimeout = socket->GetOption(SocketOption::ConnectTimeout);
 	if (connectTimeout > 0) {
 		socket->m_connectTimer = new uv_timer_t;
-		uv_timer_init(g_EventLoop.GetLoop(), socket->m_connectTimer);
+		uv_timer_init(socket->GetEventLoop().GetLoop(), socket->m_connectTimer);
 		socket->m_connectTimer->data = socket;
 		uv_timer_start(socket->m_connectTimer, OnConnectTimeout, static_cast<uint64_t>(connectTimeout), 0);
 	}
@@ -198,6 +224,20 @@ void TcpSocket::OnConnect(uv_connect_t* request, int status) {
 	}
 
 	if (status == 0) {
+		// Includes name resolution, as seen by the plugin
+		socket->GetEventQueue()->connectLatency.store((uv_hrtime() - context->startTime) / 1000, std::memory_order_relaxed);
+
+		if (socket->m_webSocket) {
+			// Connect fires once the server accepted the upgrade
+			if (socket->m_webSocket->Start(socket)) {
+				socket->StartReceiving();
+			} else {
+				g_CallbackManager.EnqueueError(socket, SocketError::ConnectError, "Out of memory");
+			}
+			delete context;
+			return;
+		}
+
 		RemoteEndpoint endpoint;
 		if (socket->m_remoteEndpointSet.load(std::memory_order_acquire)) {
 			std::atomic_thread_fence(std::memory_order_acquire);
@@ -213,30 +253,91 @@ void TcpSocket::OnConnect(uv_connect_t* request, int status) {
 }
 
 bool TcpSocket::Disconnect() {
-	uv_tcp_t* socketToClose = m_socket.exchange(nullptr, std::memory_order_acq_rel);
-	uv_tcp_t* acceptorToClose = m_acceptor.exchange(nullptr, std::memory_order_acq_rel);
+	if (m_shards) {
+		m_shards->Close(OnClose);
+	}
 
-	if (socketToClose || acceptorToClose) {
-		g_EventLoop.Post([socketToClose, acceptorToClose]() {
-			if (socketToClose && !uv_is_closing(reinterpret_cast<uv_handle_t*>(socketToClose))) {
-				uv_close(reinterpret_cast<uv_handle_t*>(socketToClose), OnClose);
-			}
-			if (acceptorToClose && !uv_is_closing(reinterpret_cast<uv_handle_t*>(acceptorToClose))) {
+	uv_tcp_t* acceptorToClose = m_acceptor.exchange(nullptr, std::memory_order_acq_rel);
+	if (acceptorToClose) {
+		GetEventLoop().Post([acceptorToClose]() {
+			if (!uv_is_closing(reinterpret_cast<uv_handle_t*>(acceptorToClose))) {
 				uv_close(reinterpret_cast<uv_handle_t*>(acceptorToClose), OnClose);
 			}
 		});
 	}
 
+	if (m_closing.exchange(true, std::memory_order_acq_rel)) {
+		return true;
+	}
+
+	// The handle is taken on the UV thread, after the jobs of earlier sends,
+	// so those are written ahead of the close frame and the FIN
+	SendRequest* closeFrame = CreateCloseFrame();
+	bool posted = GetEventLoop().Post([this, events = GetEventQueue(), closeFrame]() {
+		if (events->detached.load(std::memory_order_acquire)) {
+			// The destructor closed the handles
+			if (closeFrame) closeFrame->Release();
+			return;
+		}
+
+		uv_tcp_t* socketToClose = m_socket.exchange(nullptr, std::memory_order_acq_rel);
+		StreamWriter* writerToClose = m_writer.exchange(nullptr, std::memory_order_acq_rel);
+		CloseStream(socketToClose, writerToClose, closeFrame);
+	});
+	if (!posted && closeFrame) {
+		closeFrame->Release();
+	}
+
 	return true;
 }
 
+SendRequest* TcpSocket::CreateCloseFrame() {
+	// An open WebSocket says goodbye with a close frame
+	if (!m_webSocket || !m_webSocketOpen.exchange(false, std::memory_order_acq_rel)) {
+		return nullptr;
+	}
+
+	const bool masked = m_webSocket->GetRole() == WebSocketSession::Role::Client;
+	const char status[2] = {static_cast<char>(WebSocketSession::kCloseNormal >> 8), static_cast<char>(WebSocketSession::kCloseNormal & 0xFF)};
+	SendRequest* closeFrame = GetEventLoop().GetSendPool().Acquire(this, WebSocketSession::FrameSize(sizeof(status), masked));
+	if (closeFrame) {
+		WebSocketSession::EncodeFrame(closeFrame->data, WebSocketSession::Close, status, sizeof(status), masked);
+	}
+	return closeFrame;
+}
+
+void TcpSocket::CloseStream(uv_tcp_t* socket, StreamWriter* writer, SendRequest* closeFrame) {
+	if (closeFrame) {
+		std::atomic<StreamWriter*> slot{writer};
+		writer = socket ? StreamWriter::Attach(slot, reinterpret_cast<uv_stream_t*>(socket)) : writer;
+		if (writer) {
+			writer->Queue(closeFrame, 0);
+		} else {
+			closeFrame->Release();
+		}
+	}
+
+	// Queued sends go out ahead of the FIN
+	if (writer) {
+		writer->Close();
+	}
+	if (socket && !uv_is_closing(reinterpret_cast<uv_handle_t*>(socket))) {
+		uv_close(reinterpret_cast<uv_handle_t*>(socket), OnStreamClose);
+	}
+}
+
 bool TcpSocket::CloseReset() {
 	uv_tcp_t* socketToClose = m_socket.exchange(nullptr, std::memory_order_acq_rel);
+	StreamWriter* writerToClose = m_writer.exchange(nullptr, std::memory_order_acq_rel);
 
 	if (socketToClose) {
-		g_EventLoop.Post([socketToClose]() {
+		GetEventLoop().Post([socketToClose, writerToClose]() {
+			// A reset throws away unsent data, so queued sends are not flushed
+			if (writerToClose) {
+				writerToClose->Discard();
+			}
 			if (!uv_is_closing(reinterpret_cast<uv_handle_t*>(socketToClose))) {
-				uv_tcp_close_reset(socketToClose, OnClose);
+				uv_tcp_close_reset(socketToClose, OnStreamClose);
 			}
 		});
 		return true;
@@ -250,12 +351,20 @@ bool TcpSocket::Listen() {
 		return false;
 	}
 
-	g_EventLoop.Post([this]() {
+	if (GetOption(SocketOption::ReusePort) && g_EventLoops.GetCount() > 1) {
+		if (!m_shards) {
+			m_shards = std::make_unique<ListenShards>();
+		}
+		m_shards->Open();
+	}
+
+	GetEventLoop().Post([this]() {
 		if (IsDeleted()) return;
 
 		uv_tcp_t* expected = nullptr;
 		uv_tcp_t* newAcceptor = new uv_tcp_t;
-		uv_tcp_init(g_EventLoop.GetLoop(), newAcceptor);
+		// The descriptor has to exist before bind for SO_REUSEPORT
+		uv_tcp_init_ex(GetEventLoop().GetLoop(), newAcceptor, m_shards ? m_localAddr.ss_family : AF_UNSPEC);
 		newAcceptor->data = this;
 
 		if (!m_acceptor.compare_exchange_strong(expected, newAcceptor,
@@ -265,6 +374,10 @@ bool TcpSocket::Listen() {
 			return;
 		}
 
+		if (m_shards) {
+			m_shards->Prepare(reinterpret_cast<uv_handle_t*>(newAcceptor));
+		}
+
 		int result = uv_tcp_bind(newAcceptor, reinterpret_cast<const sockaddr*>(&m_localAddr), 0);
 		if (result != 0) {
 			g_CallbackManager.EnqueueError(this, SocketError::BindError, uv_strerror(result));
@@ -282,11 +395,47 @@ bool TcpSocket::Listen() {
 		}
 
 		g_CallbackManager.EnqueueListen(this, GetLocalEndpoint());
+
+		if (m_shards && m_shards->IsPrepared()) {
+			for (size_t i = 0; i < g_EventLoops.GetCount(); ++i) {
+				EventLoop* loop = &g_EventLoops.Get(i);
+				if (loop != &GetEventLoop()) {
+					loop->Post([this, loop]() { OpenShard(*loop); });
+				}
+			}
+		}
 	});
 
 	return true;
 }
 
+void TcpSocket::OpenShard(EventLoop& loop) {
+	if (IsDeleted()) return;
+
+	auto* acceptor = new uv_tcp_t;
+	uv_tcp_init_ex(loop.GetLoop(), acceptor, m_localAddr.ss_family);
+	acceptor->data = this;
+	auto* handle = reinterpret_cast<uv_handle_t*>(acceptor);
+
+	int result = ListenShards::EnableReusePort(handle) ? 0 : UV_ENOTSUP;
+	if (result == 0) {
+		result = uv_tcp_bind(acceptor, reinterpret_cast<const sockaddr*>(&m_localAddr), 0);
+	}
+	if (result == 0) {
+		ApplyStoredOptions(handle);
+		result = uv_listen(reinterpret_cast<uv_stream_t*>(acceptor), SOMAXCONN, OnConnection);
+	}
+
+	if (result != 0) {
+		// The primary acceptor and the other shards keep serving
+		g_CallbackManager.EnqueueError(this, SocketError::ListenError, uv_strerror(result));
+		uv_close(handle, OnClose);
+		return;
+	}
+
+	m_shards->Set(loop.GetIndex(), handle, OnClose);
+}
+
 void TcpSocket::OnConnection(uv_stream_t* server, int status) {
 	auto* socket = static_cast<TcpSocket*>(server->data);
 
@@ -299,25 +448,34 @@ void TcpSocket::OnConnection(uv_stream_t* server, int status) {
 		return;
 	}
 
-	auto* clientHandle = new uv_tcp_t;
-	uv_tcp_init(g_EventLoop.GetLoop(), clientHandle);
+	// With ReusePort this may be a shard, the client stays on its loop
+	EventLoop& loop = *EventLoop::Current();
+	uv_tcp_t* clientHandle = NewStream(loop.GetLoop(), nullptr);
 
 	if (uv_accept(server, reinterpret_cast<uv_stream_t*>(clientHandle)) == 0) {
-		TcpSocket* newSocket = TcpSocket::CreateFromAccepted(clientHandle);
+		TcpSocket* newSocket = TcpSocket::CreateFromAccepted(clientHandle, loop);
 		if (newSocket) {
+			newSocket->StoreOption(SocketOption::DirectDispatch, socket->GetOption(SocketOption::DirectDispatch));
+			if (int webSocket = socket->GetOption(SocketOption::WebSocket); webSocket != 0) {
+				newSocket->StoreOption(SocketOption::WebSocket, webSocket);
+				newSocket->StoreOption(SocketOption::FramingMaxSize, socket->GetOption(SocketOption::FramingMaxSize));
+				newSocket->m_webSocket = std::make_unique<WebSocketSession>(WebSocketSession::Role::Server, std::string(), std::string());
+			}
+			// Keep its events back until the Incoming callback gave it a handle
+			newSocket->GetEventQueue()->held.store(true, std::memory_order_release);
 			RemoteEndpoint endpoint = newSocket->GetRemoteEndpoint();
 			g_CallbackManager.EnqueueIncoming(socket, newSocket, endpoint);
 			newSocket->StartReceiving();
 		}
 	} else {
-		uv_close(reinterpret_cast<uv_handle_t*>(clientHandle), OnClose);
+		uv_close(reinterpret_cast<uv_handle_t*>(clientHandle), OnStreamClose);
 	}
 }
 
-TcpSocket* TcpSocket::CreateFromAccepted(uv_tcp_t* clientHandle) {
-	auto* socket = g_SocketManager.CreateSocket<TcpSocket>();
+TcpSocket* TcpSocket::CreateFromAccepted(uv_tcp_t* clientHandle, EventLoop& loop) {
+	auto* socket = g_SocketManager.CreateSocket<TcpSocket>(&loop);
+	static_cast<Stream*>(clientHandle->data)->events = socket->GetEventQueue();
 	socket->m_socket.store(clientHandle, std::memory_order_release);
-	clientHandle->data = socket;
 
 	sockaddr_storage peerAddress;
 	int addressLength = sizeof(peerAddress);
@@ -337,27 +495,78 @@ void TcpSocket::StartReceiving() {
 	uv_read_start(reinterpret_cast<uv_stream_t*>(socket), OnAllocBuffer, OnRead);
 }
 
+void TcpSocket::ResumeReceiving() {
+	GetEventLoop().Post([this]() {
+		if (IsDeleted()) return;
+		StartReceiving();
+	});
+}
+
+bool TcpSocket::SetWebSocketPath(std::string_view path) {
+	if (path.empty() || path.front() != '/' || m_webSocket) {
+		return false;
+	}
+
+	m_webSocketPath = path;
+	return true;
+}
+
+bool TcpSocket::SetFrameDelimiter(std::string_view delimiter) {
+	if (delimiter.empty() || delimiter.size() > StreamFramer::kMaxDelimiterLength) {
+		return false;
+	}
+
+	// Pack the delimiter into the job so it needs no allocation
+	uint64_t packed = 0;
+	std::memcpy(&packed, delimiter.data(), delimiter.size());
+	size_t length = delimiter.size();
+
+	return GetEventLoop().Post([this, packed, length]() {
+		if (IsDeleted()) return;
+		m_framer.SetDelimiter(reinterpret_cast<const char*>(&packed), length);
+	});
+}
+
 void TcpSocket::OnAllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer) {
-	auto* socket = static_cast<TcpSocket*>(handle->data);
-	buffer->base = socket->m_recvBuffer;
-	buffer->len = kRecvBufferSize;
+	TcpSocket* socket = FromStream(handle);
+	if (!socket) {
+		*buffer = uv_buf_init(nullptr, 0);
+		return;
+	}
+
+	size_t length;
+	PooledBuffer* slab = socket->m_receiveSizer.Acquire(socket->GetOption(SocketOption::ReceiveChunkSize), length);
+	if (!slab) {
+		*buffer = uv_buf_init(nullptr, 0);
+		return;
+	}
+	*buffer = uv_buf_init(slab->Data(), static_cast<unsigned int>(length));
 }
 
 void TcpSocket::OnRead(uv_stream_t* stream, ssize_t bytesRead, const uv_buf_t* buffer) {
-	auto* socket = static_cast<TcpSocket*>(stream->data);
+	TcpSocket* socket = FromStream(reinterpret_cast<uv_handle_t*>(stream));
+	PooledBuffer* slab = PooledBuffer::FromData(buffer->base);
 
-	if (socket->IsDeleted()) {
+	if (!socket) {
+		if (slab) slab->Release();
 		return;
 	}
 
 	if (bytesRead > 0) {
-		RemoteEndpoint endpoint;
-		if (socket->m_remoteEndpointSet.load(std::memory_order_acquire)) {
-			std::atomic_thread_fence(std::memory_order_acquire);
-			endpoint = socket->m_remoteEndpoint;
+		socket->m_receiveSizer.Record(static_cast<size_t>(bytesRead), buffer->len);
+		if (!socket->ConsumeRead(slab, buffer->base, static_cast<size_t>(bytesRead))) {
+			uv_read_stop(stream);
+			return;
+		}
+		if (g_CallbackManager.PauseIfBacklogged(socket)) {
+			uv_read_stop(stream);
 		}
-		g_CallbackManager.EnqueueReceive(socket, buffer->base, bytesRead, endpoint);
-	} else if (bytesRead < 0) {
+		return;
+	}
+
+	if (slab) slab->Release();
+
+	if (bytesRead < 0) {
 		if (bytesRead == UV_EOF || bytesRead == UV_ECONNRESET || bytesRead == UV_ECONNABORTED) {
 			g_CallbackManager.EnqueueDisconnect(socket);
 		} else if (bytesRead != UV_ECANCELED) {
@@ -366,47 +575,89 @@ void TcpSocket::OnRead(uv_stream_t* stream, ssize_t bytesRead, const uv_buf_t* b
 	}
 }
 
+bool TcpSocket::ConsumeRead(PooledBuffer* slab, char* data, size_t length) {
+	RemoteEndpoint endpoint;
+	if (m_remoteEndpointSet.load(std::memory_order_acquire)) {
+		std::atomic_thread_fence(std::memory_order_acquire);
+		endpoint = m_remoteEndpoint;
+	}
+	return m_webSocket
+		? m_webSocket->Consume(this, slab, data, length, endpoint)
+		: m_framer.Consume(this, slab, data, length, endpoint);
+}
+
 bool TcpSocket::Send(std::string_view data, bool async) {
-	auto* context = new TcpWriteContext;
-	context->buffer = std::make_unique<char[]>(data.length());
-	std::memcpy(context->buffer.get(), data.data(), data.length());
-	context->length = data.length();
-	context->socket = this;
-	context->writeRequest.data = context;
+	if (m_closing.load(std::memory_order_acquire)) {
+		return false;
+	}
 
-	g_EventLoop.Post([this, context]() {
-		if (IsDeleted()) {
-			delete context;
-			return;
+	SendRequest* request;
+	if (m_webSocket) {
+		// One unfragmented message per Send
+		const bool masked = m_webSocket->GetRole() == WebSocketSession::Role::Client;
+		auto opcode = GetOption(SocketOption::WebSocket) == static_cast<int>(WebSocketMode::Binary)
+			? WebSocketSession::Binary
+			: WebSocketSession::Text;
+		request = GetEventLoop().GetSendPool().Acquire(this, WebSocketSession::FrameSize(data.size(), masked));
+		if (request) {
+			WebSocketSession::EncodeFrame(request->data, opcode, data.data(), data.size(), masked);
 		}
+	} else {
+		request = GetEventLoop().GetSendPool().Acquire(this, data);
+	}
+	if (!request) {
+		return false;
+	}
 
-		uv_tcp_t* socket = m_socket.load(std::memory_order_acquire);
-		if (!socket) {
-			delete context;
+	bool posted = GetEventLoop().Post([this, request]() {
+		// The request keeps the event queue alive, the socket may be gone
+		if (request->backlog->detached.load(std::memory_order_acquire)) {
+			request->Release();
 			return;
 		}
 
-		uv_buf_t uvBuffer = uv_buf_init(context->buffer.get(), static_cast<unsigned int>(context->length));
-		int result = uv_write(&context->writeRequest, reinterpret_cast<uv_stream_t*>(socket), &uvBuffer, 1, OnWrite);
-
-		if (result != 0) {
-			g_CallbackManager.EnqueueError(this, SocketError::SendError, uv_strerror(result));
-			delete context;
+		// Messages wait for the WebSocket handshake
+		if (m_webSocket && !m_webSocket->IsOpen()) {
+			m_webSocket->Hold(request);
+			return;
 		}
+
+		Write(request);
 	});
 
+	if (!posted) {
+		request->Release();
+		return false;
+	}
+
 	return true;
 }
 
-void TcpSocket::OnWrite(uv_write_t* request, int status) {
-	auto* context = static_cast<TcpWriteContext*>(request->data);
-	auto* socket = context->socket;
+bool TcpSocket::Write(SendRequest* request) {
+	uv_tcp_t* socket = m_socket.load(std::memory_order_acquire);
+	if (!socket) {
+		request->Release();
+		return false;
+	}
 
-	if (!socket->IsDeleted() && status != 0 && status != UV_ECANCELED) {
-		g_CallbackManager.EnqueueError(socket, SocketError::SendError, uv_strerror(status));
+	StreamWriter* writer = StreamWriter::Attach(m_writer, reinterpret_cast<uv_stream_t*>(socket));
+	if (!writer) {
+		g_CallbackManager.EnqueueError(this, SocketError::SendError, "Out of memory");
+		request->Release();
+		return false;
 	}
 
-	delete context;
+	// CloseReset() may have taken the handle while the writer was created
+	if (m_socket.load(std::memory_order_acquire) != socket) {
+		if (StreamWriter* stale = m_writer.exchange(nullptr, std::memory_order_acq_rel)) {
+			stale->Discard();
+		}
+		request->Release();
+		return false;
+	}
+
+	writer->Queue(request, GetOption(SocketOption::CorkWindow));
+	return true;
 }
 
 bool TcpSocket::SendTo(std::string_view data, const char* hostname, uint16_t port, bool async) {
@@ -417,7 +668,7 @@ bool TcpSocket::SetOption(SocketOption option, int value) {
 	// Store in atomic array for immediate reads
 	StoreOption(option, value);
 
-	if (option == SocketOption::ConnectTimeout || option == SocketOption::AutoFreeHandle) {
+	if (IsExtensionOption(option)) {
 		return true;
 	}
 
@@ -462,6 +713,10 @@ void TcpSocket::OnClose(uv_handle_t* handle) {
 	}
 }
 
+void TcpSocket::OnStreamClose(uv_handle_t* handle) {
+	delete static_cast<Stream*>(handle->data);
+}
+
 void TcpSocket::OnShutdown(uv_shutdown_t* request, int status) {
 	delete request;
 }
@@ -472,7 +727,7 @@ void TcpSocket::OnConnectTimeout(uv_timer_t* timer) {
 	uv_tcp_t* socketToClose = socket->m_socket.exchange(nullptr, std::memory_order_acq_rel);
 
 	if (socketToClose && !uv_is_closing(reinterpret_cast<uv_handle_t*>(socketToClose))) {
-		uv_close(reinterpret_cast<uv_handle_t*>(socketToClose), OnClose);
+		uv_close(reinterpret_cast<uv_handle_t*>(socketToClose), OnStreamClose);
 	}
 
 	if (!socket->IsDeleted()) {
@@ -1,17 +1,75 @@
 #include "socket/UdpSocket.h"
 #include "core/EventLoop.h"
 #include "core/CallbackManager.h"
+#include "core/BufferPool.h"
+#include "core/DnsCache.h"
 #include <cstring>
 #include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+#include <cerrno>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#if UV_VERSION_HEX < 0x013200
+#define SOCKET_USE_SENDMMSG
+#endif
+#endif
+
+/**
+ * Several uv_udp_send requests sharing one payload, freed with the last.
+ * UV thread only.
+ */
+struct PendingSends {
+	virtual ~PendingSends() = default;
+
+	UdpSocket* socket = nullptr;
+	std::unique_ptr<uv_udp_send_t[]> requests;
+	size_t outstanding = 0;
+	bool errorReported = false;
+};
+
+/**
+ * Payload shared by every destination of one SendToMany call.
+ * Created on the game thread, sent and freed on the UV thread.
+ */
+struct DatagramBatch : PendingSends {
+	std::string payload;
+	std::vector<sockaddr_storage> destinations;
+};
+
+/**
+ * A message cut into UdpSegmentSize datagrams that GSO did not send.
+ */
+struct SegmentedSend : PendingSends {
+	~SegmentedSend() override {
+		request->Release();
+	}
 
-struct UdpSendContext {
-	uv_udp_send_t sendRequest;
-	uv_getaddrinfo_t resolverRequest;
-	std::unique_ptr<char[]> buffer;
-	size_t length;
-	UdpSocket* socket;
+	SendRequest* request = nullptr;
 };
 
+// Destinations handed to the kernel per sendmmsg/uv_udp_try_send2 call
+static constexpr size_t kMaxBatchSend = 64;
+
+#ifdef SOCKET_USE_SENDMMSG
+static socklen_t AddressLength(const sockaddr_storage& address) {
+	return address.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+}
+#endif
+
 UdpSocket::UdpSocket() : SocketBase(SocketType::Udp) {}
 
 UdpSocket::~UdpSocket() {
@@ -21,7 +79,11 @@ UdpSocket::~UdpSocket() {
 void UdpSocket::InitSocket(int addressFamily) {
 	uv_udp_t* expected = nullptr;
 	uv_udp_t* newSocket = new uv_udp_t;
-	uv_udp_init(g_EventLoop.GetLoop(), newSocket);
+	// Read up to a batch buffer's worth of datagrams per recvmmsg where the
+	// platform has it, libuv ignores the flag elsewhere. A ReusePort listener
+	// needs its descriptor before bind.
+	const bool shared = m_shards && m_localAddrSet;
+	uv_udp_init_ex(GetEventLoop().GetLoop(), newSocket, (shared ? m_localAddr.ss_family : AF_UNSPEC) | UV_UDP_RECVMMSG);
 	newSocket->data = this;
 
 	if (!m_socket.compare_exchange_strong(expected, newSocket,
@@ -31,6 +93,10 @@ void UdpSocket::InitSocket(int addressFamily) {
 		return;
 	}
 
+	if (shared) {
+		m_shards->Prepare(reinterpret_cast<uv_handle_t*>(newSocket));
+	}
+
 	int result = 0;
 	if (m_localAddrSet) {
 		result = uv_udp_bind(newSocket, reinterpret_cast<const sockaddr*>(&m_localAddr), 0);
@@ -64,6 +130,17 @@ bool UdpSocket::Bind(const char* hostname, uint16_t port, bool async) {
 		return false;
 	}
 
+	sockaddr_storage address;
+	if (DnsCache::ParseNumeric(hostname, port, address)) {
+		m_localAddr = address;
+		m_localAddrSet = true;
+		return true;
+	}
+
+	if (async) {
+		return GetEventLoop().GetDnsCache().Resolve(hostname, port, OnBindResolved, this);
+	}
+
 	struct addrinfo hints{};
 	hints.ai_family = AF_UNSPEC;
 	hints.ai_socktype = SOCK_DGRAM;
@@ -72,107 +149,72 @@ bool UdpSocket::Bind(const char* hostname, uint16_t port, bool async) {
 	char portString[6];
 	snprintf(portString, sizeof(portString), "%hu", port);
 
-	if (async) {
-		auto* request = new uv_getaddrinfo_t;
-		request->data = this;
+	struct addrinfo* addressInfo = nullptr;
+	int result = getaddrinfo(hostname, portString, &hints, &addressInfo);
+	if (result != 0 || !addressInfo) {
+		return false;
+	}
 
-		int result = uv_getaddrinfo(g_EventLoop.GetLoop(), request,
-			[](uv_getaddrinfo_t* request, int status, struct addrinfo* addressInfo) {
-				auto* socket = static_cast<UdpSocket*>(request->data);
+	std::memcpy(&m_localAddr, addressInfo->ai_addr, addressInfo->ai_addrlen);
+	m_localAddrSet = true;
+	freeaddrinfo(addressInfo);
 
-				if (socket->IsDeleted()) {
-					if (addressInfo) uv_freeaddrinfo(addressInfo);
-					delete request;
-					return;
-				}
+	return true;
+}
 
-				if (status == 0 && addressInfo) {
-					std::memcpy(&socket->m_localAddr, addressInfo->ai_addr, addressInfo->ai_addrlen);
-					socket->m_localAddrSet = true;
-					uv_freeaddrinfo(addressInfo);
-				} else {
-					g_CallbackManager.EnqueueError(socket, SocketError::BindError, uv_strerror(status));
-				}
+void UdpSocket::OnBindResolved(void* data, int status, const sockaddr_storage* address) {
+	auto* socket = static_cast<UdpSocket*>(data);
 
-				delete request;
-			},
-			hostname, portString, &hints);
+	if (socket->IsDeleted()) return;
 
-		if (result != 0) {
-			delete request;
-			return false;
-		}
+	if (status == 0) {
+		socket->m_localAddr = *address;
+		socket->m_localAddrSet = true;
 	} else {
-		struct addrinfo* addressInfo = nullptr;
-		int result = getaddrinfo(hostname, portString, &hints, &addressInfo);
-		if (result != 0 || !addressInfo) {
-			return false;
-		}
-
-		std::memcpy(&m_localAddr, addressInfo->ai_addr, addressInfo->ai_addrlen);
-		m_localAddrSet = true;
-		freeaddrinfo(addressInfo);
+		g_CallbackManager.EnqueueError(socket, SocketError::BindError, uv_strerror(status));
 	}
-
-	return true;
 }
 
 bool UdpSocket::Connect(const char* hostname, uint16_t port, bool async) {
-	char portString[6];
-	snprintf(portString, sizeof(portString), "%hu", port);
-
-	struct addrinfo hints{};
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_DGRAM;
-	hints.ai_protocol = IPPROTO_UDP;
-
-	auto* request = new uv_getaddrinfo_t;
-	request->data = this;
-
-	int result = uv_getaddrinfo(g_EventLoop.GetLoop(), request,
-		[](uv_getaddrinfo_t* request, int status, struct addrinfo* addressInfo) {
-			auto* socket = static_cast<UdpSocket*>(request->data);
-
-			if (socket->IsDeleted()) {
-				if (addressInfo) uv_freeaddrinfo(addressInfo);
-				delete request;
-				return;
-			}
+	return GetEventLoop().GetDnsCache().Resolve(hostname, port, OnConnectResolved, this);
+}
 
-			if (status == 0 && addressInfo) {
-				if (socket->m_socket.load(std::memory_order_acquire) == nullptr) {
-					socket->InitSocket(addressInfo->ai_family);
-				}
+void UdpSocket::OnConnectResolved(void* data, int status, const sockaddr_storage* address) {
+	auto* socket = static_cast<UdpSocket*>(data);
 
-				std::memcpy(&socket->m_connectedAddr, addressInfo->ai_addr, addressInfo->ai_addrlen);
-				socket->m_isConnected.store(true, std::memory_order_release);
-				uv_freeaddrinfo(addressInfo);
+	if (socket->IsDeleted()) return;
 
-				RemoteEndpoint endpoint;
-				g_CallbackManager.EnqueueConnect(socket, endpoint);
-				socket->StartReceiving();
-			} else {
-				g_CallbackManager.EnqueueError(socket, SocketError::ConnectError, uv_strerror(status));
-			}
-
-			delete request;
-		},
-		hostname, portString, &hints);
+	if (status != 0) {
+		g_CallbackManager.EnqueueError(socket, SocketError::ConnectError, uv_strerror(status));
+		return;
+	}
 
-	if (result != 0) {
-		delete request;
-		return false;
+	if (socket->m_socket.load(std::memory_order_acquire) == nullptr) {
+		socket->InitSocket(address->ss_family);
 	}
 
-	return true;
+	socket->m_connectedAddr = *address;
+	socket->m_isConnected.store(true, std::memory_order_release);
+
+	RemoteEndpoint endpoint;
+	g_CallbackManager.EnqueueConnect(socket, endpoint);
+	socket->StartReceiving();
 }
 
 bool UdpSocket::Disconnect() {
 	uv_udp_t* socketToClose = m_socket.exchange(nullptr, std::memory_order_acq_rel);
+	uv_poll_t* groToClose = m_groPoll.exchange(nullptr, std::memory_order_acq_rel);
 	m_isConnected.store(false, std::memory_order_release);
 
+	if (m_shards) {
+		m_shards->Close(OnClose);
+	}
+
 	if (socketToClose) {
-		g_EventLoop.Post([socketToClose]() {
+		GetEventLoop().Post([socketToClose, groToClose]() {
+			if (groToClose) {
+				CloseGroPoll(groToClose);
+			}
 			if (!uv_is_closing(reinterpret_cast<uv_handle_t*>(socketToClose))) {
 				uv_udp_recv_stop(socketToClose);
 				uv_close(reinterpret_cast<uv_handle_t*>(socketToClose), OnClose);
@@ -193,19 +235,66 @@ bool UdpSocket::Listen() {
 		return false;
 	}
 
-	g_EventLoop.Post([this]() {
+	if (GetOption(SocketOption::ReusePort) && g_EventLoops.GetCount() > 1) {
+		if (!m_shards) {
+			m_shards = std::make_unique<ListenShards>();
+		}
+		m_shards->Open();
+	}
+
+	GetEventLoop().Post([this]() {
 		if (IsDeleted()) return;
 
+		// A handle opened earlier by a send was bound without SO_REUSEPORT
+		bool shard = false;
 		if (m_socket.load(std::memory_order_acquire) == nullptr) {
 			InitSocket();
+			shard = m_shards && m_shards->IsPrepared();
 		}
 		StartReceiving();
 		g_CallbackManager.EnqueueListen(this, GetLocalEndpoint());
+
+		if (shard) {
+			for (size_t i = 0; i < g_EventLoops.GetCount(); ++i) {
+				EventLoop* loop = &g_EventLoops.Get(i);
+				if (loop != &GetEventLoop()) {
+					loop->Post([this, loop]() { OpenShard(*loop); });
+				}
+			}
+		}
 	});
 
 	return true;
 }
 
+void UdpSocket::OpenShard(EventLoop& loop) {
+	if (IsDeleted()) return;
+
+	auto* shard = new uv_udp_t;
+	uv_udp_init_ex(loop.GetLoop(), shard, m_localAddr.ss_family | UV_UDP_RECVMMSG);
+	shard->data = this;
+	auto* handle = reinterpret_cast<uv_handle_t*>(shard);
+
+	int result = ListenShards::EnableReusePort(handle) ? 0 : UV_ENOTSUP;
+	if (result == 0) {
+		result = uv_udp_bind(shard, reinterpret_cast<const sockaddr*>(&m_localAddr), 0);
+	}
+	if (result == 0) {
+		ApplyStoredOptions(handle);
+		// UDP_GRO stays with the primary handle, shards use plain reads
+		result = uv_udp_recv_start(shard, OnAllocBuffer, OnRecv);
+	}
+
+	if (result != 0) {
+		// The primary handle and the other shards keep receiving
+		g_CallbackManager.EnqueueError(this, SocketError::BindError, uv_strerror(result));
+		uv_close(handle, OnClose);
+		return;
+	}
+
+	m_shards->Set(loop.GetIndex(), handle, OnClose);
+}
+
 bool UdpSocket::Send(std::string_view data, bool async) {
 	if (!m_isConnected.load(std::memory_order_acquire)) {
 		return false;
@@ -216,141 +305,626 @@ bool UdpSocket::Send(std::string_view data, bool async) {
 
 bool UdpSocket::SendTo(std::string_view data, const char* hostname, uint16_t port, bool async) {
 	if (hostname && port > 0) {
-		char portString[6];
-		snprintf(portString, sizeof(portString), "%hu", port);
-
-		struct addrinfo hints{};
-		hints.ai_family = AF_UNSPEC;
-		hints.ai_socktype = SOCK_DGRAM;
-		hints.ai_protocol = IPPROTO_UDP;
-
-		auto* context = new UdpSendContext;
-		context->buffer = std::make_unique<char[]>(data.length());
-		std::memcpy(context->buffer.get(), data.data(), data.length());
-		context->length = data.length();
-		context->socket = this;
-		context->resolverRequest.data = context;
-
-		int result = uv_getaddrinfo(g_EventLoop.GetLoop(), &context->resolverRequest,
-			[](uv_getaddrinfo_t* resolverRequest, int status, struct addrinfo* addressInfo) {
-				auto* context = static_cast<UdpSendContext*>(resolverRequest->data);
-				auto* socket = context->socket;
-
-				if (socket->IsDeleted()) {
-					delete context;
-					if (addressInfo) uv_freeaddrinfo(addressInfo);
-					return;
-				}
-
-				if (status != 0 || !addressInfo) {
-					g_CallbackManager.EnqueueError(socket, SocketError::NoHost, uv_strerror(status));
-					delete context;
-					if (addressInfo) uv_freeaddrinfo(addressInfo);
-					return;
-				}
-
-				if (socket->m_socket.load(std::memory_order_acquire) == nullptr) {
-					socket->InitSocket(addressInfo->ai_family);
-				}
-
-				uv_udp_t* udpSocket = socket->m_socket.load(std::memory_order_acquire);
-				if (!udpSocket) {
-					delete context;
-					uv_freeaddrinfo(addressInfo);
-					return;
-				}
-
-				context->sendRequest.data = context;
-				uv_buf_t uvBuffer = uv_buf_init(context->buffer.get(), static_cast<unsigned int>(context->length));
+		SendRequest* request = GetEventLoop().GetSendPool().Acquire(this, data);
+		if (!request) {
+			return false;
+		}
 
-				int sendResult = uv_udp_send(&context->sendRequest, udpSocket, &uvBuffer, 1, addressInfo->ai_addr, OnSend);
-				uv_freeaddrinfo(addressInfo);
+		// Literals skip the resolver entirely, names are looked up (and
+		// cached) on the UV thread
+		if (!DnsCache::ParseNumeric(hostname, port, request->address)) {
+			request->address.ss_family = AF_UNSPEC;
+			request->host.assign(hostname);
+			request->port = port;
+		}
 
-				if (sendResult != 0) {
-					g_CallbackManager.EnqueueError(socket, SocketError::SendError, uv_strerror(sendResult));
-					delete context;
-				}
-			},
-			hostname, portString, &hints);
+		bool posted = GetEventLoop().Post([this, request]() {
+			if (request->address.ss_family != AF_UNSPEC) {
+				OnSendToResolved(request, 0, &request->address);
+			} else {
+				GetEventLoop().GetDnsCache().Lookup(request->host, request->port, OnSendToResolved, request);
+			}
+		});
 
-		if (result != 0) {
-			delete context;
+		if (!posted) {
+			request->Release();
 			return false;
 		}
 
 		return true;
 	} else if (m_isConnected.load(std::memory_order_acquire)) {
-		auto* context = new UdpSendContext;
-		context->buffer = std::make_unique<char[]>(data.length());
-		std::memcpy(context->buffer.get(), data.data(), data.length());
-		context->length = data.length();
-		context->socket = this;
-		context->sendRequest.data = context;
-
-		g_EventLoop.Post([this, context]() {
+		SendRequest* request = GetEventLoop().GetSendPool().Acquire(this, data);
+		if (!request) {
+			return false;
+		}
+
+		bool posted = GetEventLoop().Post([this, request]() {
 			if (IsDeleted()) {
-				delete context;
+				request->Release();
 				return;
 			}
 
 			uv_udp_t* socket = m_socket.load(std::memory_order_acquire);
 			if (!socket) {
-				delete context;
+				request->Release();
 				return;
 			}
 
-			uv_buf_t uvBuffer = uv_buf_init(context->buffer.get(), static_cast<unsigned int>(context->length));
-			const sockaddr* destinationAddress = reinterpret_cast<const sockaddr*>(&m_connectedAddr);
-			int result = uv_udp_send(&context->sendRequest, socket, &uvBuffer, 1, destinationAddress, OnSend);
-
-			if (result != 0) {
-				g_CallbackManager.EnqueueError(this, SocketError::SendError, uv_strerror(result));
-				delete context;
-			}
+			Transmit(socket, request, m_connectedAddr);
 		});
 
+		if (!posted) {
+			request->Release();
+			return false;
+		}
+
 		return true;
 	}
 
 	return false;
 }
 
+void UdpSocket::OnSendToResolved(void* data, int status, const sockaddr_storage* address) {
+	auto* request = static_cast<SendRequest*>(data);
+	auto* socket = static_cast<UdpSocket*>(request->socket);
+
+	if (socket->IsDeleted()) {
+		request->Release();
+		return;
+	}
+
+	if (status != 0) {
+		g_CallbackManager.EnqueueError(socket, SocketError::NoHost, uv_strerror(status));
+		request->Release();
+		return;
+	}
+
+	if (socket->m_socket.load(std::memory_order_acquire) == nullptr) {
+		socket->InitSocket(address->ss_family);
+	}
+
+	uv_udp_t* udpSocket = socket->m_socket.load(std::memory_order_acquire);
+	if (!udpSocket) {
+		request->Release();
+		return;
+	}
+
+	socket->Transmit(udpSocket, request, *address);
+}
+
+void UdpSocket::Transmit(uv_udp_t* handle, SendRequest* request, const sockaddr_storage& destination) {
+	int segmentSize = GetOption(SocketOption::UdpSegmentSize);
+	if (segmentSize > 0 && request->length > static_cast<size_t>(segmentSize)) {
+		TransmitSegments(handle, request, destination, static_cast<size_t>(segmentSize));
+		return;
+	}
+
+	// libuv copies the destination, so it may be a temporary
+	request->udpSend.data = request;
+	uv_buf_t uvBuffer = request->Buffer();
+
+	int result = uv_udp_send(&request->udpSend, handle, &uvBuffer, 1,
+		reinterpret_cast<const sockaddr*>(&destination), OnSend);
+
+	if (result != 0) {
+		g_CallbackManager.EnqueueError(this, SocketError::SendError, uv_strerror(result));
+		request->Release();
+	}
+}
+
+void UdpSocket::TransmitSegments(uv_udp_t* handle, SendRequest* request, const sockaddr_storage& destination, size_t segmentSize) {
+	size_t sent = 0;
+#ifdef __linux__
+	sent = TrySendSegments(handle, *request, destination, segmentSize);
+#endif
+	if (sent == request->length) {
+		request->Release();
+		return;
+	}
+
+	auto* pending = new (std::nothrow) SegmentedSend;
+	if (!pending) {
+		g_CallbackManager.EnqueueError(this, SocketError::SendError, "Out of memory");
+		request->Release();
+		return;
+	}
+	pending->socket = this;
+	pending->request = request;
+
+	size_t count = (request->length - sent + segmentSize - 1) / segmentSize;
+	pending->requests.reset(new (std::nothrow) uv_udp_send_t[count]);
+	if (!pending->requests) {
+		g_CallbackManager.EnqueueError(this, SocketError::SendError, "Out of memory");
+		delete pending;
+		return;
+	}
+
+	SendAll(handle, pending, count, [&](size_t i) {
+		size_t offset = sent + i * segmentSize;
+		size_t length = request->length - offset < segmentSize ? request->length - offset : segmentSize;
+		return uv_buf_init(request->data + offset, static_cast<unsigned int>(length));
+	}, [&](size_t) {
+		return &destination;
+	});
+}
+
+size_t UdpSocket::SendToMany(std::string_view data, const DatagramTarget* targets, size_t count) {
+	auto* batch = new (std::nothrow) DatagramBatch;
+	if (!batch) {
+		return 0;
+	}
+	batch->socket = this;
+	batch->payload.assign(data.data(), data.length());
+	batch->destinations.reserve(count);
+
+	size_t queued = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const DatagramTarget& target = targets[i];
+		if (!target.host || target.port == 0) {
+			continue;
+		}
+
+		sockaddr_storage address;
+		if (DnsCache::ParseNumeric(target.host, target.port, address)) {
+			batch->destinations.push_back(address);
+		} else if (SendTo(data, target.host, target.port)) {
+			++queued;
+		}
+	}
+
+	if (batch->destinations.empty()) {
+		delete batch;
+		return queued;
+	}
+
+	size_t literals = batch->destinations.size();
+	if (!GetEventLoop().Post([batch]() { SendBatch(batch); })) {
+		delete batch;
+		return queued;
+	}
+
+	return queued + literals;
+}
+
+void UdpSocket::SendBatch(DatagramBatch* batch) {
+	UdpSocket* socket = batch->socket;
+
+	if (socket->IsDeleted()) {
+		delete batch;
+		return;
+	}
+
+	if (socket->m_socket.load(std::memory_order_acquire) == nullptr) {
+		socket->InitSocket(batch->destinations.front().ss_family);
+	}
+
+	uv_udp_t* handle = socket->m_socket.load(std::memory_order_acquire);
+	if (!handle) {
+		delete batch;
+		return;
+	}
+
+	size_t total = batch->destinations.size();
+	size_t sent = TrySendBatch(handle, *batch);
+	if (sent == total) {
+		delete batch;
+		return;
+	}
+
+	// Whatever the kernel did not take right away is queued on the handle
+	// like a regular SendTo and sent as the socket becomes writable
+	size_t remaining = total - sent;
+	batch->requests.reset(new (std::nothrow) uv_udp_send_t[remaining]);
+	if (!batch->requests) {
+		g_CallbackManager.EnqueueError(socket, SocketError::SendError, "Out of memory");
+		delete batch;
+		return;
+	}
+
+	uv_buf_t buffer = uv_buf_init(batch->payload.data(), static_cast<unsigned int>(batch->payload.length()));
+	SendAll(handle, batch, remaining, [&](size_t) {
+		return buffer;
+	}, [&](size_t i) {
+		return &batch->destinations[sent + i];
+	});
+}
+
+template<typename BufferAt, typename DestinationAt>
+void UdpSocket::SendAll(uv_udp_t* handle, PendingSends* pending, size_t count, BufferAt bufferAt, DestinationAt destinationAt) {
+	pending->outstanding = count;
+
+	int failure = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uv_udp_send_t* request = &pending->requests[i];
+		request->data = pending;
+
+		uv_buf_t buffer = bufferAt(i);
+		const sockaddr* destination = reinterpret_cast<const sockaddr*>(destinationAt(i));
+		int result = uv_udp_send(request, handle, &buffer, 1, destination, OnBatchSend);
+		if (result != 0) {
+			failure = result;
+			--pending->outstanding;
+		}
+	}
+
+	if (failure != 0) {
+		pending->errorReported = true;
+		g_CallbackManager.EnqueueError(pending->socket, SocketError::SendError, uv_strerror(failure));
+	}
+
+	if (pending->outstanding == 0) {
+		delete pending;
+	}
+}
+
+size_t UdpSocket::TrySendBatch(uv_udp_t* handle, DatagramBatch& batch) {
+	// Sends already queued on the handle go first, as with uv_udp_try_send
+	if (uv_udp_get_send_queue_count(handle) > 0) {
+		return 0;
+	}
+
+	size_t total = batch.destinations.size();
+	size_t sent = 0;
+
+#if UV_VERSION_HEX >= 0x013200
+	uv_buf_t buffer = uv_buf_init(batch.payload.data(), static_cast<unsigned int>(batch.payload.length()));
+	uv_buf_t* buffers[kMaxBatchSend];
+	unsigned int bufferCounts[kMaxBatchSend];
+	struct sockaddr* addresses[kMaxBatchSend];
+
+	while (sent < total) {
+		size_t count = total - sent < kMaxBatchSend ? total - sent : kMaxBatchSend;
+		for (size_t i = 0; i < count; ++i) {
+			buffers[i] = &buffer;
+			bufferCounts[i] = 1;
+			addresses[i] = reinterpret_cast<struct sockaddr*>(&batch.destinations[sent + i]);
+		}
+
+		int result = uv_udp_try_send2(handle, static_cast<unsigned int>(count), buffers, bufferCounts, addresses, 0);
+		if (result <= 0) {
+			break;
+		}
+		sent += static_cast<size_t>(result);
+	}
+#elif defined(SOCKET_USE_SENDMMSG)
+	uv_os_fd_t fd;
+	if (uv_fileno(reinterpret_cast<uv_handle_t*>(handle), &fd) != 0) {
+		return 0;
+	}
+
+	iovec payload{batch.payload.data(), batch.payload.length()};
+	mmsghdr messages[kMaxBatchSend];
+
+	while (sent < total) {
+		size_t count = total - sent < kMaxBatchSend ? total - sent : kMaxBatchSend;
+		for (size_t i = 0; i < count; ++i) {
+			sockaddr_storage& destination = batch.destinations[sent + i];
+			messages[i] = {};
+			messages[i].msg_hdr.msg_name = &destination;
+			messages[i].msg_hdr.msg_namelen = AddressLength(destination);
+			messages[i].msg_hdr.msg_iov = &payload;
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int result;
+		do {
+			result = sendmmsg(fd, messages, static_cast<unsigned int>(count), 0);
+		} while (result < 0 && errno == EINTR);
+
+		// EAGAIN and per-destination errors both leave the rest to the
+		// queued path, which reports errors through the callback
+		if (result <= 0) {
+			break;
+		}
+		sent += static_cast<size_t>(result);
+	}
+#endif
+
+	return sent;
+}
+
+void UdpSocket::OnBatchSend(uv_udp_send_t* request, int status) {
+	auto* pending = static_cast<PendingSends*>(request->data);
+	UdpSocket* socket = pending->socket;
+
+	if (status != 0 && status != UV_ECANCELED && !pending->errorReported && !socket->IsDeleted()) {
+		pending->errorReported = true;
+		g_CallbackManager.EnqueueError(socket, SocketError::SendError, uv_strerror(status));
+	}
+
+	if (--pending->outstanding == 0) {
+		delete pending;
+	}
+}
+
+#ifdef __linux__
+size_t UdpSocket::TrySendSegments(uv_udp_t* handle, SendRequest& request, const sockaddr_storage& destination, size_t segmentSize) {
+	// Keep order with sends already queued on the handle
+	if (m_gsoUnsupported || uv_udp_get_send_queue_count(handle) > 0) {
+		return 0;
+	}
+
+	size_t segmentsPerCall = kMaxGsoBytes / segmentSize;
+	if (segmentsPerCall > kMaxGsoSegments) {
+		segmentsPerCall = kMaxGsoSegments;
+	}
+	if (segmentsPerCall < 2) {
+		return 0;
+	}
+
+	uv_os_fd_t fd;
+	if (uv_fileno(reinterpret_cast<uv_handle_t*>(handle), &fd) != 0) {
+		return 0;
+	}
+
+	uint16_t segment = static_cast<uint16_t>(segmentSize);
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(segment))];
+	size_t sent = 0;
+
+	while (sent < request.length) {
+		size_t remaining = request.length - sent;
+		size_t length = remaining < segmentsPerCall * segmentSize ? remaining : segmentsPerCall * segmentSize;
+
+		iovec payload{request.data + sent, length};
+		msghdr message{};
+		message.msg_name = const_cast<sockaddr_storage*>(&destination);
+		message.msg_namelen = destination.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+		message.msg_iov = &payload;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+
+		cmsghdr* header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = IPPROTO_UDP;
+		header->cmsg_type = UDP_SEGMENT;
+		header->cmsg_len = CMSG_LEN(sizeof(segment));
+		std::memcpy(CMSG_DATA(header), &segment, sizeof(segment));
+
+		ssize_t result;
+		do {
+			result = sendmsg(fd, &message, 0);
+		} while (result < 0 && errno == EINTR);
+
+		if (result < 0) {
+			// Kernels without UDP_SEGMENT reject the cmsg, and devices without
+			// checksum offload fail with EIO; either way stop trying
+			if (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+				m_gsoUnsupported = true;
+			}
+			break;
+		}
+		sent += length;
+	}
+
+	return sent;
+}
+
+bool UdpSocket::StartGroReceiving(uv_udp_t* handle) {
+	if (m_groPoll.load(std::memory_order_acquire)) {
+		return true;
+	}
+
+	uv_os_fd_t fd;
+	if (uv_fileno(reinterpret_cast<uv_handle_t*>(handle), &fd) != 0) {
+		return false;
+	}
+
+	int enable = 1;
+	if (setsockopt(fd, IPPROTO_UDP, UDP_GRO, &enable, sizeof(enable)) != 0) {
+		return false;
+	}
+
+	// libuv does not pass control messages to uv_udp_recv_cb, so reading
+	// happens through a poll handle on a second descriptor for the socket
+	int pollFd = dup(fd);
+	auto* poll = pollFd >= 0 ? new (std::nothrow) uv_poll_t : nullptr;
+	if (!poll || uv_poll_init(GetEventLoop().GetLoop(), poll, pollFd) != 0) {
+		delete poll;
+		if (pollFd >= 0) close(pollFd);
+		enable = 0;
+		setsockopt(fd, IPPROTO_UDP, UDP_GRO, &enable, sizeof(enable));
+		return false;
+	}
+
+	poll->data = this;
+	m_groPoll.store(poll, std::memory_order_release);
+	uv_poll_start(poll, UV_READABLE, OnGroReadable);
+	return true;
+}
+
+void UdpSocket::OnGroReadable(uv_poll_t* poll, int status, int events) {
+	auto* socket = static_cast<UdpSocket*>(poll->data);
+
+	if (socket->IsDeleted()) return;
+
+	if (status < 0) {
+		g_CallbackManager.EnqueueError(socket, SocketError::RecvError, uv_strerror(status));
+		return;
+	}
+
+	uv_os_fd_t fd;
+	if (uv_fileno(reinterpret_cast<uv_handle_t*>(poll), &fd) != 0) return;
+
+	BufferPool& pool = GetReceivePools().datagram;
+	for (int i = 0; i < kMaxGroReads; ++i) {
+		PooledBuffer* slab = pool.Acquire();
+		if (!slab) return;
+
+		sockaddr_storage senderAddress{};
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+		iovec payload{slab->Data(), pool.GetSlabSize()};
+
+		msghdr message{};
+		message.msg_name = &senderAddress;
+		message.msg_namelen = sizeof(senderAddress);
+		message.msg_iov = &payload;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+
+		ssize_t bytesRead;
+		do {
+			bytesRead = recvmsg(fd, &message, 0);
+		} while (bytesRead < 0 && errno == EINTR);
+
+		if (bytesRead <= 0) {
+			slab->Release();
+			if (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				g_CallbackManager.EnqueueError(socket, SocketError::RecvError, uv_strerror(uv_translate_sys_error(errno)));
+			}
+			return;
+		}
+
+		size_t segmentSize = 0;
+		for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+			if (header->cmsg_level == IPPROTO_UDP && header->cmsg_type == UDP_GRO) {
+				int size;
+				std::memcpy(&size, CMSG_DATA(header), sizeof(size));
+				segmentSize = size > 0 ? static_cast<size_t>(size) : 0;
+			}
+		}
+
+		RemoteEndpoint sender = ExtractEndpoint(reinterpret_cast<sockaddr*>(&senderAddress));
+		char* data = slab->Data();
+		size_t length = static_cast<size_t>(bytesRead);
+
+		// Split the coalesced buffer back into its datagrams. All but the last
+		// are copied out, since terminating one in place would overwrite the
+		// first byte of the next.
+		if (segmentSize > 0) {
+			while (length > segmentSize) {
+				if (PooledBuffer* copy = CopyDatagram(data, segmentSize)) {
+					g_CallbackManager.EnqueueReceive(socket, copy, copy->Data(), segmentSize, sender);
+				}
+				data += segmentSize;
+				length -= segmentSize;
+			}
+		}
+
+		CompactDatagram(slab, data, length);
+		g_CallbackManager.EnqueueReceive(socket, slab, data, length, sender);
+	}
+}
+#endif
+
+void UdpSocket::CloseGroPoll(uv_poll_t* poll) {
+#ifdef __linux__
+	uv_os_fd_t fd;
+	bool haveFd = uv_fileno(reinterpret_cast<uv_handle_t*>(poll), &fd) == 0;
+
+	// Closing the poll handle stops watching the descriptor right away
+	uv_close(reinterpret_cast<uv_handle_t*>(poll), [](uv_handle_t* handle) {
+		delete reinterpret_cast<uv_poll_t*>(handle);
+	});
+
+	if (haveFd) {
+		close(fd);
+	}
+#endif
+}
+
 void UdpSocket::OnSend(uv_udp_send_t* request, int status) {
-	auto* context = static_cast<UdpSendContext*>(request->data);
-	auto* socket = context->socket;
+	auto* sendRequest = static_cast<SendRequest*>(request->data);
+	auto* socket = sendRequest->socket;
 
 	if (!socket->IsDeleted() && status != 0 && status != UV_ECANCELED) {
 		g_CallbackManager.EnqueueError(socket, SocketError::SendError, uv_strerror(status));
 	}
 
-	delete context;
+	sendRequest->Release();
 }
 
 void UdpSocket::StartReceiving() {
 	uv_udp_t* socket = m_socket.load(std::memory_order_acquire);
 	if (!socket) return;
 
+#ifdef __linux__
+	// Falls back to regular reads where the kernel has no UDP_GRO
+	if (GetOption(SocketOption::UdpGro) && StartGroReceiving(socket)) {
+		return;
+	}
+#endif
+
 	uv_udp_recv_start(socket, OnAllocBuffer, OnRecv);
 }
 
 void UdpSocket::OnAllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer) {
-	auto* socket = static_cast<UdpSocket*>(handle->data);
-	buffer->base = socket->m_recvBuffer;
-	buffer->len = kRecvBufferSize;
+	ReceivePools& pools = GetReceivePools();
+	BufferPool& pool = uv_udp_using_recvmmsg(reinterpret_cast<uv_udp_t*>(handle))
+		? pools.datagramBatch
+		: pools.datagram;
+
+	PooledBuffer* slab = pool.Acquire();
+	if (!slab) {
+		*buffer = uv_buf_init(nullptr, 0);
+		return;
+	}
+	*buffer = uv_buf_init(slab->Data(), static_cast<unsigned int>(pool.GetSlabSize()));
+}
+
+PooledBuffer* UdpSocket::CopyDatagram(const char* data, size_t length) {
+	ReceivePools& pools = GetReceivePools();
+	BufferPool& pool = length <= pools.smallDatagram.GetSlabSize()
+		? pools.smallDatagram
+		: pools.datagram;
+
+	PooledBuffer* slab = pool.Acquire();
+	if (slab) {
+		std::memcpy(slab->Data(), data, length);
+	}
+	return slab;
+}
+
+void UdpSocket::CompactDatagram(PooledBuffer*& slab, char*& data, size_t length) {
+	// Backpressure counts payload bytes, so a flood of small datagrams
+	// would otherwise pin a full slab each until their callbacks run
+	if (length > GetReceivePools().smallDatagram.GetSlabSize()) return;
+
+	PooledBuffer* copy = CopyDatagram(data, length);
+	if (!copy) return;
+
+	slab->Release();
+	slab = copy;
+	data = copy->Data();
 }
 
 void UdpSocket::OnRecv(uv_udp_t* handle, ssize_t bytesRead, const uv_buf_t* buffer,
 					   const struct sockaddr* senderAddress, unsigned flags) {
 	auto* socket = static_cast<UdpSocket*>(handle->data);
 
+	// One datagram out of a recvmmsg batch. The batch buffer goes back to
+	// its pool in the UV_UDP_MMSG_FREE call that follows, so the datagram is
+	// copied out rather than pinning the whole buffer until it is consumed.
+	if (flags & UV_UDP_MMSG_CHUNK) {
+		if (socket->IsDeleted() || bytesRead <= 0) return;
+
+		PooledBuffer* copy = CopyDatagram(buffer->base, static_cast<size_t>(bytesRead));
+		if (!copy) return;
+
+		RemoteEndpoint sender = ExtractEndpoint(senderAddress);
+		g_CallbackManager.EnqueueReceive(socket, copy, copy->Data(), bytesRead, sender);
+		return;
+	}
+
+	PooledBuffer* slab = PooledBuffer::FromData(buffer->base);
+
 	if (socket->IsDeleted()) {
+		if (slab) slab->Release();
 		return;
 	}
 
-	if (bytesRead > 0) {
+	if (bytesRead > 0 && slab) {
+		char* data = buffer->base;
+		CompactDatagram(slab, data, static_cast<size_t>(bytesRead));
+
 		RemoteEndpoint sender = ExtractEndpoint(senderAddress);
-		g_CallbackManager.EnqueueReceive(socket, buffer->base, bytesRead, sender);
-	} else if (bytesRead < 0) {
+		g_CallbackManager.EnqueueReceive(socket, slab, data, bytesRead, sender);
+		return;
+	}
+
+	if (slab) slab->Release();
+
+	if (bytesRead < 0) {
 		if (bytesRead == UV_EOF) {
 			g_CallbackManager.EnqueueDisconnect(socket);
 		} else if (bytesRead != UV_ECANCELED) {
@@ -363,7 +937,7 @@ bool UdpSocket::SetOption(SocketOption option, int value) {
 	// Store in atomic array for immediate reads
 	StoreOption(option, value);
 
-	if (option == SocketOption::AutoFreeHandle) {
+	if (IsExtensionOption(option)) {
 		return true;
 	}
 
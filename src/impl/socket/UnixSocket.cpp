@@ -4,36 +4,55 @@
 #include "core/EventLoop.h"
 #include "core/CallbackManager.h"
 #include "core/SocketManager.h"
+#include "core/BufferPool.h"
 #include <cstring>
 #include <atomic>
 
-struct UnixWriteContext {
-	uv_write_t writeRequest;
-	std::unique_ptr<char[]> buffer;
-	size_t length;
-	UnixSocket* socket;
-};
-
 UnixSocket::UnixSocket() : SocketBase(SocketType::Unix) {}
 
 UnixSocket::~UnixSocket() {
-	Disconnect();
+	// Jobs still queued see the socket deleted, so the handles go to a job
+	// that does not touch the socket
+	uv_pipe_t* pipeToClose = m_pipe.exchange(nullptr, std::memory_order_acq_rel);
+	uv_pipe_t* acceptorToClose = m_acceptor.exchange(nullptr, std::memory_order_acq_rel);
+	StreamWriter* writerToClose = m_writer.exchange(nullptr, std::memory_order_acq_rel);
+
+	if (pipeToClose || acceptorToClose) {
+		GetEventLoop().Post([pipeToClose, acceptorToClose, writerToClose]() {
+			ClosePipe(pipeToClose, writerToClose);
+			CloseAcceptor(acceptorToClose);
+		});
+	}
 }
 
 void UnixSocket::InitPipe() {
 	uv_pipe_t* expected = nullptr;
-	uv_pipe_t* newPipe = new uv_pipe_t;
-	uv_pipe_init(g_EventLoop.GetLoop(), newPipe, 0);
-	newPipe->data = this;
+	uv_pipe_t* newPipe = NewStream(GetEventLoop().GetLoop(), GetEventQueue());
 
 	if (!m_pipe.compare_exchange_strong(expected, newPipe,
 		std::memory_order_release, std::memory_order_acquire)) {
-		uv_close(reinterpret_cast<uv_handle_t*>(newPipe), OnClose);
+		uv_close(reinterpret_cast<uv_handle_t*>(newPipe), OnStreamClose);
 	}
 }
 
+uv_pipe_t* UnixSocket::NewStream(uv_loop_t* loop, std::shared_ptr<SocketEventQueue> events) {
+	auto* stream = new Stream{};
+	stream->events = std::move(events);
+	uv_pipe_init(loop, &stream->pipe, 0);
+	stream->pipe.data = stream;
+	return &stream->pipe;
+}
+
+UnixSocket* UnixSocket::FromStream(uv_handle_t* handle) {
+	const SocketEventQueue* events = static_cast<Stream*>(handle->data)->events.get();
+	if (!events || events->detached.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+	return static_cast<UnixSocket*>(events->owner);
+}
+
 bool UnixSocket::IsOpen() const {
-	return m_pipe.load(std::memory_order_acquire) != nullptr ||
+	return (!m_closing.load(std::memory_order_acquire) && m_pipe.load(std::memory_order_acquire) != nullptr) ||
 	       m_acceptor.load(std::memory_order_acquire) != nullptr;
 }
 
@@ -46,8 +65,10 @@ bool UnixSocket::Bind(const char* path, uint16_t port, bool async) {
 
 bool UnixSocket::Connect(const char* path, uint16_t port, bool async) {
 	m_path = path;
+	// Reconnecting after Disconnect(), whose job runs before this one
+	m_closing.store(false, std::memory_order_release);
 
-	g_EventLoop.Post([this]() {
+	GetEventLoop().Post([this]() {
 		if (IsDeleted()) return;
 
 		if (m_pipe.load(std::memory_order_acquire) == nullptr) {
@@ -83,29 +104,50 @@ void UnixSocket::OnConnect(uv_connect_t* request, int status) {
 }
 
 bool UnixSocket::Disconnect() {
-	uv_pipe_t* pipeToClose = m_pipe.exchange(nullptr, std::memory_order_acq_rel);
 	uv_pipe_t* acceptorToClose = m_acceptor.exchange(nullptr, std::memory_order_acq_rel);
-
-	if (pipeToClose) {
-		g_EventLoop.Post([pipeToClose]() {
-			if (!uv_is_closing(reinterpret_cast<uv_handle_t*>(pipeToClose))) {
-				uv_read_stop(reinterpret_cast<uv_stream_t*>(pipeToClose));
-				uv_close(reinterpret_cast<uv_handle_t*>(pipeToClose), OnClose);
-			}
+	if (acceptorToClose) {
+		GetEventLoop().Post([acceptorToClose]() {
+			CloseAcceptor(acceptorToClose);
 		});
 	}
 
-	if (acceptorToClose) {
-		g_EventLoop.Post([acceptorToClose]() {
-			if (!uv_is_closing(reinterpret_cast<uv_handle_t*>(acceptorToClose))) {
-				uv_close(reinterpret_cast<uv_handle_t*>(acceptorToClose), OnClose);
-			}
-		});
+	if (m_closing.exchange(true, std::memory_order_acq_rel)) {
+		return true;
 	}
 
+	// The pipe is taken on the UV thread, after the jobs of earlier sends,
+	// so those are written ahead of the FIN
+	GetEventLoop().Post([this, events = GetEventQueue()]() {
+		if (events->detached.load(std::memory_order_acquire)) {
+			// The destructor closed the handles
+			return;
+		}
+
+		uv_pipe_t* pipeToClose = m_pipe.exchange(nullptr, std::memory_order_acq_rel);
+		StreamWriter* writerToClose = m_writer.exchange(nullptr, std::memory_order_acq_rel);
+		ClosePipe(pipeToClose, writerToClose);
+	});
+
 	return true;
 }
 
+void UnixSocket::ClosePipe(uv_pipe_t* pipe, StreamWriter* writer) {
+	// Queued sends go out ahead of the FIN
+	if (writer) {
+		writer->Close();
+	}
+	if (pipe && !uv_is_closing(reinterpret_cast<uv_handle_t*>(pipe))) {
+		uv_read_stop(reinterpret_cast<uv_stream_t*>(pipe));
+		uv_close(reinterpret_cast<uv_handle_t*>(pipe), OnStreamClose);
+	}
+}
+
+void UnixSocket::CloseAcceptor(uv_pipe_t* acceptor) {
+	if (acceptor && !uv_is_closing(reinterpret_cast<uv_handle_t*>(acceptor))) {
+		uv_close(reinterpret_cast<uv_handle_t*>(acceptor), OnClose);
+	}
+}
+
 bool UnixSocket::CloseReset() {
 	return Disconnect();
 }
@@ -115,12 +157,12 @@ bool UnixSocket::Listen() {
 		return false;
 	}
 
-	g_EventLoop.Post([this]() {
+	GetEventLoop().Post([this]() {
 		if (IsDeleted()) return;
 
 		uv_pipe_t* expected = nullptr;
 		uv_pipe_t* acceptor = new uv_pipe_t;
-		uv_pipe_init(g_EventLoop.GetLoop(), acceptor, 0);
+		uv_pipe_init(GetEventLoop().GetLoop(), acceptor, 0);
 		acceptor->data = this;
 
 		if (!m_acceptor.compare_exchange_strong(expected, acceptor,
@@ -163,62 +205,78 @@ void UnixSocket::OnConnection(uv_stream_t* server, int status) {
 		return;
 	}
 
-	uv_pipe_t* client = new uv_pipe_t;
-	uv_pipe_init(g_EventLoop.GetLoop(), client, 0);
+	uv_pipe_t* client = NewStream(socket->GetEventLoop().GetLoop(), nullptr);
 
 	if (uv_accept(server, reinterpret_cast<uv_stream_t*>(client)) == 0) {
-		UnixSocket* newSocket = CreateFromAccepted(client, socket->m_path);
+		UnixSocket* newSocket = CreateFromAccepted(client, socket->m_path, socket->GetEventLoop());
 		if (newSocket) {
+			newSocket->StoreOption(SocketOption::DirectDispatch, socket->GetOption(SocketOption::DirectDispatch));
+			// Keep its events back until the Incoming callback gave it a handle
+			newSocket->GetEventQueue()->held.store(true, std::memory_order_release);
 			RemoteEndpoint remoteEndpoint;
 			remoteEndpoint.address = socket->m_path;
 			g_CallbackManager.EnqueueIncoming(socket, newSocket, remoteEndpoint);
 			newSocket->StartReading();
 		}
 	} else {
-		uv_close(reinterpret_cast<uv_handle_t*>(client), OnClose);
+		uv_close(reinterpret_cast<uv_handle_t*>(client), OnStreamClose);
 	}
 }
 
-UnixSocket* UnixSocket::CreateFromAccepted(uv_pipe_t* clientHandle, const std::string& path) {
-	auto* socket = g_SocketManager.CreateSocket<UnixSocket>();
+UnixSocket* UnixSocket::CreateFromAccepted(uv_pipe_t* clientHandle, const std::string& path, EventLoop& loop) {
+	auto* socket = g_SocketManager.CreateSocket<UnixSocket>(&loop);
 	socket->m_path = path;
+	static_cast<Stream*>(clientHandle->data)->events = socket->GetEventQueue();
 	socket->m_pipe.store(clientHandle, std::memory_order_release);
-	clientHandle->data = socket;
 	return socket;
 }
 
 bool UnixSocket::Send(std::string_view data, bool async) {
 	uv_pipe_t* pipe = m_pipe.load(std::memory_order_acquire);
-	if (!pipe) return false;
-
-	auto* context = new UnixWriteContext;
-	context->buffer = std::make_unique<char[]>(data.length());
-	std::memcpy(context->buffer.get(), data.data(), data.length());
-	context->length = data.length();
-	context->socket = this;
-	context->writeRequest.data = context;
-
-	g_EventLoop.Post([this, context]() {
-		if (IsDeleted()) {
-			delete context;
+	if (!pipe || m_closing.load(std::memory_order_acquire)) return false;
+
+	SendRequest* request = GetEventLoop().GetSendPool().Acquire(this, data);
+	if (!request) {
+		return false;
+	}
+
+	bool posted = GetEventLoop().Post([this, request]() {
+		// The request keeps the event queue alive, the socket may be gone
+		if (request->backlog->detached.load(std::memory_order_acquire)) {
+			request->Release();
 			return;
 		}
 
 		uv_pipe_t* pipe = m_pipe.load(std::memory_order_acquire);
 		if (!pipe) {
-			delete context;
+			request->Release();
 			return;
 		}
 
-		uv_buf_t uvBuffer = uv_buf_init(context->buffer.get(), static_cast<unsigned int>(context->length));
-		int result = uv_write(&context->writeRequest, reinterpret_cast<uv_stream_t*>(pipe), &uvBuffer, 1, OnWrite);
+		StreamWriter* writer = StreamWriter::Attach(m_writer, reinterpret_cast<uv_stream_t*>(pipe));
+		if (!writer) {
+			g_CallbackManager.EnqueueError(this, SocketError::SendError, "Out of memory");
+			request->Release();
+			return;
+		}
 
-		if (result != 0) {
-			g_CallbackManager.EnqueueError(this, SocketError::SendError, uv_strerror(result));
-			delete context;
+		// The destructor may have taken the handle while the writer was created
+		if (m_pipe.load(std::memory_order_acquire) != pipe) {
+			if (StreamWriter* stale = m_writer.exchange(nullptr, std::memory_order_acq_rel)) {
+				stale->Discard();
+			}
+			request->Release();
+			return;
 		}
+
+		writer->Queue(request, GetOption(SocketOption::CorkWindow));
 	});
 
+	if (!posted) {
+		request->Release();
+		return false;
+	}
+
 	return true;
 }
 
@@ -227,17 +285,6 @@ bool UnixSocket::SendTo(std::string_view data, const char* hostname, uint16_t po
 	return Send(data, async);
 }
 
-void UnixSocket::OnWrite(uv_write_t* request, int status) {
-	auto* context = static_cast<UnixWriteContext*>(request->data);
-	auto* socket = context->socket;
-
-	if (!socket->IsDeleted() && status != 0 && status != UV_ECANCELED) {
-		g_CallbackManager.EnqueueError(socket, SocketError::SendError, uv_strerror(status));
-	}
-
-	delete context;
-}
-
 void UnixSocket::StartReading() {
 	uv_pipe_t* pipe = m_pipe.load(std::memory_order_acquire);
 	if (!pipe) return;
@@ -245,22 +292,69 @@ void UnixSocket::StartReading() {
 	uv_read_start(reinterpret_cast<uv_stream_t*>(pipe), OnAllocBuffer, OnRead);
 }
 
+void UnixSocket::ResumeReceiving() {
+	GetEventLoop().Post([this]() {
+		if (IsDeleted()) return;
+		StartReading();
+	});
+}
+
+bool UnixSocket::SetFrameDelimiter(std::string_view delimiter) {
+	if (delimiter.empty() || delimiter.size() > StreamFramer::kMaxDelimiterLength) {
+		return false;
+	}
+
+	// Pack the delimiter into the job so it needs no allocation
+	uint64_t packed = 0;
+	std::memcpy(&packed, delimiter.data(), delimiter.size());
+	size_t length = delimiter.size();
+
+	return GetEventLoop().Post([this, packed, length]() {
+		if (IsDeleted()) return;
+		m_framer.SetDelimiter(reinterpret_cast<const char*>(&packed), length);
+	});
+}
+
 void UnixSocket::OnAllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer) {
-	auto* socket = static_cast<UnixSocket*>(handle->data);
-	buffer->base = socket->m_recvBuffer;
-	buffer->len = kRecvBufferSize;
+	UnixSocket* socket = FromStream(handle);
+	if (!socket) {
+		*buffer = uv_buf_init(nullptr, 0);
+		return;
+	}
+
+	size_t length;
+	PooledBuffer* slab = socket->m_receiveSizer.Acquire(socket->GetOption(SocketOption::ReceiveChunkSize), length);
+	if (!slab) {
+		*buffer = uv_buf_init(nullptr, 0);
+		return;
+	}
+	*buffer = uv_buf_init(slab->Data(), static_cast<unsigned int>(length));
 }
 
 void UnixSocket::OnRead(uv_stream_t* stream, ssize_t bytesRead, const uv_buf_t* buffer) {
-	auto* socket = static_cast<UnixSocket*>(stream->data);
+	UnixSocket* socket = FromStream(reinterpret_cast<uv_handle_t*>(stream));
+	PooledBuffer* slab = PooledBuffer::FromData(buffer->base);
 
-	if (socket->IsDeleted()) {
+	if (!socket) {
+		if (slab) slab->Release();
 		return;
 	}
 
 	if (bytesRead > 0) {
-		g_CallbackManager.EnqueueReceive(socket, buffer->base, bytesRead);
-	} else if (bytesRead < 0) {
+		socket->m_receiveSizer.Record(static_cast<size_t>(bytesRead), buffer->len);
+		if (!socket->m_framer.Consume(socket, slab, buffer->base, static_cast<size_t>(bytesRead), RemoteEndpoint{})) {
+			uv_read_stop(stream);
+			return;
+		}
+		if (g_CallbackManager.PauseIfBacklogged(socket)) {
+			uv_read_stop(stream);
+		}
+		return;
+	}
+
+	if (slab) slab->Release();
+
+	if (bytesRead < 0) {
 		if (bytesRead == UV_EOF) {
 			g_CallbackManager.EnqueueDisconnect(socket);
 		} else if (bytesRead != UV_ECANCELED) {
@@ -280,4 +374,8 @@ void UnixSocket::OnClose(uv_handle_t* handle) {
 	}
 }
 
+void UnixSocket::OnStreamClose(uv_handle_t* handle) {
+	delete static_cast<Stream*>(handle->data);
+}
+
 #endif // _WIN32
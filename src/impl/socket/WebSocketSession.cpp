@@ -0,0 +1,615 @@
+#include "socket/WebSocketSession.h"
+#include "socket/TcpSocket.h"
+#include "core/CallbackManager.h"
+#include "core/BufferPool.h"
+#include "core/SendRequest.h"
+#include "core/HttpHeaders.h"
+#include <cstring>
+
+static constexpr char kAcceptGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+// Upgrade requests and responses larger than this are rejected
+static constexpr size_t kMaxHandshakeSize = 8192;
+
+static constexpr uint16_t kCloseProtocolError = 1002;
+static constexpr uint16_t kCloseTooBig = 1009;
+
+// xorshift64*, seeded per thread. Masking keys only need to be
+// unpredictable to intermediaries, not cryptographically strong.
+static uint32_t RandomWord() {
+	thread_local uint64_t state = 0;
+	if (state == 0) {
+		state = uv_hrtime() ^ reinterpret_cast<uintptr_t>(&state) ^ 0x9E3779B97F4A7C15ull;
+		if (state == 0) state = 1;
+	}
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return static_cast<uint32_t>((state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// XOR data with the masking key, starting at key byte offset % 4. Works a
+// word at a time; the loop has no dependencies between iterations, so
+// compilers turn it into SIMD where the target has it.
+static void ApplyMask(char* data, size_t length, const uint8_t mask[4], uint64_t offset) {
+	uint8_t key[8];
+	for (size_t i = 0; i < 8; ++i) {
+		key[i] = mask[(offset + i) & 3];
+	}
+
+	uint64_t wide;
+	std::memcpy(&wide, key, sizeof(wide));
+
+	size_t i = 0;
+	for (; i + sizeof(wide) <= length; i += sizeof(wide)) {
+		uint64_t word;
+		std::memcpy(&word, data + i, sizeof(word));
+		word ^= wide;
+		std::memcpy(data + i, &word, sizeof(word));
+	}
+	for (; i < length; ++i) {
+		data[i] = static_cast<char>(data[i] ^ key[i & 7]);
+	}
+}
+
+static uint32_t RotateLeft(uint32_t value, int bits) {
+	return (value << bits) | (value >> (32 - bits));
+}
+
+static void Sha1(const char* data, size_t length, uint8_t digest[20]) {
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+	// Message, 0x80, zero padding and the 64-bit bit length, in 64 byte blocks
+	const size_t total = ((length + 8) / 64 + 1) * 64;
+	std::string message(data, length);
+	message.resize(total, '\0');
+	message[length] = static_cast<char>(0x80);
+	const uint64_t bits = static_cast<uint64_t>(length) * 8;
+	for (size_t i = 0; i < 8; ++i) {
+		message[total - 1 - i] = static_cast<char>(bits >> (i * 8));
+	}
+
+	for (size_t block = 0; block < total; block += 64) {
+		const auto* bytes = reinterpret_cast<const uint8_t*>(message.data() + block);
+
+		uint32_t w[80];
+		for (size_t i = 0; i < 16; ++i) {
+			w[i] = (static_cast<uint32_t>(bytes[i * 4]) << 24) | (static_cast<uint32_t>(bytes[i * 4 + 1]) << 16) |
+			       (static_cast<uint32_t>(bytes[i * 4 + 2]) << 8) | static_cast<uint32_t>(bytes[i * 4 + 3]);
+		}
+		for (size_t i = 16; i < 80; ++i) {
+			w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (size_t i = 0; i < 80; ++i) {
+			uint32_t f, k;
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = RotateLeft(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	for (size_t i = 0; i < 5; ++i) {
+		digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+		digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+		digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+		digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+	}
+}
+
+static std::string Base64(const uint8_t* data, size_t length) {
+	static constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string out;
+	out.reserve((length + 2) / 3 * 4);
+	for (size_t i = 0; i < length; i += 3) {
+		uint32_t chunk = static_cast<uint32_t>(data[i]) << 16;
+		if (i + 1 < length) chunk |= static_cast<uint32_t>(data[i + 1]) << 8;
+		if (i + 2 < length) chunk |= data[i + 2];
+
+		out += kAlphabet[(chunk >> 18) & 0x3F];
+		out += kAlphabet[(chunk >> 12) & 0x3F];
+		out += i + 1 < length ? kAlphabet[(chunk >> 6) & 0x3F] : '=';
+		out += i + 2 < length ? kAlphabet[chunk & 0x3F] : '=';
+	}
+	return out;
+}
+
+static std::string ComputeAccept(std::string_view key) {
+	std::string input(key);
+	input += kAcceptGuid;
+
+	uint8_t digest[20];
+	Sha1(input.data(), input.size(), digest);
+	return Base64(digest, sizeof(digest));
+}
+
+WebSocketSession::WebSocketSession(Role role, std::string host, std::string path)
+	: m_role(role), m_host(std::move(host)), m_path(std::move(path)) {}
+
+WebSocketSession::~WebSocketSession() {
+	for (SendRequest* request : m_held) {
+		request->Release();
+	}
+}
+
+size_t WebSocketSession::FrameSize(size_t length, bool masked) {
+	size_t header = 2;
+	if (length > 0xFFFF) {
+		header += 8;
+	} else if (length >= 126) {
+		header += 2;
+	}
+	return header + (masked ? 4 : 0) + length;
+}
+
+void WebSocketSession::EncodeFrame(char* out, Opcode opcode, const char* payload, size_t length, bool masked) {
+	const uint8_t maskBit = masked ? 0x80 : 0;
+	size_t offset = 0;
+
+	out[offset++] = static_cast<char>(0x80 | opcode);
+	if (length < 126) {
+		out[offset++] = static_cast<char>(maskBit | length);
+	} else if (length <= 0xFFFF) {
+		out[offset++] = static_cast<char>(maskBit | 126);
+		out[offset++] = static_cast<char>(length >> 8);
+		out[offset++] = static_cast<char>(length);
+	} else {
+		out[offset++] = static_cast<char>(maskBit | 127);
+		for (int shift = 56; shift >= 0; shift -= 8) {
+			out[offset++] = static_cast<char>(static_cast<uint64_t>(length) >> shift);
+		}
+	}
+
+	if (masked) {
+		uint32_t key = RandomWord();
+		uint8_t mask[4];
+		std::memcpy(mask, &key, sizeof(mask));
+		std::memcpy(out + offset, mask, sizeof(mask));
+		offset += sizeof(mask);
+
+		if (length) {
+			std::memcpy(out + offset, payload, length);
+			ApplyMask(out + offset, length, mask, 0);
+		}
+	} else if (length) {
+		std::memcpy(out + offset, payload, length);
+	}
+}
+
+bool WebSocketSession::Start(TcpSocket* socket) {
+	uint8_t nonce[16];
+	for (size_t i = 0; i < sizeof(nonce); i += 4) {
+		uint32_t word = RandomWord();
+		std::memcpy(nonce + i, &word, 4);
+	}
+	std::string key = Base64(nonce, sizeof(nonce));
+	m_accept = ComputeAccept(key);
+
+	std::string request;
+	request.reserve(160 + m_path.size() + m_host.size());
+	request += "GET ";
+	request += m_path;
+	request += " HTTP/1.1\r\nHost: ";
+	request += m_host;
+	request += "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: ";
+	request += key;
+	request += "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+
+	return SendRaw(socket, request);
+}
+
+void WebSocketSession::Hold(SendRequest* request) {
+	if (m_state == State::Closed) {
+		request->Release();
+		return;
+	}
+	m_held.push_back(request);
+}
+
+bool WebSocketSession::ConsumeHandshake(TcpSocket* socket, const char* data, size_t length, size_t& consumed, const RemoteEndpoint& sender) {
+	const size_t previous = m_handshake.size();
+	m_handshake.append(data, length);
+
+	// The blank line may straddle the previous read
+	size_t end = m_handshake.find("\r\n\r\n", previous >= 3 ? previous - 3 : 0);
+	if (end == std::string::npos) {
+		if (m_handshake.size() > kMaxHandshakeSize) {
+			Fail(socket, 0, "WebSocket handshake too large");
+			return false;
+		}
+		consumed = length;
+		return true;
+	}
+
+	end += 4;
+	consumed = end - previous;
+
+	std::string head;
+	head.swap(m_handshake);
+	head.resize(end);
+
+	return m_role == Role::Server ? AcceptRequest(socket, head) : AcceptResponse(socket, head, sender);
+}
+
+bool WebSocketSession::AcceptRequest(TcpSocket* socket, std::string_view request) {
+	const char* error = nullptr;
+	std::string_view key = FindHeader(request, "Sec-WebSocket-Key");
+
+	if (request.substr(0, 4) != "GET ") {
+		error = "WebSocket handshake is not a GET request";
+	} else if (!HasHeaderToken(FindHeader(request, "Upgrade"), "websocket") ||
+	           !HasHeaderToken(FindHeader(request, "Connection"), "Upgrade")) {
+		error = "WebSocket handshake is missing the upgrade headers";
+	} else if (FindHeader(request, "Sec-WebSocket-Version") != "13") {
+		SendRaw(socket, "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nContent-Length: 0\r\n\r\n");
+		Fail(socket, 0, "Unsupported WebSocket version");
+		return false;
+	} else if (key.empty()) {
+		error = "WebSocket handshake is missing Sec-WebSocket-Key";
+	}
+
+	if (error) {
+		SendRaw(socket, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n");
+		Fail(socket, 0, error);
+		return false;
+	}
+
+	std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+	response += ComputeAccept(key);
+	response += "\r\n\r\n";
+
+	if (!SendRaw(socket, response)) {
+		Fail(socket, 0, "Out of memory");
+		return false;
+	}
+
+	Open(socket);
+	return true;
+}
+
+bool WebSocketSession::AcceptResponse(TcpSocket* socket, std::string_view response, const RemoteEndpoint& sender) {
+	const char* error = nullptr;
+
+	// "HTTP/1.1 101 Switching Protocols"
+	size_t space = response.find(' ');
+	if (space == std::string_view::npos || response.substr(space + 1, 4) != "101 ") {
+		error = "WebSocket server refused the upgrade";
+	} else if (!HasHeaderToken(FindHeader(response, "Upgrade"), "websocket") ||
+	           !HasHeaderToken(FindHeader(response, "Connection"), "Upgrade")) {
+		error = "WebSocket response is missing the upgrade headers";
+	} else if (FindHeader(response, "Sec-WebSocket-Accept") != m_accept) {
+		error = "WebSocket server sent a wrong Sec-WebSocket-Accept";
+	}
+
+	if (error) {
+		m_state = State::Closed;
+		g_CallbackManager.EnqueueError(socket, SocketError::ConnectError, error);
+		return false;
+	}
+
+	g_CallbackManager.EnqueueConnect(socket, sender);
+	Open(socket);
+	return true;
+}
+
+void WebSocketSession::Open(TcpSocket* socket) {
+	m_state = State::Open;
+	m_accept.clear();
+	m_accept.shrink_to_fit();
+	socket->m_webSocketOpen.store(true, std::memory_order_release);
+
+	for (SendRequest* request : m_held) {
+		socket->Write(request);
+	}
+	m_held.clear();
+	m_held.shrink_to_fit();
+}
+
+bool WebSocketSession::Consume(TcpSocket* socket, PooledBuffer* slab, char* data, size_t length, const RemoteEndpoint& sender) {
+	size_t position = 0;
+
+	if (m_state == State::Handshaking) {
+		if (!ConsumeHandshake(socket, data, length, position, sender)) {
+			slab->Release();
+			return false;
+		}
+	}
+
+	if (m_state == State::Closed) {
+		slab->Release();
+		return false;
+	}
+
+	int maxSize = socket->GetOption(SocketOption::FramingMaxSize);
+	const size_t maxMessageSize = maxSize > 0 ? static_cast<size_t>(maxSize) : kDefaultMaxMessageSize;
+
+	bool open = true;
+	while (open && position < length) {
+		if (!m_inPayload) {
+			// Two bytes, then as many more as they announce
+			while (position < length && m_headerLength < HeaderSize()) {
+				size_t take = HeaderSize() - m_headerLength;
+				if (take > length - position) take = length - position;
+				std::memcpy(m_header + m_headerLength, data + position, take);
+				m_headerLength = static_cast<uint8_t>(m_headerLength + take);
+				position += take;
+			}
+			if (m_headerLength < HeaderSize()) {
+				break;
+			}
+
+			// The pending message's following bytes are parsed, so the game
+			// thread may now terminate it in place
+			FlushPending(socket, slab, sender);
+
+			const char* error = nullptr;
+			uint16_t closeCode = kCloseProtocolError;
+			if (!ParseHeader(maxMessageSize, error, closeCode)) {
+				Fail(socket, closeCode, error);
+				open = false;
+				break;
+			}
+
+			m_headerLength = 0;
+			m_inPayload = true;
+			m_payloadReceived = 0;
+			if (m_payloadLength == 0) {
+				open = FinishFrame(socket, sender);
+			}
+			continue;
+		}
+
+		const size_t available = length - position;
+		const uint64_t remaining = m_payloadLength - m_payloadReceived;
+
+		// A whole unfragmented message within this read is unmasked and
+		// delivered in place
+		if (m_payloadReceived == 0 && remaining <= available && m_fin && m_opcode != Continuation && m_opcode < Close) {
+			char* payload = data + position;
+			if (m_masked) {
+				ApplyMask(payload, static_cast<size_t>(remaining), m_mask, 0);
+			}
+			m_pending = Pending{payload, static_cast<size_t>(remaining)};
+			m_hasPending = true;
+			m_messageOpcode = 0;
+			m_inPayload = false;
+			position += static_cast<size_t>(remaining);
+			continue;
+		}
+
+		size_t take = remaining < available ? static_cast<size_t>(remaining) : available;
+		char* destination;
+		if (m_opcode >= Close) {
+			destination = m_control + m_payloadReceived;
+		} else {
+			size_t used = m_message.size();
+			m_message.resize(used + take);
+			destination = m_message.data() + used;
+		}
+
+		std::memcpy(destination, data + position, take);
+		if (m_masked) {
+			ApplyMask(destination, take, m_mask, m_payloadReceived);
+		}
+		position += take;
+		m_payloadReceived += take;
+
+		if (m_payloadReceived == m_payloadLength) {
+			open = FinishFrame(socket, sender);
+		}
+	}
+
+	FlushPending(socket, slab, sender);
+	slab->Release();
+	return open;
+}
+
+size_t WebSocketSession::HeaderSize() const {
+	if (m_headerLength < 2) {
+		return 2;
+	}
+
+	const auto second = static_cast<uint8_t>(m_header[1]);
+	const uint8_t length = second & 0x7F;
+	return 2 + (length == 126 ? 2 : length == 127 ? 8 : 0) + (second & 0x80 ? 4 : 0);
+}
+
+bool WebSocketSession::ParseHeader(size_t maxMessageSize, const char*& error, uint16_t& closeCode) {
+	const auto first = static_cast<uint8_t>(m_header[0]);
+	const auto second = static_cast<uint8_t>(m_header[1]);
+
+	m_fin = (first & 0x80) != 0;
+	m_opcode = first & 0x0F;
+	m_masked = (second & 0x80) != 0;
+
+	// No extensions are negotiated, so the reserved bits must be clear
+	if (first & 0x70) {
+		error = "WebSocket frame has reserved bits set";
+		return false;
+	}
+
+	// Clients mask every frame, servers none
+	if (m_masked != (m_role == Role::Server)) {
+		error = m_masked ? "WebSocket server sent a masked frame" : "WebSocket client sent an unmasked frame";
+		return false;
+	}
+
+	size_t offset = 2;
+	uint64_t length = second & 0x7F;
+	if (length == 126) {
+		length = (static_cast<uint64_t>(static_cast<uint8_t>(m_header[2])) << 8) | static_cast<uint8_t>(m_header[3]);
+		offset = 4;
+	} else if (length == 127) {
+		length = 0;
+		for (size_t i = 0; i < 8; ++i) {
+			length = (length << 8) | static_cast<uint8_t>(m_header[2 + i]);
+		}
+		offset = 10;
+	}
+	m_payloadLength = length;
+
+	if (m_masked) {
+		std::memcpy(m_mask, m_header + offset, sizeof(m_mask));
+	}
+
+	switch (m_opcode) {
+		case Close:
+		case Ping:
+		case Pong: {
+			if (!m_fin || length > sizeof(m_control)) {
+				error = "WebSocket control frame is fragmented or too long";
+				return false;
+			}
+			return true;
+		}
+		case Text:
+		case Binary: {
+			if (m_messageOpcode != 0) {
+				error = "WebSocket message started inside a fragmented message";
+				return false;
+			}
+			m_messageOpcode = m_opcode;
+			break;
+		}
+		case Continuation: {
+			if (m_messageOpcode == 0) {
+				error = "WebSocket continuation frame without a message";
+				return false;
+			}
+			break;
+		}
+		default: {
+			error = "WebSocket frame has an unknown opcode";
+			return false;
+		}
+	}
+
+	if (m_message.size() > maxMessageSize || length > maxMessageSize - m_message.size()) {
+		error = "WebSocket message exceeds the maximum size";
+		closeCode = kCloseTooBig;
+		return false;
+	}
+
+	m_message.reserve(m_message.size() + static_cast<size_t>(length));
+	return true;
+}
+
+bool WebSocketSession::FinishFrame(TcpSocket* socket, const RemoteEndpoint& sender) {
+	m_inPayload = false;
+	const size_t length = static_cast<size_t>(m_payloadLength);
+
+	switch (m_opcode) {
+		case Ping: {
+			SendControl(socket, Pong, m_control, length);
+			return true;
+		}
+		case Pong: {
+			return true;
+		}
+		case Close: {
+			// Echo the status code and stop, the script decides when to close
+			if (!m_closeSent) {
+				SendControl(socket, Close, m_control, length >= 2 ? 2 : 0);
+			}
+			m_state = State::Closed;
+			socket->m_webSocketOpen.store(false, std::memory_order_release);
+			g_CallbackManager.EnqueueDisconnect(socket);
+			return false;
+		}
+		default: {
+			if (m_fin) {
+				EnqueueMessage(socket, sender);
+			}
+			return true;
+		}
+	}
+}
+
+void WebSocketSession::FlushPending(TcpSocket* socket, PooledBuffer* slab, const RemoteEndpoint& sender) {
+	if (!m_hasPending) {
+		return;
+	}
+
+	slab->Retain();
+	g_CallbackManager.EnqueueReceive(socket, slab, m_pending.data, m_pending.length, sender);
+	m_hasPending = false;
+}
+
+void WebSocketSession::EnqueueMessage(TcpSocket* socket, const RemoteEndpoint& sender) {
+	const size_t length = m_message.size();
+	PooledBuffer* buffer = AcquireBuffer(length);
+	if (buffer) {
+		if (length) {
+			std::memcpy(buffer->Data(), m_message.data(), length);
+		}
+		g_CallbackManager.EnqueueReceive(socket, buffer, buffer->Data(), length, sender);
+	} else {
+		g_CallbackManager.EnqueueError(socket, SocketError::RecvError, "Out of memory");
+	}
+
+	m_messageOpcode = 0;
+	m_message.clear();
+	// Don't let one large message pin its buffer
+	if (m_message.capacity() > kDefaultMaxMessageSize) {
+		std::vector<char>().swap(m_message);
+	}
+}
+
+bool WebSocketSession::SendControl(TcpSocket* socket, Opcode opcode, const char* payload, size_t length) {
+	const bool masked = m_role == Role::Client;
+	SendRequest* request = SendRequest::Create(socket, FrameSize(length, masked));
+	if (!request) {
+		return false;
+	}
+
+	EncodeFrame(request->data, opcode, payload, length, masked);
+	if (opcode == Close) {
+		m_closeSent = true;
+	}
+	return socket->Write(request);
+}
+
+bool WebSocketSession::SendRaw(TcpSocket* socket, std::string_view data) {
+	SendRequest* request = SendRequest::Create(socket, data.size());
+	if (!request) {
+		return false;
+	}
+
+	std::memcpy(request->data, data.data(), data.size());
+	return socket->Write(request);
+}
+
+void WebSocketSession::Fail(TcpSocket* socket, uint16_t closeCode, const char* error) {
+	if (m_state == State::Open && !m_closeSent && closeCode != 0) {
+		const char status[2] = {static_cast<char>(closeCode >> 8), static_cast<char>(closeCode)};
+		SendControl(socket, Close, status, sizeof(status));
+	}
+
+	m_state = State::Closed;
+	socket->m_webSocketOpen.store(false, std::memory_order_release);
+	m_message.clear();
+	g_CallbackManager.EnqueueError(socket, SocketError::RecvError, error);
+}
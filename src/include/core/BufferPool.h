@@ -0,0 +1,164 @@
+#pragma once
+
+#include "lockfree/FreeList.h"
+#include "socket/SocketTypes.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class BufferPool;
+
+/**
+ * Reference-counted receive slab.
+ *
+ * The header lives directly in front of the payload so a libuv uv_buf_t::base
+ * can be mapped back to its slab without a lookup. Every slab has one spare
+ * byte after its payload so the game thread can null-terminate in place.
+ */
+struct PooledBuffer {
+	std::atomic<uint32_t> refs{1};
+	BufferPool* pool = nullptr;   // nullptr for slabs freed on release
+	PooledBuffer* next = nullptr;
+
+	[[nodiscard]] char* Data() { return reinterpret_cast<char*>(this + 1); }
+
+	/**
+	 * Map a payload pointer handed to libuv back to its slab header.
+	 */
+	[[nodiscard]] static PooledBuffer* FromData(char* data) {
+		return data ? reinterpret_cast<PooledBuffer*>(data) - 1 : nullptr;
+	}
+
+	void Retain() { refs.fetch_add(1, std::memory_order_relaxed); }
+
+	/**
+	 * Drop one reference, returning the slab to its pool (or freeing an
+	 * unpooled one) on the last one.
+	 * Thread-safe, can be called from any thread.
+	 */
+	void Release();
+};
+
+/**
+ * Lock-free pool of fixed-size receive slabs.
+ *
+ * Thread model:
+ * - UV thread: acquires slabs in OnAllocBuffer (single consumer, so each
+ *   event loop has pools of its own, see ReceivePools)
+ * - Any thread: returns slabs via PooledBuffer::Release()
+ */
+class BufferPool {
+public:
+	BufferPool(size_t slabSize, size_t maxCached);
+	~BufferPool();
+
+	BufferPool(const BufferPool&) = delete;
+	BufferPool& operator=(const BufferPool&) = delete;
+
+	/**
+	 * Get a slab with a reference count of 1.
+	 * Must be called from the UV thread.
+	 *
+	 * @return Slab or nullptr if allocation failed
+	 */
+	[[nodiscard]] PooledBuffer* Acquire();
+
+	/**
+	 * Usable payload size of each slab (excludes the terminator byte).
+	 */
+	[[nodiscard]] size_t GetSlabSize() const { return m_slabSize; }
+
+	[[nodiscard]] uint64_t GetHits() const { return m_hits.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t GetMisses() const { return m_misses.load(std::memory_order_relaxed); }
+
+private:
+	friend struct PooledBuffer;
+
+	void Recycle(PooledBuffer* buffer);
+	static void Free(PooledBuffer* buffer);
+
+	const size_t m_slabSize;
+	FreeList<PooledBuffer, &PooledBuffer::next> m_freeList;
+
+	std::atomic<uint64_t> m_hits{0};
+	std::atomic<uint64_t> m_misses{0};
+};
+
+// Receive slab size classes for stream sockets (TCP/Unix), smallest first
+constexpr size_t kStreamSizeClasses = 4;
+constexpr size_t kDefaultStreamSizeClass = 2;
+
+/**
+ * Receive slab pools of one event loop.
+ * Slabs are only cached once used, so loops that never run cost nothing.
+ */
+struct ReceivePools {
+	BufferPool stream[kStreamSizeClasses] = {
+		{2048, 512},
+		{8192, 256},
+		{16384, 256},
+		{65536, 32},
+	};
+	// Receive slabs for datagram sockets (UDP datagrams can be up to 65535 bytes)
+	BufferPool datagram{65536, 64};
+	// recvmmsg buffers, libuv splits them into one 64 KiB slot per datagram.
+	// A batch buffer is returned as soon as libuv has delivered its
+	// datagrams, so only a couple are ever live.
+	BufferPool datagramBatch{16 * 65536, 2};
+	// Slabs for datagrams copied out of a recvmmsg buffer that fit in 2 KiB
+	BufferPool smallDatagram{2048, 1024};
+
+	// Totals over every pool above, for the stats
+	[[nodiscard]] uint64_t GetHits() const;
+	[[nodiscard]] uint64_t GetMisses() const;
+};
+
+// Indexed by EventLoop::GetIndex()
+extern ReceivePools g_ReceivePools[kMaxEventLoops];
+
+/**
+ * Pools of the event loop running on the calling thread.
+ * Must be called from a UV thread.
+ */
+[[nodiscard]] ReceivePools& GetReceivePools();
+
+/**
+ * Get a slab with room for length bytes from the smallest stream size class
+ * that fits, or an unpooled slab if none does.
+ * Must be called from a UV thread.
+ *
+ * @return Slab or nullptr if allocation failed
+ */
+[[nodiscard]] PooledBuffer* AcquireBuffer(size_t length);
+
+/**
+ * Chooses the receive slab size for one stream socket.
+ *
+ * ReceiveChunkSize > 0 uses the smallest size class that holds it and reads
+ * at most that many bytes at a time; 0 uses the 16 KiB default. Adaptive
+ * mode (-1) starts at the default and grows one class as soon as a read
+ * fills its slab, and shrinks one class after two reads in a row that the
+ * class below would have held, similar to Netty's AdaptiveRecvByteBufAllocator.
+ *
+ * Thread safety: UV thread only.
+ */
+class ReceiveSizer {
+public:
+	/**
+	 * Get a slab for the next read.
+	 * @param chunkSize Value of the socket's ReceiveChunkSize option
+	 * @param length Receives the number of bytes to read into the slab
+	 * @return Slab or nullptr if allocation failed
+	 */
+	[[nodiscard]] PooledBuffer* Acquire(int chunkSize, size_t& length);
+
+	/**
+	 * Feed back the size of a completed read.
+	 */
+	void Record(size_t bytesRead, size_t length);
+
+private:
+	uint8_t m_class = kDefaultStreamSizeClass;
+	uint8_t m_shrinkStreak = 0;
+	bool m_adaptive = false;
+};
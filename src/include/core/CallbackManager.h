@@ -2,58 +2,256 @@
 
 #include "socket/SocketTypes.h"
 #include "lockfree/SPSCQueue.h"
+#include "lockfree/FreeList.h"
+#include "lockfree/IntrusiveMPSCQueue.h"
 #include "lockfree/QueueTypes.h"
+#include "core/LatencyHistogram.h"
 #include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
 
 class SocketBase;
+struct PooledBuffer;
 
 /**
- * Lock-free callback manager using SPSC queues.
+ * Per-socket event queue and its scheduling state.
+ *
+ * Owned jointly by the socket and the scheduler, so a queue that was handed
+ * to the game thread stays valid even if its socket is destroyed before the
+ * scheduler gets to it. A detached queue discards its remaining events.
+ */
+struct SocketEventQueue {
+	explicit SocketEventQueue(SocketBase* owner) : owner(owner) {}
+	~SocketEventQueue();
+
+	SocketEventQueue(const SocketEventQueue&) = delete;
+	SocketEventQueue& operator=(const SocketEventQueue&) = delete;
+
+	SocketBase* const owner;
+	IntrusiveMPSCQueue<EventNode> events;
+
+	// Events and received bytes waiting for dispatch
+	// (UV thread increments, game thread decrements)
+	std::atomic<size_t> pending{0};
+	std::atomic<size_t> pendingBytes{0};
+	// Reading was stopped by backpressure (UV thread sets, game thread clears)
+	std::atomic<bool> receivePaused{false};
+	// Set by the producer that hands the queue to the scheduler
+	std::atomic<bool> scheduled{false};
+	// Owner socket was destroyed (game thread)
+	std::atomic<bool> detached{false};
+	// Accepted socket whose Incoming callback has not run yet
+	std::atomic<bool> held{false};
+
+	// Scheduler state (game thread only)
+	int64_t deficit = 0;
+	bool parked = false;
+
+	// Counters for Socket.GetStat
+	std::atomic<uint64_t> droppedEvents{0};
+	std::atomic<uint64_t> receivePauses{0};
+	// Data events handed to the receive callback queue (UV thread)
+	std::atomic<uint64_t> bytesReceived{0};
+	std::atomic<uint64_t> messagesReceived{0};
+	// Accepted by Send, SendTo and SendToMany (game thread)
+	std::atomic<uint64_t> bytesSent{0};
+	std::atomic<uint64_t> messagesSent{0};
+	std::atomic<uint64_t> sendErrors{0};
+	std::atomic<uint64_t> receiveErrors{0};
+	// Bytes of send requests not yet written (game thread adds, any thread subtracts)
+	std::atomic<int64_t> sendBacklog{0};
+	// Duration of the last successful TCP connect in microseconds
+	std::atomic<uint64_t> connectLatency{0};
+};
+
+/**
+ * Lock-free callback manager with per-socket event queues.
  *
  * Thread model:
- * - UV thread: produces events via EnqueueXxx() methods
+ * - UV threads: produce events via EnqueueXxx() methods
  * - Game thread: consumes events via ProcessPendingCallbacks()
  *
- * Each event type has its own queue to avoid the need for variant types
- * and to allow type-safe processing.
+ * Each event loop hands queues over through its own ready queue and draws
+ * nodes from its own pool, so every ring keeps a single producer however
+ * many loops run.
+ *
+ * Every socket owns one ordered event queue. The first event on an idle
+ * queue hands it to the game thread through a ready queue; the game thread
+ * then serves active queues deficit-round-robin, charging each event by its
+ * size, so a single chatty peer gets its fair share of the per-frame budget
+ * instead of filling a shared queue and starving everyone else.
+ *
+ * Sockets with DirectDispatch set are kept on a separate list that is
+ * drained in full at the start of every frame, ahead of and outside the
+ * per-frame budget. ForceFrameLock disables this and keeps every socket
+ * strictly on the budgeted per-frame path.
  */
 class CallbackManager {
 public:
+	CallbackManager();
+	~CallbackManager();
+
+	CallbackManager(const CallbackManager&) = delete;
+	CallbackManager& operator=(const CallbackManager&) = delete;
+
 	// Enqueue methods (called from UV thread)
 	void EnqueueConnect(SocketBase* socket, const RemoteEndpoint& endpoint);
 	void EnqueueDisconnect(SocketBase* socket);
 	void EnqueueListen(SocketBase* socket, const RemoteEndpoint& localEndpoint);
 	void EnqueueIncoming(SocketBase* socket, SocketBase* newSocket, const RemoteEndpoint& remoteEndpoint);
-	void EnqueueReceive(SocketBase* socket, const char* data, size_t length);
-	void EnqueueReceive(SocketBase* socket, const char* data, size_t length, const RemoteEndpoint& sender);
+	// Takes over the caller's reference on buffer, data must point into it
+	void EnqueueReceive(SocketBase* socket, PooledBuffer* buffer, char* data, size_t length);
+	void EnqueueReceive(SocketBase* socket, PooledBuffer* buffer, char* data, size_t length, const RemoteEndpoint& sender);
 	void EnqueueError(SocketBase* socket, SocketError errorType, const char* errorMsg);
 
-	// Process callbacks (called from game thread)
+	/**
+	 * Check a stream socket's receive backlog after enqueuing data (UV thread).
+	 * Once it passes the high watermark the socket is marked paused and the
+	 * caller must stop reading; the game thread calls ResumeReceiving() when
+	 * the backlog is back under the low watermark.
+	 *
+	 * @return true if the caller should call uv_read_stop
+	 */
+	[[nodiscard]] bool PauseIfBacklogged(SocketBase* socket);
+
+	[[nodiscard]] uint64_t GetDroppedEvents() const { return m_droppedEvents.load(std::memory_order_relaxed); }
+
+	// Events waiting across all sockets, and the most that ever waited at once
+	[[nodiscard]] size_t GetPendingCount() const;
+	[[nodiscard]] size_t GetPendingHighWater() const { return m_pendingHighWater.load(std::memory_order_relaxed); }
+
+	/**
+	 * Sockets waiting in the ready queues of all loops (game thread).
+	 */
+	[[nodiscard]] size_t GetReadyQueueDepth() const;
+
+	// Hand-overs put off because a ready queue was full
+	[[nodiscard]] uint64_t GetReadyQueueFull() const { return m_readyQueueFull.load(std::memory_order_relaxed); }
+
+	/**
+	 * Process callbacks (called from game thread).
+	 * The amount of work per call is bounded by CallbackBudgetMode.
+	 */
 	void ProcessPendingCallbacks();
 
-	// Check if there are pending callbacks for a socket
+	// Check if any socket has events waiting
 	[[nodiscard]] bool HasPendingCallbacks() const;
 
+	// One latency histogram pair per QueuedEvent alternative
+	static constexpr size_t kEventTypeCount = std::variant_size_v<QueuedEvent>;
+
+	[[nodiscard]] static const char* GetEventTypeName(size_t type);
+
+	/**
+	 * Time from enqueue on the UV thread to dispatch on the game thread, and
+	 * time spent in the plugin callback, per event type.
+	 * Game thread only.
+	 */
+	[[nodiscard]] const LatencyHistogram& GetQueueLatency(size_t type) const { return m_queueLatency[type]; }
+	[[nodiscard]] const LatencyHistogram& GetCallbackLatency(size_t type) const { return m_callbackLatency[type]; }
+	void ResetLatency();
+
+	/**
+	 * Set up the ready queues and node pools of the first count event loops.
+	 * Called from game thread before those loops start.
+	 */
+	void ReserveLoops(size_t count);
+
 private:
+	friend struct SocketEventQueue;
+
+	using QueueRef = std::shared_ptr<SocketEventQueue>;
+
+	// Hand an event to its socket's queue (UV thread)
+	void Enqueue(SocketBase* socket, QueuedEvent&& event);
+
+	// Node pool: allocated on UV thread, returned from game thread
+	EventNode* AllocateNode(uint8_t loop);
+	void FreeNode(EventNode* node);
+	// Remove a dequeued node's event from the backlog counters (game thread)
+	void Unaccount(SocketEventQueue& queue, const QueuedEvent& event);
+	void ResumeIfDrained(SocketEventQueue& queue);
+
+	// Free a node whose event will never be executed, releasing its payload
+	void DiscardNode(EventNode* node);
+	static void ReleasePayload(QueuedEvent& event);
+
+	// Scheduler (game thread)
+	void CollectReadyQueues();
+	void Activate(QueueRef&& queue);
+	void SetIdle(QueueRef&& queue);
+	void ReleaseHeld(const QueueRef& queue);
+	void ProcessDirectQueues(size_t concatLimit);
+	int64_t DispatchNext(SocketEventQueue& queue, size_t concatLimit);
+
 	// Execute individual callback types
+	void ExecuteEvent(QueuedEvent& event);
 	void ExecuteConnect(const QueuedConnectEvent& event);
 	void ExecuteDisconnect(const QueuedDisconnectEvent& event);
 	void ExecuteListen(const QueuedListenEvent& event);
 	void ExecuteIncoming(const QueuedIncomingEvent& event);
 	void ExecuteReceive(const QueuedDataEvent& event);
+	int64_t ExecuteConcatenatedReceive(SocketEventQueue& queue, const QueuedDataEvent& event, size_t maxLength);
+	void DispatchReceive(SocketBase* socket, char* data, size_t length, const RemoteEndpoint& sender);
 	void ExecuteError(const QueuedErrorEvent& event);
 
+	[[nodiscard]] bool IsDirectDispatch(SocketBase* socket) const;
+
 	// Helper to check if socket is valid for callback execution
 	[[nodiscard]] bool IsSocketValid(SocketBase* socket) const;
 
-	// SPSC queues for each event type
-	// UV thread produces, game thread consumes
-	SPSCQueue<QueuedConnectEvent, 256> m_connectQueue;
-	SPSCQueue<QueuedDisconnectEvent, 256> m_disconnectQueue;
-	SPSCQueue<QueuedListenEvent, 64> m_listenQueue;
-	SPSCQueue<QueuedIncomingEvent, 256> m_incomingQueue;
-	SPSCQueue<QueuedDataEvent, 1024> m_dataQueue;
-	SPSCQueue<QueuedErrorEvent, 256> m_errorQueue;
+	[[nodiscard]] static int64_t GetEventCost(const QueuedEvent& event);
+
+	// BackpressureHigh/BackpressureLow for a socket, in bytes
+	[[nodiscard]] static size_t GetHighWatermark(SocketBase* socket);
+	[[nodiscard]] static size_t GetLowWatermark(SocketBase* socket);
+
+	// Per-socket backlog above which new events are dropped
+	static constexpr size_t kMaxPendingPerSocket = 4096;
+
+	// Stream sockets stop reading at half the event cap so the cap itself is
+	// never reached by stream data, and resume at a quarter
+	static constexpr size_t kPauseEventCount = kMaxPendingPerSocket / 2;
+	static constexpr size_t kResumeEventCount = kMaxPendingPerSocket / 4;
+
+	// Backlog defaults when BackpressureHigh/BackpressureLow are not set
+	static constexpr size_t kDefaultHighWatermark = 1024 * 1024;
+
+	// Deficit round robin: credit per visit, and the fixed part of every event's
+	// cost so many tiny messages cannot monopolise a round either
+	static constexpr int64_t kSchedulerQuantum = 16384;
+	static constexpr int64_t kEventBaseCost = 256;
+
+	// Per event loop hand-over state
+	struct LoopQueues {
+		// Queues that went from idle to pending (UV thread produces, game thread consumes)
+		SPSCQueue<QueueRef, 16384> ready;
+		FreeList<EventNode, &EventNode::freeNext> nodes{4096};
+	};
+	std::unique_ptr<LoopQueues> m_loops[kMaxEventLoops];
+
+	// Queues with pending events (game thread only)
+	std::deque<QueueRef> m_active;
+	std::deque<QueueRef> m_direct;
+
+	std::atomic<size_t> m_pendingEvents{0};
+	std::atomic<size_t> m_pendingHighWater{0};
+	std::atomic<uint64_t> m_droppedEvents{0};
+	std::atomic<uint64_t> m_readyQueueFull{0};
+
+	// Latency per event type (game thread only)
+	LatencyHistogram m_queueLatency[kEventTypeCount];
+	LatencyHistogram m_callbackLatency[kEventTypeCount];
+
+	// Scratch buffer for ConcatenateCallbacks (game thread only)
+	static constexpr size_t kMinConcatenateSize = 4096;
+	std::vector<char> m_concatBuffer;
+
+	// Adaptive budget state (game thread only)
+	static constexpr int kMaxAdaptiveBudget = 8192;
+	int m_adaptiveBudget = 1;
 };
 
-extern CallbackManager g_CallbackManager;
\ No newline at end of file
+extern CallbackManager g_CallbackManager;
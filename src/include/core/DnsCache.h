@@ -0,0 +1,97 @@
+#pragma once
+
+#include <uv.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * Name resolution front end shared by every socket.
+ *
+ * Numeric IPv4/IPv6 literals are parsed inline and never reach the
+ * resolver. Names go through uv_getaddrinfo once; the first address is
+ * cached for kTtlMs, and lookups for a name that is already being resolved
+ * wait for that request instead of starting another one.
+ *
+ * Every event loop has its own cache.
+ *
+ * Thread model:
+ * - ParseNumeric() and Resolve() may be called from any thread
+ * - Lookup() and every callback run on the owning loop's thread
+ */
+class DnsCache {
+public:
+	/**
+	 * Resolution result, called on the UV thread.
+	 * @param status 0 on success or a libuv error code
+	 * @param address Resolved address with the port applied, nullptr on error
+	 */
+	using Callback = void (*)(void* data, int status, const sockaddr_storage* address);
+
+	explicit DnsCache(EventLoop& loop) : m_loop(loop) {}
+
+	DnsCache(const DnsCache&) = delete;
+	DnsCache& operator=(const DnsCache&) = delete;
+
+	/**
+	 * Parse a numeric IPv4 or IPv6 literal without touching the resolver.
+	 * @return true if host was a literal and address was filled in
+	 */
+	static bool ParseNumeric(const char* host, uint16_t port, sockaddr_storage& address);
+
+	/**
+	 * Resolve host from any thread by posting the lookup to the loop.
+	 * @return false if the lookup could not be queued, callback is not called
+	 */
+	bool Resolve(const char* host, uint16_t port, Callback callback, void* data);
+
+	/**
+	 * Resolve host on the loop's thread. Literals and cache hits complete before
+	 * this returns, everything else completes from the resolver callback.
+	 */
+	void Lookup(const std::string& host, uint16_t port, Callback callback, void* data);
+
+	[[nodiscard]] uint64_t GetHits() const { return m_hits.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t GetMisses() const { return m_misses.load(std::memory_order_relaxed); }
+
+private:
+	struct Waiter {
+		uint16_t port;
+		Callback callback;
+		void* data;
+	};
+
+	// One uv_getaddrinfo in flight per name
+	struct PendingLookup {
+		uv_getaddrinfo_t request;
+		DnsCache* cache;
+		std::string host;
+		std::vector<Waiter> waiters;
+	};
+
+	struct Entry {
+		sockaddr_storage address;
+		uint64_t expires;
+	};
+
+	static void OnResolved(uv_getaddrinfo_t* request, int status, struct addrinfo* addressInfo);
+	static void Complete(const Waiter& waiter, const sockaddr_storage& address);
+
+	void Store(const std::string& host, const sockaddr_storage& address);
+
+	static constexpr uint64_t kTtlMs = 60 * 1000;
+	static constexpr size_t kMaxEntries = 1024;
+
+	EventLoop& m_loop;
+
+	// Owning loop's thread only
+	std::unordered_map<std::string, Entry> m_entries;
+	std::unordered_map<std::string, PendingLookup*> m_pending;
+
+	std::atomic<uint64_t> m_hits{0};
+	std::atomic<uint64_t> m_misses{0};
+};
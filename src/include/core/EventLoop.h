@@ -1,24 +1,43 @@
 #pragma once
 
-#include "lockfree/SPSCQueue.h"
+#include "lockfree/MPSCQueue.h"
+#include "lockfree/IntrusiveMPSCQueue.h"
 #include "lockfree/QueueTypes.h"
+#include "core/SendRequest.h"
+#include "core/DnsCache.h"
+#include "socket/SocketTypes.h"
 #include <uv.h>
 #include <thread>
 #include <atomic>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
 
 /**
  * Lock-free event loop wrapper for libuv.
  *
  * Thread model:
- * - Game thread: posts jobs via Post() method
- * - UV thread: consumes jobs and runs libuv event loop
+ * - Any thread: posts jobs via Post() method
+ * - UV thread: consumes jobs and runs libuv event loop, blocking in
+ *   uv_run until there is work; Stop() wakes it through m_async
  *
- * Uses SPSC queue for lock-free job posting.
+ * Uses an MPSC queue for lock-free job posting, so the game thread, the UV
+ * thread's own callbacks and foreign threads may all post concurrently.
+ *
+ * When the ring is full, jobs spill into an unbounded linked overflow list.
+ * Overflow is sticky: once a job has spilled, every later job goes to the
+ * list as well until the UV thread has drained it, so jobs from any one
+ * thread always run in the order they were posted.
+ *
+ * Several loops may run side by side, see EventLoopPool. Each one has its
+ * own thread, job queue, send pool and name cache; a socket stays on the
+ * loop it was assigned to for its whole life.
  */
 class EventLoop {
 public:
-	EventLoop();
+	explicit EventLoop(uint8_t index);
 	~EventLoop();
 
 	EventLoop(const EventLoop&) = delete;
@@ -29,38 +48,145 @@ public:
 	[[nodiscard]] bool IsRunning() const { return m_running.load(std::memory_order_acquire); }
 	[[nodiscard]] uv_loop_t* GetLoop() { return m_loop; }
 
+	// Position in the pool, also selects this loop's callback and slab queues
+	[[nodiscard]] uint8_t GetIndex() const { return m_index; }
+
+	/**
+	 * Name resolution for sockets on this loop.
+	 * Lookups and their callbacks run on this loop's thread.
+	 */
+	[[nodiscard]] DnsCache& GetDnsCache() { return m_dnsCache; }
+
+	/**
+	 * The loop whose thread is calling, nullptr outside the UV threads.
+	 */
+	[[nodiscard]] static EventLoop* Current();
+
 	/**
 	 * Post a job to be executed on the UV thread.
 	 * Thread-safe, can be called from any thread.
 	 *
 	 * @param callback Function pointer to execute
 	 * @param data User data to pass to callback
-	 * @return true if job was queued, false if queue is full
+	 * @return true if job was queued, false if out of memory
 	 */
 	bool Post(void (*callback)(void*), void* data);
 
 	/**
-	 * Post a job using std::function (convenience wrapper).
-	 * Note: This allocates memory for the function object.
+	 * Post a callable to be executed on the UV thread.
+	 * Thread-safe, can be called from any thread. The callable is stored
+	 * inline in the job queue, see AsyncJob for the capture limit.
 	 *
-	 * @param callback Function to execute
-	 * @return true if job was queued, false if queue is full
+	 * @param callback Callable to execute
+	 * @return true if job was queued, false if out of memory
+	 */
+	template<typename F>
+	bool Post(F&& callback) {
+		return Post(AsyncJob(std::forward<F>(callback)));
+	}
+
+	bool Post(AsyncJob&& job);
+
+	/**
+	 * Pool for outgoing messages handled by this loop.
+	 * Acquire from the game thread, release from any thread.
+	 */
+	[[nodiscard]] SendRequestPool& GetSendPool() { return m_sendPool; }
+
+	/**
+	 * Run a callback once the current pass over posted jobs is done.
+	 * UV thread only. Lets jobs batch work, e.g. coalescing every Send of
+	 * one wakeup into a single write.
 	 */
-	bool Post(std::function<void()> callback);
+	void Defer(void (*callback)(void*), void* data);
+
+	// Jobs that did not fit the ring, and the deepest the overflow list got
+	[[nodiscard]] uint64_t GetOverflowCount() const { return m_overflowCount.load(std::memory_order_relaxed); }
+	[[nodiscard]] size_t GetOverflowHighWater() const { return m_overflowHighWater.load(std::memory_order_relaxed); }
+
+	// Jobs waiting in the ring and the overflow list (approximate)
+	[[nodiscard]] size_t GetJobQueueDepth() const;
+	// Most jobs found waiting when the loop woke up
+	[[nodiscard]] size_t GetJobQueueHighWater() const { return m_jobHighWater.load(std::memory_order_relaxed); }
 
 private:
 	void Run();
 	static void OnAsync(uv_async_t* handle);
 	static void OnClose(uv_handle_t* handle);
 
+	bool PostOverflow(AsyncJob&& job, uint64_t state);
+	void TryLeaveOverflow();
+	void RunJobs();
+	void RunDeferred();
+
+	const uint8_t m_index;
 	uv_loop_t* m_loop = nullptr;
 	uv_async_t* m_async = nullptr;
 	std::thread m_thread;
 	std::atomic<bool> m_running{false};
 	std::atomic<bool> m_stopping{false};
 
-	// SPSC queue for async jobs (game thread produces, UV thread consumes)
-	SPSCQueue<AsyncJob, 1024> m_jobQueue;
+	// MPSC queue for async jobs (any thread produces, UV thread consumes)
+	static constexpr size_t kJobQueueSize = 1024;
+	MPSCQueue<AsyncJob, kJobQueueSize> m_jobQueue;
+
+	// Overflow state word: bit 0 set while jobs spill into the overflow list,
+	// the remaining bits count overflow pushes
+	static constexpr uint64_t kOverflowActive = 1;
+	static constexpr uint64_t kOverflowPush = 2;
+
+	std::atomic<uint64_t> m_overflowState{0};
+	IntrusiveMPSCQueue<OverflowJob> m_overflow;
+	uint64_t m_overflowPopped = 0;  // UV thread only
+	std::atomic<uint64_t> m_overflowPoppedShared{0};
+
+	std::atomic<uint64_t> m_overflowCount{0};
+	std::atomic<size_t> m_overflowHighWater{0};
+	// Written by the UV thread only
+	std::atomic<size_t> m_jobHighWater{0};
+
+	SendRequestPool m_sendPool{256};
+	DnsCache m_dnsCache{*this};
+
+	// Deferred callbacks (UV thread only)
+	std::vector<std::pair<void (*)(void*), void*>> m_deferred;
+	std::vector<std::pair<void (*)(void*), void*>> m_runningDeferred;
+	bool m_runningJobs = false;
+};
+
+/**
+ * The event loops sockets are spread across.
+ *
+ * Loop 0 always exists and also runs the extension-wide services such as
+ * the HTTP client. Start() adds loops up to the configured count; loops are
+ * never destroyed before the pool, so the pools they own stay valid for
+ * requests and events still in flight.
+ *
+ * Thread model:
+ * - Game thread: Start(), Stop()
+ * - Any thread: Get(), GetCount() once started
+ */
+class EventLoopPool {
+public:
+	EventLoopPool();
+	~EventLoopPool() = default;
+
+	EventLoopPool(const EventLoopPool&) = delete;
+	EventLoopPool& operator=(const EventLoopPool&) = delete;
+
+	/**
+	 * Start count loops (clamped to 1..kMaxEventLoops).
+	 */
+	void Start(size_t count);
+	void Stop();
+
+	[[nodiscard]] size_t GetCount() const { return m_count; }
+	[[nodiscard]] EventLoop& Get(size_t index) { return *m_loops[index]; }
+	[[nodiscard]] EventLoop& GetPrimary() { return *m_loops[0]; }
+
+private:
+	std::unique_ptr<EventLoop> m_loops[kMaxEventLoops];
+	size_t m_count = 1;
 };
 
-extern EventLoop g_EventLoop;
\ No newline at end of file
+extern EventLoopPool g_EventLoops;
\ No newline at end of file
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "core/HttpResponseParser.h"
+#include "core/BufferPool.h"
+#include "lockfree/IntrusiveMPSCQueue.h"
+#include <smsdk_ext.h>
+#include <uv.h>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * One HTTP request and, once it completed, its response.
+ *
+ * Built on the game thread, owned by the UV thread while in flight and
+ * handed back through the completion queue.
+ */
+struct HttpRequest : MPSCNode {
+	// Completion callback (game thread), cleared if its plugin unloads
+	IPluginFunction* callback = nullptr;
+	IPluginContext* context = nullptr;
+	cell_t data = 0;
+
+	// Target and the serialized request
+	std::string host;
+	uint16_t port = 80;
+	std::string message;
+	bool head = false;
+	bool idempotent = false;
+	bool retried = false;
+
+	// Response; status stays 0 and error is set on failure
+	int status = 0;
+	std::string headers;
+	std::string body;
+	std::string error;
+};
+
+/**
+ * HTTP/1.1 client with per-host keep-alive connection pools.
+ *
+ * Requests to the same host and port share up to HttpMaxConnections
+ * connections, which stay open between requests for a while. When every
+ * connection is busy, idempotent requests are pipelined, up to
+ * HttpPipelineDepth per connection, onto connections that already kept a
+ * response alive. An idempotent request whose reused connection closes
+ * before any of its response arrived is retried once.
+ *
+ * Connections are raw libuv handles rather than TcpSocket objects, since
+ * the response bytes are parsed here instead of reaching a plugin's
+ * receive callback. Only plain http:// URLs are supported.
+ *
+ * Thread model:
+ * - Game thread: Request(), ProcessCompletions(), CancelRequests()
+ * - UV thread of the first event loop: connections, pools and response parsing
+ * - Completed requests travel back through an intrusive MPSC queue
+ */
+class HttpClient {
+public:
+	static constexpr int kDefaultMaxConnections = 6;
+	static constexpr int kDefaultPipelineDepth = 4;
+	static constexpr uint64_t kDefaultTimeoutMs = 30000;
+	// Idle connections are closed after this long
+	static constexpr uint64_t kIdleTimeoutMs = 30000;
+
+	HttpClient() = default;
+	~HttpClient();
+
+	HttpClient(const HttpClient&) = delete;
+	HttpClient& operator=(const HttpClient&) = delete;
+
+	/**
+	 * Start a request (game thread).
+	 *
+	 * @param headers Extra header lines separated by CRLF, may be empty
+	 * @param error Receives the reason if the arguments are invalid
+	 * @return false if the arguments are invalid or the request could not
+	 *         be queued, callback is not called
+	 */
+	bool Request(std::string_view method, std::string_view url, std::string_view headers, std::string_view body,
+		IPluginFunction* callback, cell_t data, const char*& error);
+
+	/**
+	 * Run the callbacks of completed requests (game thread).
+	 */
+	void ProcessCompletions();
+
+	/**
+	 * Drop the callbacks of a plugin's unfinished requests (game thread).
+	 * The requests still run to completion.
+	 */
+	void CancelRequests(IPluginContext* context);
+
+	/**
+	 * Fail queued requests and close every connection (game thread).
+	 * Must be called before the event loop stops.
+	 */
+	void Shutdown();
+
+private:
+	struct HostPool;
+
+	struct Connection {
+		uv_tcp_t tcp;
+		uv_timer_t timer;
+		uv_connect_t connectRequest;
+
+		HttpClient* client = nullptr;
+		HostPool* pool = nullptr;
+
+		ReceiveSizer receiveSizer;
+		HttpResponseParser parser;
+
+		// Requests written or waiting for the connect, oldest first; the
+		// parser reads the response to the front one
+		std::deque<HttpRequest*> inFlight;
+
+		uint8_t openHandles = 0;
+		bool resolving = false;
+		bool connected = false;
+		bool closing = false;
+		// A response completed and the server kept the connection open
+		bool reused = false;
+	};
+
+	struct HostPool {
+		std::string host;
+		uint16_t port = 0;
+		std::vector<Connection*> connections;
+		std::deque<HttpRequest*> waiting;
+	};
+
+	// UV thread
+	void Dispatch(HttpRequest* request);
+	void Pump(HostPool* pool);
+	Connection* Open(HostPool* pool);
+	void Connect(Connection* connection);
+	void Assign(Connection* connection, HttpRequest* request);
+	void Write(Connection* connection, HttpRequest* request);
+	void OnData(Connection* connection, const char* data, size_t length);
+	// Fail the connection's requests, or with retry requeue the idempotent
+	// ones that saw no response yet if the connection had been reused
+	void Close(Connection* connection, const char* error, bool retry = false);
+	void Fail(HttpRequest* request, const char* error);
+	void Complete(HttpRequest* request);
+	void CloseAll();
+
+	[[nodiscard]] static Connection* FromHandle(void* handle);
+	static void StartTimer(Connection* connection, uint64_t timeoutMs);
+	[[nodiscard]] static uint64_t GetTimeout();
+
+	static void OnResolved(void* data, int status, const sockaddr_storage* address);
+	static void OnConnect(uv_connect_t* request, int status);
+	static void OnAllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer);
+	static void OnRead(uv_stream_t* stream, ssize_t bytesRead, const uv_buf_t* buffer);
+	static void OnWrite(uv_write_t* request, int status);
+	static void OnTimer(uv_timer_t* timer);
+	static void OnClose(uv_handle_t* handle);
+
+	// Pools by "host:port" (UV thread only)
+	std::unordered_map<std::string, std::unique_ptr<HostPool>> m_pools;
+	bool m_shutdown = false;
+
+	// UV thread produces, game thread consumes
+	IntrusiveMPSCQueue<HttpRequest> m_completions;
+
+	// Requests not yet completed, for CancelRequests (game thread only)
+	std::unordered_set<HttpRequest*> m_pending;
+};
+
+extern HttpClient g_HttpClient;
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string_view>
+
+// Helpers for the HTTP/1.1 heads parsed by the WebSocket handshake and the
+// HTTP client. Header names and tokens compare case-insensitively.
+
+inline char AsciiToLower(char c) {
+	return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+inline bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (AsciiToLower(a[i]) != AsciiToLower(b[i])) return false;
+	}
+	return true;
+}
+
+inline std::string_view TrimWhitespace(std::string_view value) {
+	while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+	while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+	return value;
+}
+
+// Value of header name in an HTTP head (start line first), empty if absent
+inline std::string_view FindHeader(std::string_view head, std::string_view name) {
+	size_t lineStart = head.find("\r\n");
+	while (lineStart != std::string_view::npos) {
+		lineStart += 2;
+		size_t lineEnd = head.find("\r\n", lineStart);
+		if (lineEnd == std::string_view::npos) break;
+
+		std::string_view line = head.substr(lineStart, lineEnd - lineStart);
+		size_t colon = line.find(':');
+		if (colon != std::string_view::npos && EqualsIgnoreCase(TrimWhitespace(line.substr(0, colon)), name)) {
+			return TrimWhitespace(line.substr(colon + 1));
+		}
+		lineStart = lineEnd;
+	}
+	return {};
+}
+
+// Check a comma separated header value for token
+inline bool HasHeaderToken(std::string_view list, std::string_view token) {
+	while (!list.empty()) {
+		size_t comma = list.find(',');
+		if (EqualsIgnoreCase(TrimWhitespace(list.substr(0, comma)), token)) return true;
+		if (comma == std::string_view::npos) break;
+		list.remove_prefix(comma + 1);
+	}
+	return false;
+}
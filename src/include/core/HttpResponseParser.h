@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * Incremental HTTP/1.1 response parser.
+ *
+ * Bytes are fed as they arrive, in reads of any size. Bodies delimited by
+ * Content-Length, by chunked transfer coding or by the connection closing
+ * are supported; interim 1xx responses are skipped. Parsing stops at the
+ * end of a response, so the bytes after it can be fed to the next one when
+ * requests are pipelined.
+ *
+ * Thread safety: none, used by one connection on the UV thread.
+ */
+class HttpResponseParser {
+public:
+	enum class Result {
+		NeedMore,
+		Complete,
+		Error
+	};
+
+	// Limits on the head (status line and headers) and the decoded body
+	static constexpr size_t kMaxHeaderSize = 64 * 1024;
+	static constexpr size_t kMaxBodySize = 16 * 1024 * 1024;
+
+	HttpResponseParser() = default;
+
+	HttpResponseParser(const HttpResponseParser&) = delete;
+	HttpResponseParser& operator=(const HttpResponseParser&) = delete;
+
+	/**
+	 * Prepare for the response to the next request.
+	 * @param headRequest The request was HEAD, so the response has no body
+	 */
+	void Reset(bool headRequest);
+
+	/**
+	 * Parse bytes of the current response.
+	 * @param consumed Receives the number of bytes used; on Complete the
+	 *                 rest belongs to the next response
+	 */
+	Result Feed(const char* data, size_t length, size_t& consumed);
+
+	/**
+	 * The connection closed. Completes a body that runs until close.
+	 * @return Complete, or Error if the response was cut short
+	 */
+	Result Finish();
+
+	// Any byte of the current response was seen
+	[[nodiscard]] bool HasStarted() const { return m_started; }
+	// The connection may carry another request after this response
+	[[nodiscard]] bool IsKeepAlive() const { return m_keepAlive; }
+	[[nodiscard]] const char* GetError() const { return m_error; }
+
+	[[nodiscard]] int GetStatus() const { return m_status; }
+	// Header lines of the final response, each ending in CRLF
+	[[nodiscard]] std::string& GetHeaders() { return m_headers; }
+	[[nodiscard]] std::string& GetBody() { return m_body; }
+
+private:
+	enum class State : uint8_t {
+		StatusLine,
+		Headers,
+		Body,
+		ChunkSize,
+		ChunkData,
+		ChunkEnd,
+		Trailers,
+		UntilClose,
+		Done
+	};
+
+	bool ParseLine(std::string_view line);
+	bool ParseStatusLine(std::string_view line);
+	bool ParseHeader(std::string_view line);
+	bool EndHeaders();
+	bool ParseChunkSize(std::string_view line);
+	bool Fail(const char* error);
+
+	State m_state = State::StatusLine;
+	bool m_headRequest = false;
+	bool m_started = false;
+	bool m_keepAlive = false;
+	bool m_chunked = false;
+	bool m_hasLength = false;
+
+	int m_status = 0;
+	uint64_t m_contentLength = 0;
+	// Bytes left of the Content-Length body or the current chunk
+	uint64_t m_remaining = 0;
+	// Head bytes of the current response, against kMaxHeaderSize
+	size_t m_headerBytes = 0;
+
+	// Line being received
+	std::string m_line;
+	std::string m_headers;
+	std::string m_body;
+	const char* m_error = nullptr;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Log-linear histogram of durations in nanoseconds.
+ *
+ * Every power of two is split into kSubBuckets linear buckets, so a
+ * recorded value is reported to within about 6% whatever its magnitude,
+ * from single nanoseconds up to kMaxValue. Larger values land in the last
+ * bucket. Fixed size, recording never allocates.
+ *
+ * Not thread-safe, each histogram has a single writer.
+ */
+class LatencyHistogram {
+public:
+	void Record(uint64_t nanoseconds) {
+		if (nanoseconds > kMaxValue) {
+			nanoseconds = kMaxValue;
+		}
+		++m_counts[BucketOf(nanoseconds)];
+		++m_total;
+		if (nanoseconds > m_max) {
+			m_max = nanoseconds;
+		}
+	}
+
+	/**
+	 * Smallest value that at least fraction of the samples do not exceed,
+	 * rounded up to its bucket's bound.
+	 *
+	 * @param fraction Percentile in [0, 1], e.g. 0.99 for p99
+	 * @return Value in nanoseconds, 0 if nothing was recorded
+	 */
+	[[nodiscard]] uint64_t Percentile(double fraction) const;
+
+	[[nodiscard]] uint64_t GetCount() const { return m_total; }
+	[[nodiscard]] uint64_t GetMax() const { return m_max; }
+
+	void Reset();
+
+private:
+	static constexpr unsigned kSubBucketBits = 4;
+	static constexpr uint64_t kSubBuckets = 1ull << kSubBucketBits;
+	// About 68 seconds, anything slower is a stall not a latency
+	static constexpr unsigned kMaxExponent = 35;
+	static constexpr uint64_t kMaxValue = (2ull << kMaxExponent) - 1;
+	static constexpr size_t kBucketCount = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+	[[nodiscard]] static size_t BucketOf(uint64_t value) {
+		if (value < kSubBuckets) {
+			return static_cast<size_t>(value);
+		}
+		unsigned exponent = kSubBucketBits;
+		while (value >> (exponent + 1)) {
+			++exponent;
+		}
+		unsigned shift = exponent - kSubBucketBits;
+		uint64_t sub = (value >> shift) & (kSubBuckets - 1);
+		return static_cast<size_t>((exponent - kSubBucketBits + 1) * kSubBuckets + sub);
+	}
+
+	// Largest value that falls into bucket
+	[[nodiscard]] static uint64_t UpperBound(size_t bucket);
+
+	uint64_t m_counts[kBucketCount]{};
+	uint64_t m_total = 0;
+	uint64_t m_max = 0;
+};
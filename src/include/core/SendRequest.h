@@ -0,0 +1,119 @@
+#pragma once
+
+#include "lockfree/FreeList.h"
+#include <uv.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class SocketBase;
+class SendRequestPool;
+struct SocketEventQueue;
+
+/**
+ * Outgoing message and the libuv request that carries it.
+ *
+ * Requests and their payload buffers are recycled through a
+ * SendRequestPool, so steady-state sends do not allocate. A request made
+ * for a socket counts towards its send backlog from Acquire or Create
+ * until it is released.
+ */
+struct SendRequest {
+	// A request is either a stream write or a datagram send
+	union {
+		uv_write_t write;
+		uv_udp_send_t udpSend;
+	};
+
+	// UDP SendTo destination: a parsed literal, or AF_UNSPEC with the name
+	// in host for DnsCache to resolve on the UV thread
+	sockaddr_storage address;
+	std::string host;
+	uint16_t port = 0;
+
+	// Not valid once the write is under way, the socket may be destroyed
+	// before it completes; write completions go through backlog instead
+	SocketBase* socket = nullptr;
+	// Event queue whose send backlog this request counts towards. Held by
+	// reference, the socket may be destroyed before the write completes.
+	std::shared_ptr<SocketEventQueue> backlog;
+	char* data = nullptr;
+	size_t length = 0;
+	size_t capacity = 0;
+
+	SendRequestPool* pool = nullptr;
+	SendRequest* next = nullptr;
+
+	SendRequest() {}
+
+	[[nodiscard]] uv_buf_t Buffer() const {
+		return uv_buf_init(data, static_cast<unsigned int>(length));
+	}
+
+	/**
+	 * Allocate a request outside any pool, for sends that originate on the
+	 * UV thread. Its payload holds length uninitialized bytes.
+	 *
+	 * @return Request or nullptr if allocation failed
+	 */
+	[[nodiscard]] static SendRequest* Create(SocketBase* socket, size_t length);
+
+	/**
+	 * Return the request to its pool, or free it if it has none.
+	 * Thread-safe, can be called from any thread.
+	 */
+	void Release();
+};
+
+/**
+ * Lock-free pool of send requests.
+ *
+ * Thread model:
+ * - Game thread: acquires requests in Send/SendTo (single consumer)
+ * - Any thread: returns requests via SendRequest::Release()
+ */
+class SendRequestPool {
+public:
+	explicit SendRequestPool(size_t maxCached);
+	~SendRequestPool();
+
+	SendRequestPool(const SendRequestPool&) = delete;
+	SendRequestPool& operator=(const SendRequestPool&) = delete;
+
+	/**
+	 * Get a request holding a copy of payload.
+	 * Must be called from the game thread.
+	 *
+	 * @return Request or nullptr if allocation failed
+	 */
+	[[nodiscard]] SendRequest* Acquire(SocketBase* socket, std::string_view payload);
+
+	/**
+	 * Get a request whose payload holds length uninitialized bytes.
+	 * Must be called from the game thread.
+	 *
+	 * @return Request or nullptr if allocation failed
+	 */
+	[[nodiscard]] SendRequest* Acquire(SocketBase* socket, size_t length);
+
+	/**
+	 * Number of heap allocations made for requests and their buffers.
+	 */
+	[[nodiscard]] uint64_t GetAllocations() const { return m_allocations.load(std::memory_order_relaxed); }
+
+private:
+	friend struct SendRequest;
+
+	void Recycle(SendRequest* request);
+	static void Free(SendRequest* request);
+
+	// Buffers grow in steps of at least this, and larger ones are not kept
+	static constexpr size_t kMinCapacity = 256;
+	static constexpr size_t kMaxPooledCapacity = 65536;
+
+	FreeList<SendRequest, &SendRequest::next> m_freeList;
+	std::atomic<uint64_t> m_allocations{0};
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <smsdk_ext.h>
+
+class SocketBase;
+
+/**
+ * Services the socket core takes from the process hosting it.
+ *
+ * The extension implements this on top of SourceMod (extension.cpp), the
+ * benchmark harness with a stand-alone shim (bench/BenchHost.cpp). Apart
+ * from these calls the core only needs the IPluginFunction interface to
+ * run callbacks.
+ *
+ * All methods are called from the game thread, except LogError which any
+ * thread may call.
+ */
+class SocketHost {
+public:
+	virtual ~SocketHost() = default;
+
+	/**
+	 * Look up a core.cfg setting.
+	 *
+	 * @return Value or nullptr if the key is not set
+	 */
+	[[nodiscard]] virtual const char* GetConfigValue(const char* key) = 0;
+
+	virtual void LogError(const char* format, ...) = 0;
+
+	/**
+	 * Create the handle of an accepted socket, owned by the plugin whose
+	 * Incoming callback receives it.
+	 *
+	 * @return Handle, 0 on failure
+	 */
+	[[nodiscard]] virtual Handle_t CreateSocketHandle(SocketBase* socket, IPluginFunction* owner) = 0;
+
+	/**
+	 * Free a socket's handle on behalf of the plugin owning callback, which
+	 * destroys the socket (AutoFreeHandle).
+	 */
+	virtual void FreeSocketHandle(SocketBase* socket, IPluginFunction* owner) = 0;
+};
+
+extern SocketHost* g_SocketHost;
@@ -7,13 +7,20 @@
 #ifndef _WIN32
 #include "socket/UnixSocket.h"
 #endif
+#include <cstddef>
+#include <mutex>
 #include <unordered_set>
 
 /**
  * Socket manager for tracking active sockets.
  *
+ * Every socket is bound to one event loop when it is created, the loop
+ * with the fewest sockets unless the caller names one.
+ *
  * Thread model:
- * - All operations are called from game thread only
+ * - Sockets are created on the game thread, and on a UV thread when a
+ *   listener accepts, so the socket set is guarded by a mutex
+ * - Sockets are destroyed on the game thread only
  * - UV thread uses socket->IsDeleted() atomic flag for validation
  */
 class SocketManager {
@@ -28,10 +35,12 @@ public:
 
 	/**
 	 * Create a new socket of the specified type.
-	 * Must be called from game thread.
+	 *
+	 * @param loop Event loop to bind the socket to, nullptr picks the least
+	 *             loaded one. Accepted sockets stay on their listener's loop.
 	 */
 	template<typename T>
-	T* CreateSocket();
+	T* CreateSocket(EventLoop* loop = nullptr);
 
 	/**
 	 * Destroy a socket.
@@ -39,17 +48,32 @@ public:
 	 */
 	void DestroySocket(SocketBase* socket);
 
+	/**
+	 * Start the event loops, as many as the SocketEventLoops core.cfg key
+	 * asks for (1 by default, at most kMaxEventLoops).
+	 */
 	void Start();
 	void Stop();
 
+	/**
+	 * Number of live sockets bound to the event loop at index.
+	 */
+	[[nodiscard]] size_t GetLoopSocketCount(size_t index);
+
 private:
+	// Bind a new socket to a loop and track it
+	void Register(SocketBase* socket, EventLoop* loop);
+
+	std::mutex m_mutex;
 	std::unordered_set<SocketBase*> m_sockets;
+	// Live sockets per event loop
+	size_t m_loopSockets[kMaxEventLoops]{};
 };
 
 template<typename T>
-T* SocketManager::CreateSocket() {
+T* SocketManager::CreateSocket(EventLoop* loop) {
 	T* socket = new T();
-	m_sockets.insert(socket);
+	Register(socket, loop);
 	return socket;
 }
 
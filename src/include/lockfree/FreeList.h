@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Lock-free bounded free list with many producers and a single consumer.
+ *
+ * Items are linked through a plain pointer member chosen by the Link
+ * template parameter, so the list adds no storage of its own.
+ *
+ * Thread safety:
+ * - Any thread may call Push()
+ * - Only ONE thread may call Pop() (consumer)
+ *
+ * Pushes go onto a Treiber stack. The consumer never pops single items from
+ * that stack; it detaches the whole chain with one exchange and serves from
+ * a private list afterwards. With a single consumer no node can be removed
+ * and re-pushed under a pending CAS, so the stack is ABA-free without tags.
+ */
+template<typename T, T* T::*Link>
+class FreeList {
+public:
+	explicit FreeList(size_t maxSize) : m_maxSize(maxSize) {}
+
+	FreeList(const FreeList&) = delete;
+	FreeList& operator=(const FreeList&) = delete;
+
+	/**
+	 * Return an item to the list (any thread).
+	 * @return false if the list is full, caller keeps ownership
+	 */
+	bool Push(T* item) {
+		if (m_size.fetch_add(1, std::memory_order_relaxed) >= m_maxSize) {
+			m_size.fetch_sub(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		T* head = m_shared.load(std::memory_order_relaxed);
+		do {
+			item->*Link = head;
+		} while (!m_shared.compare_exchange_weak(head, item,
+			std::memory_order_release, std::memory_order_relaxed));
+		return true;
+	}
+
+	/**
+	 * Take an item from the list (consumer only).
+	 * @return Item or nullptr if the list is empty
+	 */
+	T* Pop() {
+		if (!m_local) {
+			m_local = m_shared.exchange(nullptr, std::memory_order_acquire);
+			if (!m_local) {
+				return nullptr;
+			}
+		}
+
+		T* item = m_local;
+		m_local = item->*Link;
+		item->*Link = nullptr;
+		m_size.fetch_sub(1, std::memory_order_relaxed);
+		return item;
+	}
+
+	/**
+	 * Detach every cached item, for teardown (no concurrent access allowed).
+	 * @return Chain of items linked through Link
+	 */
+	T* TakeAll() {
+		T* chain = m_shared.exchange(nullptr, std::memory_order_acquire);
+		while (m_local) {
+			T* item = m_local;
+			m_local = item->*Link;
+			item->*Link = chain;
+			chain = item;
+		}
+		m_size.store(0, std::memory_order_relaxed);
+		return chain;
+	}
+
+	[[nodiscard]] size_t size_approx() const {
+		return m_size.load(std::memory_order_relaxed);
+	}
+
+private:
+	const size_t m_maxSize;
+	std::atomic<size_t> m_size{0};
+
+	// Items returned from any thread
+	std::atomic<T*> m_shared{nullptr};
+
+	// Consumer-owned chain of ready items
+	T* m_local = nullptr;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+
+/**
+ * Link embedded in every node of an IntrusiveMPSCQueue.
+ */
+struct MPSCNode {
+	std::atomic<MPSCNode*> next{nullptr};
+};
+
+/**
+ * Unbounded intrusive Multi-Producer Single-Consumer queue.
+ *
+ * Based on Dmitry Vyukov's intrusive MPSC node-based queue. Producers are
+ * wait-free (one exchange plus one store); the queue itself is just two
+ * pointers and a stub node, storage grows only with the items in flight.
+ *
+ * Note: A producer that was preempted between its exchange and its link
+ * store briefly hides the items behind it, so the consumer may observe the
+ * queue as empty while a push is in progress. The push becomes visible as
+ * soon as that producer resumes.
+ *
+ * Thread safety:
+ * - Any thread may call push()
+ * - Only ONE thread may call front() and pop() (consumer)
+ */
+template<typename T>
+class IntrusiveMPSCQueue {
+public:
+	IntrusiveMPSCQueue() : m_tail(&m_stub), m_head(&m_stub) {}
+
+	IntrusiveMPSCQueue(const IntrusiveMPSCQueue&) = delete;
+	IntrusiveMPSCQueue& operator=(const IntrusiveMPSCQueue&) = delete;
+
+	/**
+	 * Append a node (any thread).
+	 * The queue does not take ownership; the node must stay alive until popped.
+	 */
+	void push(T* node) {
+		PushNode(node);
+	}
+
+	/**
+	 * Peek at the oldest node without removing it (consumer only).
+	 * @return Front node or nullptr if the queue is (observably) empty
+	 */
+	T* front() {
+		MPSCNode* head = m_head;
+		if (head == &m_stub) {
+			MPSCNode* next = head->next.load(std::memory_order_acquire);
+			if (!next) {
+				return nullptr;
+			}
+			m_head = next;
+			head = next;
+		}
+		return static_cast<T*>(head);
+	}
+
+	/**
+	 * Remove the oldest node (consumer only).
+	 * @return Front node or nullptr if the queue is (observably) empty
+	 */
+	T* pop() {
+		MPSCNode* head = m_head;
+		MPSCNode* next = head->next.load(std::memory_order_acquire);
+
+		if (head == &m_stub) {
+			if (!next) {
+				return nullptr;
+			}
+			m_head = next;
+			head = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+
+		if (next) {
+			m_head = next;
+			return static_cast<T*>(head);
+		}
+
+		// head is the last linked node; a producer may be mid-push behind it
+		if (head != m_tail.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+
+		// Re-insert the stub so head can be detached
+		PushNode(&m_stub);
+
+		next = head->next.load(std::memory_order_acquire);
+		if (next) {
+			m_head = next;
+			return static_cast<T*>(head);
+		}
+		return nullptr;
+	}
+
+private:
+	void PushNode(MPSCNode* node) {
+		node->next.store(nullptr, std::memory_order_relaxed);
+		MPSCNode* prev = m_tail.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	// Producer side
+	std::atomic<MPSCNode*> m_tail;
+
+	// Consumer side
+	MPSCNode* m_head;
+	MPSCNode m_stub;
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "lockfree/SPSCQueue.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+/**
+ * Lock-free bounded Multi-Producer Single-Consumer (MPSC) queue.
+ *
+ * Based on Dmitry Vyukov's bounded MPMC queue, with the dequeue side
+ * reduced to a single consumer. Every cell carries a sequence number that
+ * tells producers whether the slot is free for their lap and tells the
+ * consumer whether the item in it has been published.
+ *
+ * Unlike SPSCQueue all Capacity slots are usable.
+ *
+ * Thread safety:
+ * - Any thread may call try_enqueue() (producers)
+ * - Only ONE thread may call try_dequeue() (consumer)
+ *
+ * Memory ordering:
+ * - Producers claim a slot with a relaxed CAS on the tail, then publish the
+ *   item with a release store of the cell sequence
+ * - The consumer acquires the cell sequence, then frees the slot for the
+ *   next lap with a release store
+ */
+template<typename T, size_t Capacity = 1024>
+class MPSCQueue {
+	static_assert(Capacity > 1, "Capacity must be greater than 1");
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2 for efficient modulo");
+
+public:
+	MPSCQueue() {
+		for (size_t i = 0; i < Capacity; ++i) {
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~MPSCQueue() {
+		// Destroy remaining published elements in place
+		size_t head = m_head;
+		for (;;) {
+			Cell& cell = m_cells[head & kMask];
+			if (cell.sequence.load(std::memory_order_relaxed) != head + 1) {
+				break;
+			}
+			reinterpret_cast<T*>(&cell.storage)->~T();
+			++head;
+		}
+	}
+
+	MPSCQueue(const MPSCQueue&) = delete;
+	MPSCQueue& operator=(const MPSCQueue&) = delete;
+	MPSCQueue(MPSCQueue&&) = delete;
+	MPSCQueue& operator=(MPSCQueue&&) = delete;
+
+	/**
+	 * Try to enqueue an item (any thread).
+	 * @param item The item to enqueue (will be moved, untouched if full)
+	 * @return true if successful, false if queue is full
+	 */
+	bool try_enqueue(T&& item) {
+		size_t position;
+		Cell* cell = Claim(position);
+		if (!cell) {
+			return false;
+		}
+
+		new (&cell->storage) T(std::move(item));
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Try to enqueue an item by copy (any thread).
+	 * @param item The item to enqueue (will be copied)
+	 * @return true if successful, false if queue is full
+	 */
+	bool try_enqueue(const T& item) {
+		size_t position;
+		Cell* cell = Claim(position);
+		if (!cell) {
+			return false;
+		}
+
+		new (&cell->storage) T(item);
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Try to dequeue an item (consumer only).
+	 * @param item Output parameter for the dequeued item
+	 * @return true if successful, false if queue is empty or the next
+	 *         producer has not finished publishing yet
+	 */
+	bool try_dequeue(T& item) {
+		Cell& cell = m_cells[m_head & kMask];
+		if (cell.sequence.load(std::memory_order_acquire) != m_head + 1) {
+			return false;
+		}
+
+		T* ptr = reinterpret_cast<T*>(&cell.storage);
+		item = std::move(*ptr);
+		ptr->~T();
+
+		// Hand the slot to the producer one lap ahead
+		cell.sequence.store(m_head + Capacity, std::memory_order_release);
+		++m_head;
+		m_headPublished.store(m_head, std::memory_order_relaxed);
+		return true;
+	}
+
+	/**
+	 * Check whether every claimed slot has been consumed (consumer only).
+	 * Unlike empty(), slots claimed by producers that are still writing
+	 * count as not drained even though try_dequeue() cannot return them yet.
+	 */
+	[[nodiscard]] bool drained() const {
+		return m_tail.load(std::memory_order_acquire) == m_head;
+	}
+
+	/**
+	 * Check if the queue is empty (approximate).
+	 * Safe to call from any thread but result may be stale.
+	 */
+	[[nodiscard]] bool empty() const {
+		return size_approx() == 0;
+	}
+
+	/**
+	 * Get approximate size (may be inaccurate due to concurrent access).
+	 * Counts slots claimed by producers that are still being written.
+	 */
+	[[nodiscard]] size_t size_approx() const {
+		const size_t head = m_headPublished.load(std::memory_order_relaxed);
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		return tail > head ? tail - head : 0;
+	}
+
+	/**
+	 * Get the usable capacity of the queue.
+	 */
+	[[nodiscard]] static constexpr size_t capacity() {
+		return Capacity;
+	}
+
+private:
+	static constexpr size_t kMask = Capacity - 1;
+
+	struct Cell {
+		std::atomic<size_t> sequence;
+		alignas(alignof(T)) unsigned char storage[sizeof(T)];
+	};
+
+	/**
+	 * Reserve the cell at the current tail for the calling producer.
+	 * @param position Receives the claimed position
+	 * @return Claimed cell or nullptr if the queue is full
+	 */
+	Cell* Claim(size_t& position) {
+		position = m_tail.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = m_cells[position & kMask];
+			const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+			if (difference == 0) {
+				if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					return &cell;
+				}
+			} else if (difference < 0) {
+				// The consumer has not freed this slot from the previous lap
+				return nullptr;
+			} else {
+				position = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Shared by producers
+	alignas(kCacheLineSize) std::atomic<size_t> m_tail{0};
+
+	// Consumer-owned head, mirrored for size_approx() from other threads
+	alignas(kCacheLineSize) size_t m_head{0};
+	std::atomic<size_t> m_headPublished{0};
+
+	alignas(kCacheLineSize) Cell m_cells[Capacity];
+};
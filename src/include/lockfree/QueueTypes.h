@@ -1,14 +1,21 @@
 #pragma once
 
 #include "socket/SocketTypes.h"
+#include "lockfree/IntrusiveMPSCQueue.h"
 #include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <variant>
 
 class SocketBase;
+struct PooledBuffer;
 
 /**
  * Queue event types for lock-free cross-thread communication.
  *
- * UV thread (producer) -> Game thread (consumer):
+ * UV thread (producer) -> Game thread (consumer), wrapped in EventNode:
  *   - QueuedConnectEvent
  *   - QueuedDataEvent
  *   - QueuedErrorEvent
@@ -16,8 +23,8 @@ class SocketBase;
  *   - QueuedListenEvent
  *   - QueuedIncomingEvent
  *
- * Game thread (producer) -> UV thread (consumer):
- *   - AsyncJob
+ * Any thread (producer) -> UV thread (consumer):
+ *   - AsyncJob, spilled into OverflowJob nodes when the ring is full
  */
 
 struct QueuedConnectEvent {
@@ -27,7 +34,8 @@ struct QueuedConnectEvent {
 
 struct QueuedDataEvent {
 	SocketBase* socket;
-	char* data;         // Heap-allocated, consumer must free
+	PooledBuffer* buffer;   // Owns one reference, consumer must release
+	char* data;             // Points into buffer, length + 1 bytes writable
 	size_t length;
 	RemoteEndpoint sender;
 };
@@ -54,12 +62,117 @@ struct QueuedIncomingEvent {
 };
 
 /**
- * Async job for posting work from game thread to UV thread.
+ * Any UV thread event. Each socket keeps a single queue of these so the
+ * order between connect, data, disconnect and error events is preserved.
  */
-struct AsyncJob {
-	void (*callback)(void* data);
-	void* data;
+using QueuedEvent = std::variant<
+	QueuedConnectEvent,
+	QueuedDisconnectEvent,
+	QueuedListenEvent,
+	QueuedIncomingEvent,
+	QueuedDataEvent,
+	QueuedErrorEvent>;
 
-	AsyncJob() : callback(nullptr), data(nullptr) {}
-	AsyncJob(void (*cb)(void*), void* d) : callback(cb), data(d) {}
+/**
+ * Pooled node carrying one event through a per-socket IntrusiveMPSCQueue.
+ */
+struct EventNode : MPSCNode {
+	QueuedEvent event;
+	EventNode* freeNext = nullptr;
+	// uv_hrtime() when the event was queued, for the latency histograms
+	uint64_t enqueueTime = 0;
+	// Event loop whose pool the node returns to
+	uint8_t loop = 0;
+};
+
+/**
+ * Async job for posting work to the UV thread.
+ *
+ * Move-only callable stored inline, so posting a job never allocates. The
+ * inline capacity fits a socket pointer plus a request or buffer handle;
+ * callables that capture more are rejected at compile time.
+ */
+class AsyncJob {
+public:
+	static constexpr size_t kInlineSize = 4 * sizeof(void*);
+
+	AsyncJob() = default;
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, AsyncJob>>>
+	AsyncJob(F&& callback) {
+		using Callable = std::decay_t<F>;
+		static_assert(sizeof(Callable) <= kInlineSize, "Job captures too much state for inline storage");
+		static_assert(alignof(Callable) <= alignof(std::max_align_t), "Job callable is over-aligned");
+		static_assert(std::is_nothrow_move_constructible_v<Callable>, "Job callable must be nothrow movable");
+
+		new (m_storage) Callable(std::forward<F>(callback));
+		m_ops = &kOps<Callable>;
+	}
+
+	AsyncJob(AsyncJob&& other) noexcept {
+		MoveFrom(other);
+	}
+
+	AsyncJob& operator=(AsyncJob&& other) noexcept {
+		if (this != &other) {
+			Reset();
+			MoveFrom(other);
+		}
+		return *this;
+	}
+
+	AsyncJob(const AsyncJob&) = delete;
+	AsyncJob& operator=(const AsyncJob&) = delete;
+
+	~AsyncJob() {
+		Reset();
+	}
+
+	explicit operator bool() const { return m_ops != nullptr; }
+
+	void operator()() {
+		m_ops->invoke(m_storage);
+	}
+
+	void Reset() {
+		if (m_ops) {
+			m_ops->destroy(m_storage);
+			m_ops = nullptr;
+		}
+	}
+
+private:
+	struct Ops {
+		void (*invoke)(void* storage);
+		void (*move)(void* destination, void* source);
+		void (*destroy)(void* storage);
+	};
+
+	template<typename Callable>
+	static constexpr Ops kOps = {
+		[](void* storage) { (*static_cast<Callable*>(storage))(); },
+		[](void* destination, void* source) {
+			new (destination) Callable(std::move(*static_cast<Callable*>(source)));
+			static_cast<Callable*>(source)->~Callable();
+		},
+		[](void* storage) { static_cast<Callable*>(storage)->~Callable(); },
+	};
+
+	void MoveFrom(AsyncJob& other) {
+		if (other.m_ops) {
+			other.m_ops->move(m_storage, other.m_storage);
+			m_ops = other.m_ops;
+			other.m_ops = nullptr;
+		}
+	}
+
+	alignas(std::max_align_t) unsigned char m_storage[kInlineSize];
+	const Ops* m_ops = nullptr;
+};
+
+/**
+ * Heap node carrying an AsyncJob through the job overflow list.
+ */
+struct OverflowJob : MPSCNode {
+	AsyncJob job;
 };
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "socket/SocketTypes.h"
+#include <uv.h>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Extra listening handles of a server socket with ReusePort set.
+ *
+ * The socket's own handle stays the primary one: it reports the Listen
+ * event and the local endpoint. Every other event loop gets a handle of its
+ * own bound to the same address with SO_REUSEPORT, so the kernel spreads
+ * incoming connections or datagrams across the loops while the plugin
+ * still sees a single socket.
+ *
+ * Thread model:
+ * - Open(): game thread, before the primary handle is created
+ * - Prepare(): primary's loop, before the primary handle binds
+ * - Set(): loop owning the handle, once it listens
+ * - Close(): game thread, closes each handle on its own loop
+ */
+class ListenShards {
+public:
+	ListenShards() = default;
+
+	ListenShards(const ListenShards&) = delete;
+	ListenShards& operator=(const ListenShards&) = delete;
+
+	/**
+	 * Allow the handles of other loops to bind the primary's address.
+	 * @return false where the platform cannot share the port, no shards are
+	 *         opened then and the primary listens alone
+	 */
+	bool Prepare(uv_handle_t* primary);
+
+	[[nodiscard]] bool IsPrepared() const { return m_prepared; }
+
+	/**
+	 * Enable SO_REUSEPORT on a handle that has a descriptor but is not
+	 * bound yet.
+	 */
+	[[nodiscard]] static bool EnableReusePort(uv_handle_t* handle);
+
+	// Allow Set() again after a Close()
+	void Open() { m_closed.store(false, std::memory_order_seq_cst); }
+
+	/**
+	 * Hand over a listening handle of loop index. A handle that arrives
+	 * after Close() is closed right away.
+	 */
+	void Set(size_t index, uv_handle_t* handle, uv_close_cb onClose);
+
+	/**
+	 * Close every handle on the loop it belongs to.
+	 */
+	void Close(uv_close_cb onClose);
+
+private:
+	std::atomic<uv_handle_t*> m_handles[kMaxEventLoops]{};
+	std::atomic<bool> m_closed{false};
+	// Primary got SO_REUSEPORT (primary's loop only)
+	bool m_prepared = false;
+};
@@ -4,8 +4,11 @@
 #include <smsdk_ext.h>
 #include <uv.h>
 #include <string_view>
-#include <queue>
+#include <vector>
 #include <atomic>
+#include <memory>
+
+struct SocketEventQueue;
 
 struct CallbackInfo {
 	IPluginFunction* function = nullptr;
@@ -20,6 +23,9 @@ struct CallbackInfo {
  * - m_options: atomic array for thread-safe option access
  * - m_callbacks: only accessed from game thread
  * - m_pendingOptions: only accessed from game thread (queued) and UV thread (applied)
+ * - m_events: created with the socket, shared with the callback scheduler
+ * - m_loop: set once by SocketManager before the socket is used, all of the
+ *   socket's handles live on that loop
  */
 class SocketBase {
 public:
@@ -39,8 +45,33 @@ public:
 	virtual bool SendTo(std::string_view data, const char* hostname, uint16_t port, bool async = true) = 0;
 	virtual bool SetOption(SocketOption option, int value) = 0;
 
+	/**
+	 * Restart reading after backpressure paused it (stream sockets).
+	 * Called from game thread once the receive backlog has drained.
+	 */
+	virtual void ResumeReceiving() {}
+
+	/**
+	 * Set the message delimiter used by FramingMode::Delimiter (stream sockets).
+	 * Called from game thread, applied on the UV thread.
+	 *
+	 * @return false if the socket has no framing or the delimiter is invalid
+	 */
+	virtual bool SetFrameDelimiter(std::string_view delimiter) { return false; }
+
 	[[nodiscard]] SocketType GetType() const { return m_type; }
 
+	/**
+	 * Event loop owning this socket's handles.
+	 */
+	[[nodiscard]] EventLoop& GetEventLoop() const { return *m_loop; }
+
+	/**
+	 * Assign the owning event loop.
+	 * Called by SocketManager right after construction.
+	 */
+	void SetEventLoop(EventLoop& loop) { m_loop = &loop; }
+
 	CallbackInfo& GetCallback(CallbackEvent event) {
 		return m_callbacks[static_cast<size_t>(event)];
 	}
@@ -57,6 +88,32 @@ public:
 		return 0;
 	}
 
+	/**
+	 * Check if an option is handled by the extension itself rather than
+	 * being a setsockopt() level option.
+	 */
+	[[nodiscard]] static bool IsExtensionOption(SocketOption option) {
+		switch (option) {
+			case SocketOption::ConnectTimeout:
+			case SocketOption::AutoFreeHandle:
+			case SocketOption::DirectDispatch:
+			case SocketOption::BackpressureHigh:
+			case SocketOption::BackpressureLow:
+			case SocketOption::CorkWindow:
+			case SocketOption::UdpSegmentSize:
+			case SocketOption::UdpGro:
+			case SocketOption::ReceiveChunkSize:
+			case SocketOption::FramingMode:
+			case SocketOption::FramingSize:
+			case SocketOption::FramingMaxSize:
+			case SocketOption::WebSocket:
+			case SocketOption::ReusePort:
+				return true;
+			default:
+				return false;
+		}
+	}
+
 	/**
 	 * Check if socket is marked for deletion.
 	 * Thread-safe, used by UV thread to skip callbacks.
@@ -66,13 +123,25 @@ public:
 	}
 
 	/**
-	 * Mark socket as deleted.
-	 * Called from destructor.
+	 * Mark socket as deleted, on the socket and on its event queue.
+	 * Called before the socket is destroyed and from the destructor.
+	 */
+	void MarkDeleted();
+
+	/**
+	 * Queue of events waiting for this socket's callbacks.
+	 * Outlives the socket while the scheduler still references it.
 	 */
-	void MarkDeleted() {
-		m_deleted.store(true, std::memory_order_release);
+	[[nodiscard]] const std::shared_ptr<SocketEventQueue>& GetEventQueue() const {
+		return m_events;
 	}
 
+	/**
+	 * Count messages accepted for sending, for Socket.GetStat.
+	 * Called from game thread.
+	 */
+	void RecordSent(size_t bytes, size_t messages);
+
 	int32_t m_smHandle = 0;
 
 protected:
@@ -101,16 +170,30 @@ protected:
 	 */
 	void ApplyPendingOptions(uv_handle_t* handle);
 
+	/**
+	 * Apply every socket level option set so far from its stored value.
+	 * For the extra handles of a ReusePort listener, which open after the
+	 * primary handle consumed the pending options. Any UV thread.
+	 */
+	void ApplyStoredOptions(uv_handle_t* handle);
+
 	SocketType m_type;
 	CallbackInfo m_callbacks[static_cast<size_t>(CallbackEvent::Count)];
 
-	// Pending options queue (game thread writes, UV thread reads during apply)
-	std::queue<PendingOption> m_pendingOptions;
+	// Pending options queue (game thread writes, UV thread reads during apply).
+	// A vector rather than std::queue: std::deque allocates on construction,
+	// and most sockets never queue an option.
+	std::vector<PendingOption> m_pendingOptions;
 
 	// Atomic deletion flag
 	std::atomic<bool> m_deleted{false};
 
+	std::shared_ptr<SocketEventQueue> m_events;
+
+	EventLoop* m_loop = nullptr;
+
 private:
-	static constexpr size_t kMaxOptions = 32;
+	// Sized to the option set, every socket carries one slot per option
+	static constexpr size_t kMaxOptions = static_cast<size_t>(SocketOption::Count);
 	std::atomic<int> m_options[kMaxOptions]{};
 };
\ No newline at end of file
@@ -1,10 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <functional>
 #include <memory>
-#include <unordered_map>
 #include <uv.h>
 
 #ifdef _WIN32
@@ -23,6 +23,9 @@ class UnixSocket;
 #endif
 class EventLoop;
 
+// Most event loops sockets can be spread across
+constexpr size_t kMaxEventLoops = 8;
+
 enum class SocketType {
 	Tcp = 1,
 	Udp = 2,
@@ -45,6 +48,8 @@ enum class SocketOption {
 	ConcatenateCallbacks = 1,
 	ForceFrameLock = 2,
 	CallbacksPerFrame = 3,
+	CallbackBudgetMode = 19,
+	CallbackTimeSlice = 20,
 	// Socket level options
 	Broadcast = 4,
 	ReuseAddr = 5,
@@ -61,7 +66,45 @@ enum class SocketOption {
 	// Extension options
 	DebugMode = 16,
 	ConnectTimeout = 17,
-	AutoFreeHandle = 18
+	AutoFreeHandle = 18,
+	DirectDispatch = 21,
+	BackpressureHigh = 22,
+	BackpressureLow = 23,
+	CorkWindow = 24,
+	UdpSegmentSize = 25,
+	UdpGro = 26,
+	ReceiveChunkSize = 27,
+	FramingMode = 28,
+	FramingSize = 29,
+	FramingMaxSize = 30,
+	WebSocket = 31,
+	ReusePort = 35,
+	// HTTP client options, extension-wide
+	HttpMaxConnections = 32,
+	HttpPipelineDepth = 33,
+	HttpTimeout = 34,
+	// One past the highest option value, keep last
+	Count = 36
+};
+
+enum class CallbackBudgetMode {
+	Count = 0,      // At most CallbacksPerFrame events per frame
+	TimeSlice = 1,  // As many events as fit in CallbackTimeSlice microseconds
+	Adaptive = 2    // Event count that follows queue depth, capped by the time slice
+};
+
+enum class FramingMode {
+	None = 0,                // Deliver reads as they arrive
+	Fixed = 1,               // Messages of FramingSize bytes
+	PrefixBigEndian = 2,     // FramingSize byte big-endian length, then the message
+	PrefixLittleEndian = 3,  // FramingSize byte little-endian length, then the message
+	Delimiter = 4            // Messages end with the socket's frame delimiter
+};
+
+enum class WebSocketMode {
+	None = 0,    // Plain TCP
+	Text = 1,    // WebSocket, Send() writes text messages
+	Binary = 2   // WebSocket, Send() writes binary messages
 };
 
 enum class CallbackEvent {
@@ -74,6 +117,35 @@ enum class CallbackEvent {
 	Count = 6
 };
 
+enum class SocketGlobalStat {
+	BufferPoolHits = 0,
+	BufferPoolMisses = 1,
+	DroppedEvents = 2,
+	JobQueueOverflows = 3,
+	JobQueueHighWater = 4,
+	SendAllocations = 5,
+	PendingEvents = 6,
+	PendingEventsHighWater = 7,
+	ReadyQueueDepth = 8,
+	ReadyQueueFull = 9,
+	JobQueueDepth = 10,
+	JobQueueDepthHighWater = 11
+};
+
+enum class SocketStat {
+	DroppedEvents = 0,   // Events discarded because the socket's backlog was full
+	ReceivePauses = 1,   // Times reading was paused by backpressure (TCP/Unix)
+	PendingBytes = 2,    // Received bytes waiting for the Receive callback
+	BytesReceived = 3,
+	MessagesReceived = 4,
+	BytesSent = 5,
+	MessagesSent = 6,
+	SendErrors = 7,
+	ReceiveErrors = 8,
+	SendBacklog = 9,     // Bytes accepted by Send/SendTo and not yet written
+	ConnectLatency = 10  // Microseconds the last TCP connect took
+};
+
 struct RemoteEndpoint {
 	std::string address;
 	uint16_t port = 0;
@@ -89,6 +161,7 @@ struct PendingOption {
 };
 
 // Global options (extension-level settings)
+// Written from game thread, read from both threads via atomic access
 class GlobalOptions {
 public:
 	static GlobalOptions& Instance() {
@@ -96,21 +169,38 @@ public:
 		return instance;
 	}
 
-	void Set(SocketOption option, int value) { m_options[option] = value; }
+	void Set(SocketOption option, int value) {
+		size_t index = static_cast<size_t>(option);
+		if (index < kMaxOptions) {
+			m_options[index].store(value, std::memory_order_release);
+		}
+	}
+
 	int Get(SocketOption option) const {
-		auto it = m_options.find(option);
-		return it != m_options.end() ? it->second : GetDefault(option);
+		size_t index = static_cast<size_t>(option);
+		if (index < kMaxOptions) {
+			return m_options[index].load(std::memory_order_acquire);
+		}
+		return 0;
 	}
 
 private:
+	GlobalOptions() {
+		for (size_t i = 0; i < kMaxOptions; ++i) {
+			m_options[i].store(GetDefault(static_cast<SocketOption>(i)), std::memory_order_relaxed);
+		}
+	}
+
 	static int GetDefault(SocketOption option) {
 		switch (option) {
 			case SocketOption::CallbacksPerFrame: return 1;
+			case SocketOption::CallbackTimeSlice: return 1000;
 			default: return 0;
 		}
 	}
 
-	std::unordered_map<SocketOption, int> m_options;
+	static constexpr size_t kMaxOptions = 64;
+	std::atomic<int> m_options[kMaxOptions]{};
 };
 
 inline GlobalOptions& g_GlobalOptions = GlobalOptions::Instance();
\ No newline at end of file
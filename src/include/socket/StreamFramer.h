@@ -0,0 +1,91 @@
+#pragma once
+
+#include "socket/SocketTypes.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SocketBase;
+struct PooledBuffer;
+
+/**
+ * Splits a stream socket's byte stream into messages on the UV thread, so
+ * the Receive callback fires once per complete message.
+ *
+ * Modes (FramingMode option):
+ * - Fixed: every message is FramingSize bytes
+ * - PrefixBigEndian/PrefixLittleEndian: a FramingSize (1, 2 or 4) byte
+ *   length precedes every message, the prefix is not delivered
+ * - Delimiter: messages end with the delimiter (default "\n"), which is
+ *   not delivered
+ *
+ * Messages that lie within one read are delivered in place from the read
+ * slab; messages spanning reads are assembled in a side buffer.
+ *
+ * Thread safety: UV thread only.
+ */
+class StreamFramer {
+public:
+	static constexpr size_t kMaxDelimiterLength = 8;
+	static constexpr size_t kDefaultMaxFrameSize = 65536;
+
+	StreamFramer() = default;
+
+	StreamFramer(const StreamFramer&) = delete;
+	StreamFramer& operator=(const StreamFramer&) = delete;
+
+	/**
+	 * Set the delimiter for Delimiter mode.
+	 * @return false if delimiter is empty or longer than kMaxDelimiterLength
+	 */
+	bool SetDelimiter(const char* delimiter, size_t length);
+
+	/**
+	 * Split one read and enqueue every complete message on socket.
+	 * Takes over the caller's reference on slab, data must point into it.
+	 *
+	 * @return false if a message exceeded FramingMaxSize; an error has been
+	 *         enqueued and the caller should stop reading
+	 */
+	bool Consume(SocketBase* socket, PooledBuffer* slab, char* data, size_t length, const RemoteEndpoint& sender);
+
+	/**
+	 * Check whether socket's options select a framing mode.
+	 */
+	[[nodiscard]] static bool IsEnabled(const SocketBase* socket);
+
+private:
+	struct Config {
+		FramingMode mode;
+		size_t size;
+		size_t maxSize;
+	};
+
+	enum class ParseResult {
+		Complete,
+		NeedMore,
+		TooLarge
+	};
+
+	// Location of one message relative to the start of the parsed bytes
+	struct Frame {
+		size_t offset;   // First message byte
+		size_t length;   // Message bytes
+		size_t end;      // Byte after the message and its trailing delimiter
+	};
+
+	[[nodiscard]] static bool ReadConfig(const SocketBase* socket, Config& config);
+	ParseResult Parse(const Config& config, const char* data, size_t length, Frame& frame) const;
+
+	// Bytes of data needed to complete the message in m_partial, 0 if unknown
+	size_t Missing(const Config& config, const char* data, size_t length, bool& tooLarge) const;
+
+	void EnqueueCopy(SocketBase* socket, const char* data, size_t length, const RemoteEndpoint& sender);
+	void Fail(SocketBase* socket);
+
+	// Start of a message that arrived split across reads
+	std::vector<char> m_partial;
+
+	char m_delimiter[kMaxDelimiterLength] = {'\n'};
+	uint8_t m_delimiterLength = 1;
+};
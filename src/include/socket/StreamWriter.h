@@ -0,0 +1,83 @@
+#pragma once
+
+#include <uv.h>
+#include <atomic>
+#include <cstddef>
+
+struct SendRequest;
+
+/**
+ * Outbound queue for one stream handle (TCP or Unix).
+ *
+ * Sends are queued instead of written one by one and flushed as a single
+ * scatter-gather uv_write, either once the current pass over posted jobs
+ * is done or, with a cork window, when the window's timer fires.
+ *
+ * Thread safety:
+ * - Created, used and destroyed on the UV thread only
+ * - The owning socket holds it in an atomic slot so Disconnect() can
+ *   detach it from the game thread and hand it to a close job
+ */
+class StreamWriter {
+public:
+	/**
+	 * Get the writer for stream, creating it on first use (UV thread).
+	 * @return Writer or nullptr if allocation failed
+	 */
+	static StreamWriter* Attach(std::atomic<StreamWriter*>& slot, uv_stream_t* stream);
+
+	/**
+	 * Queue a request, taking ownership of it (UV thread).
+	 * @param corkMs Cork window in milliseconds, 0 flushes after the current job pass
+	 */
+	void Queue(SendRequest* request, int corkMs);
+
+	/**
+	 * Write everything queued so far (UV thread).
+	 */
+	void Flush();
+
+	/**
+	 * Flush, then release the writer once nothing references it (UV thread).
+	 * Must be called before the stream handle is closed.
+	 */
+	void Close();
+
+	/**
+	 * Drop everything queued and release the writer (UV thread).
+	 * Writes already handed to libuv still complete or get cancelled normally.
+	 */
+	void Discard();
+
+	StreamWriter(const StreamWriter&) = delete;
+	StreamWriter& operator=(const StreamWriter&) = delete;
+
+private:
+	explicit StreamWriter(uv_stream_t* stream) : m_stream(stream) {}
+	~StreamWriter() = default;
+
+	static void OnDeferredFlush(void* data);
+	static void OnCorkTimer(uv_timer_t* timer);
+	static void OnWrite(uv_write_t* request, int status);
+
+	void Shutdown();
+	void ReleaseIfIdle();
+
+	// uv_write copies up to 4 buffers inline and allocates beyond that, so
+	// batches are bounded to keep that allocation small
+	static constexpr size_t kMaxBatch = 64;
+	// Queued bytes at which a cork window is cut short
+	static constexpr size_t kMaxBatchBytes = 64 * 1024;
+
+	uv_stream_t* m_stream;
+
+	// Pending requests, linked through SendRequest::next
+	SendRequest* m_head = nullptr;
+	SendRequest* m_tail = nullptr;
+	size_t m_count = 0;
+	size_t m_bytes = 0;
+
+	uv_timer_t* m_corkTimer = nullptr;
+	bool m_flushDeferred = false;
+	bool m_closed = false;
+};
@@ -1,8 +1,15 @@
 #pragma once
 
 #include "socket/SocketBase.h"
+#include "socket/StreamWriter.h"
+#include "socket/StreamFramer.h"
+#include "socket/WebSocketSession.h"
+#include "socket/ListenShards.h"
+#include "core/BufferPool.h"
 #include <uv.h>
 #include <atomic>
+#include <memory>
+#include <string>
 
 class TcpSocket;
 
@@ -10,7 +17,12 @@ class TcpSocket;
  * TCP socket implementation using libuv.
  *
  * Thread safety:
- * - m_socket, m_acceptor: atomic pointers for lock-free access
+ * - m_socket, m_acceptor: atomic pointers for lock-free access; Disconnect()
+ *   takes m_socket on the UV thread, behind the sends posted before it
+ * - m_writer: outbound queue, created and closed on the UV thread
+ * - m_webSocket: created before the socket is shared with the UV thread
+ *   (Connect) or the game thread (accept), then used on the UV thread
+ * - m_shards: created by Listen() on the game thread, see ListenShards
  * - m_remoteEndpoint: only written from UV thread, read from game thread
  *   (uses atomic_thread_fence for synchronization)
  * - All other state follows SocketBase thread safety model
@@ -29,31 +41,93 @@ public:
 	bool Send(std::string_view data, bool async = true) override;
 	bool SendTo(std::string_view data, const char* hostname, uint16_t port, bool async = true) override;
 	bool SetOption(SocketOption option, int value) override;
+	void ResumeReceiving() override;
+	bool SetFrameDelimiter(std::string_view delimiter) override;
 
-	static TcpSocket* CreateFromAccepted(uv_tcp_t* client);
+	/**
+	 * Set the request target of the WebSocket upgrade (default "/").
+	 * Must be called before Connect.
+	 */
+	bool SetWebSocketPath(std::string_view path);
+
+	static TcpSocket* CreateFromAccepted(uv_tcp_t* client, EventLoop& loop);
+
+	/**
+	 * Process one read through the WebSocket session or the framer (UV
+	 * thread). Takes over the caller's reference on slab, data must point
+	 * into it. The benchmark harness calls this to choose read boundaries.
+	 *
+	 * @return false if the caller should stop reading
+	 */
+	bool ConsumeRead(PooledBuffer* slab, char* data, size_t length);
 
 	[[nodiscard]] RemoteEndpoint GetRemoteEndpoint() const;
 	[[nodiscard]] RemoteEndpoint GetLocalEndpoint() const;
 
 private:
+	friend class WebSocketSession;
+
+	/**
+	 * Connection handle. It outlives the socket until its close callback
+	 * runs, so the read callbacks reach the socket through the event queue
+	 * and only once they know it was not destroyed.
+	 */
+	struct Stream {
+		uv_tcp_t tcp;
+		std::shared_ptr<SocketEventQueue> events;
+	};
+
 	void InitSocket();
 
-	static void OnResolved(uv_getaddrinfo_t* request, int status, struct addrinfo* addressInfo);
+	// Initialized connection handle on loop, events may be set later (UV thread)
+	static uv_tcp_t* NewStream(uv_loop_t* loop, std::shared_ptr<SocketEventQueue> events);
+	// Socket of a connection handle, nullptr once it was destroyed (UV thread)
+	static TcpSocket* FromStream(uv_handle_t* handle);
+
+	// Queue a request on the stream writer, taking ownership of it (UV thread)
+	bool Write(SendRequest* request);
+
+	static void OnBindResolved(void* data, int status, const sockaddr_storage* address);
+	static void OnResolved(void* data, int status, const sockaddr_storage* address);
 	static void OnConnect(uv_connect_t* request, int status);
 	static void OnConnection(uv_stream_t* server, int status);
+	// Bind and listen on loop's SO_REUSEPORT acceptor (that loop's thread)
+	void OpenShard(EventLoop& loop);
 	static void OnAllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer);
 	static void OnRead(uv_stream_t* stream, ssize_t bytesRead, const uv_buf_t* buffer);
-	static void OnWrite(uv_write_t* request, int status);
 	static void OnClose(uv_handle_t* handle);
+	static void OnStreamClose(uv_handle_t* handle);
 	static void OnShutdown(uv_shutdown_t* request, int status);
 	static void OnConnectTimeout(uv_timer_t* timer);
 
 	void StartReceiving();
 	void CancelConnectTimeout();
 
+	// Close frame for an open WebSocket, nullptr otherwise (game thread)
+	SendRequest* CreateCloseFrame();
+	// Queue closeFrame behind the pending sends, flush them, then close the
+	// handle (UV thread). Takes ownership of writer and closeFrame.
+	static void CloseStream(uv_tcp_t* socket, StreamWriter* writer, SendRequest* closeFrame);
+
 	// Atomic socket pointers for lock-free access
 	std::atomic<uv_tcp_t*> m_socket{nullptr};
 	std::atomic<uv_tcp_t*> m_acceptor{nullptr};
+	std::atomic<StreamWriter*> m_writer{nullptr};
+
+	// Read size and message framing state (UV thread only)
+	ReceiveSizer m_receiveSizer;
+	StreamFramer m_framer;
+
+	// Acceptors on the other event loops, null unless ReusePort was set
+	std::unique_ptr<ListenShards> m_shards;
+
+	// WebSocket protocol state, null unless SocketWebSocket was set
+	std::unique_ptr<WebSocketSession> m_webSocket;
+	std::string m_webSocketPath;
+	// Handshake done and no close seen, read by Disconnect() to send a close frame
+	std::atomic<bool> m_webSocketOpen{false};
+	// Disconnect() was called, its job takes the handle (game thread sets)
+	std::atomic<bool> m_closing{false};
 
 	uv_timer_t* m_connectTimer = nullptr;
 	sockaddr_storage m_localAddr{};
@@ -63,8 +137,4 @@ private:
 	// Uses memory fence for synchronization
 	RemoteEndpoint m_remoteEndpoint;
 	std::atomic<bool> m_remoteEndpointSet{false};
-
-	// Receive buffer (TCP is stream-based, smaller buffer is sufficient)
-	static constexpr size_t kRecvBufferSize = 16384;
-	char m_recvBuffer[kRecvBufferSize];
 };
\ No newline at end of file
@@ -1,14 +1,32 @@
 #pragma once
 
 #include "socket/SocketBase.h"
+#include "socket/ListenShards.h"
 #include <uv.h>
 #include <atomic>
+#include <memory>
+
+struct PooledBuffer;
+struct SendRequest;
+struct PendingSends;
+struct DatagramBatch;
+
+/**
+ * One destination of UdpSocket::SendToMany.
+ */
+struct DatagramTarget {
+	const char* host;
+	uint16_t port;
+};
 
 /**
  * UDP socket implementation using libuv.
  *
  * Thread safety:
  * - m_socket: atomic pointer for lock-free access
+ * - m_groPoll: atomic pointer, set on the UV thread, taken by Disconnect()
+ * - m_shards: created by Listen() on the game thread, see ListenShards
+ *   (replies go out through the primary handle, which shares the port)
  * - All other state follows SocketBase thread safety model
  */
 class UdpSocket : public SocketBase {
@@ -26,28 +44,75 @@ public:
 	bool SendTo(std::string_view data, const char* hostname, uint16_t port, bool async = true) override;
 	bool SetOption(SocketOption option, int value) override;
 
+	/**
+	 * Send one payload to many destinations.
+	 * Literal addresses are sent together from a single UV thread job using
+	 * as few system calls as the platform allows; host names are resolved
+	 * and sent one by one as with SendTo.
+	 *
+	 * @return Number of datagrams queued
+	 */
+	size_t SendToMany(std::string_view data, const DatagramTarget* targets, size_t count);
+
 	[[nodiscard]] RemoteEndpoint GetLocalEndpoint() const;
 
 private:
 	void InitSocket(int addressFamily = AF_INET);
 
 	void StartReceiving();
+	// Bind and receive on loop's SO_REUSEPORT handle (that loop's thread)
+	void OpenShard(EventLoop& loop);
 
 	static void OnAllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer);
+	static PooledBuffer* CopyDatagram(const char* data, size_t length);
+	// Move a small datagram out of its 64 KiB receive slab
+	static void CompactDatagram(PooledBuffer*& slab, char*& data, size_t length);
 	static void OnRecv(uv_udp_t* handle, ssize_t bytesRead, const uv_buf_t* buffer,
 					   const struct sockaddr* senderAddress, unsigned flags);
 	static void OnSend(uv_udp_send_t* request, int status);
+	static void OnBindResolved(void* data, int status, const sockaddr_storage* address);
+	static void OnConnectResolved(void* data, int status, const sockaddr_storage* address);
+	static void OnSendToResolved(void* data, int status, const sockaddr_storage* address);
+	static void SendBatch(DatagramBatch* batch);
+	static size_t TrySendBatch(uv_udp_t* handle, DatagramBatch& batch);
+	static void OnBatchSend(uv_udp_send_t* request, int status);
+
+	// Send request to destination, splitting it by UdpSegmentSize (UV thread)
+	void Transmit(uv_udp_t* handle, SendRequest* request, const sockaddr_storage& destination);
+	void TransmitSegments(uv_udp_t* handle, SendRequest* request, const sockaddr_storage& destination, size_t segmentSize);
+
+	// One uv_udp_send per datagram, reporting the first failure once
+	template<typename BufferAt, typename DestinationAt>
+	static void SendAll(uv_udp_t* handle, PendingSends* pending, size_t count, BufferAt bufferAt, DestinationAt destinationAt);
+
+	static void CloseGroPoll(uv_poll_t* poll);
+
+#ifdef __linux__
+	// UDP_SEGMENT send, returns the number of bytes the kernel took
+	size_t TrySendSegments(uv_udp_t* handle, SendRequest& request, const sockaddr_storage& destination, size_t segmentSize);
+	bool StartGroReceiving(uv_udp_t* handle);
+	static void OnGroReadable(uv_poll_t* poll, int status, int events);
+
+	// Kernel limits for one UDP_SEGMENT send
+	static constexpr size_t kMaxGsoSegments = 64;
+	static constexpr size_t kMaxGsoBytes = 65000;
+	// Coalesced reads per readable event before yielding to the loop
+	static constexpr int kMaxGroReads = 16;
+#endif
 	static void OnClose(uv_handle_t* handle);
 
 	// Atomic socket pointer for lock-free access
 	std::atomic<uv_udp_t*> m_socket{nullptr};
+	std::atomic<uv_poll_t*> m_groPoll{nullptr};
+
+	// Receive handles on the other event loops, null unless ReusePort was set
+	std::unique_ptr<ListenShards> m_shards;
+
+	// UDP_SEGMENT was rejected, segment in user space from now on (UV thread)
+	bool m_gsoUnsupported = false;
 
 	sockaddr_storage m_localAddr{};
 	sockaddr_storage m_connectedAddr{};
 	bool m_localAddrSet = false;
 	std::atomic<bool> m_isConnected{false};
-
-	// Receive buffer (UDP datagrams can be up to 65535 bytes)
-	static constexpr size_t kRecvBufferSize = 65536;
-	char m_recvBuffer[kRecvBufferSize];
 };
\ No newline at end of file
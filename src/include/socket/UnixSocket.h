@@ -3,16 +3,22 @@
 #ifndef _WIN32
 
 #include "socket/SocketBase.h"
+#include "socket/StreamWriter.h"
+#include "socket/StreamFramer.h"
+#include "core/BufferPool.h"
 #include <uv.h>
 #include <atomic>
+#include <memory>
 #include <string>
 
 /**
  * Unix domain socket implementation using libuv pipes.
  *
  * Thread safety:
- * - m_pipe: atomic pointer for lock-free access
+ * - m_pipe: atomic pointer for lock-free access; Disconnect() takes it on
+ *   the UV thread, behind the sends posted before it
  * - m_acceptor: atomic pointer for server socket
+ * - m_writer: outbound queue, created and closed on the UV thread
  * - All other state follows SocketBase thread safety model
  *
  * Note: Unix sockets are not available on Windows.
@@ -31,36 +37,59 @@ public:
 	bool Send(std::string_view data, bool async = true) override;
 	bool SendTo(std::string_view data, const char* hostname, uint16_t port, bool async = true) override;
 	bool SetOption(SocketOption option, int value) override;
+	void ResumeReceiving() override;
+	bool SetFrameDelimiter(std::string_view delimiter) override;
 
 	[[nodiscard]] std::string GetPath() const { return m_path; }
 
 	/**
 	 * Create a UnixSocket from an accepted client handle.
-	 * Called from UV thread during OnConnection.
+	 * Called from UV thread during OnConnection, stays on the listener's loop.
 	 */
-	static UnixSocket* CreateFromAccepted(uv_pipe_t* clientHandle, const std::string& path);
+	static UnixSocket* CreateFromAccepted(uv_pipe_t* clientHandle, const std::string& path, EventLoop& loop);
 
 private:
+	/**
+	 * Connection pipe. It outlives the socket until its close callback
+	 * runs, so the read callbacks reach the socket through the event queue
+	 * and only once they know it was not destroyed.
+	 */
+	struct Stream {
+		uv_pipe_t pipe;
+		std::shared_ptr<SocketEventQueue> events;
+	};
+
 	void InitPipe();
 
+	// Initialized connection pipe on loop, events may be set later (UV thread)
+	static uv_pipe_t* NewStream(uv_loop_t* loop, std::shared_ptr<SocketEventQueue> events);
+	// Socket of a connection pipe, nullptr once it was destroyed (UV thread)
+	static UnixSocket* FromStream(uv_handle_t* handle);
+
 	void StartReading();
+	// Flush writer, then close the connection pipe (UV thread). Takes ownership of both.
+	static void ClosePipe(uv_pipe_t* pipe, StreamWriter* writer);
+	static void CloseAcceptor(uv_pipe_t* acceptor);
 
 	static void OnAllocBuffer(uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer);
 	static void OnRead(uv_stream_t* stream, ssize_t bytesRead, const uv_buf_t* buffer);
-	static void OnWrite(uv_write_t* request, int status);
 	static void OnConnect(uv_connect_t* request, int status);
 	static void OnConnection(uv_stream_t* server, int status);
 	static void OnClose(uv_handle_t* handle);
+	static void OnStreamClose(uv_handle_t* handle);
 
 	// Atomic pipe pointers for lock-free access
 	std::atomic<uv_pipe_t*> m_pipe{nullptr};
 	std::atomic<uv_pipe_t*> m_acceptor{nullptr};
+	std::atomic<StreamWriter*> m_writer{nullptr};
+	// Disconnect() was called, its job takes the pipe (game thread sets)
+	std::atomic<bool> m_closing{false};
 
-	std::string m_path;
+	// Read size and message framing state (UV thread only)
+	ReceiveSizer m_receiveSizer;
+	StreamFramer m_framer;
 
-	// Receive buffer (Unix sockets are stream-based like TCP)
-	static constexpr size_t kRecvBufferSize = 16384;
-	char m_recvBuffer[kRecvBufferSize];
+	std::string m_path;
 };
 
 #endif // _WIN32
\ No newline at end of file
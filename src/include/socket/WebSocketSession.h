@@ -0,0 +1,162 @@
+#pragma once
+
+#include "socket/SocketTypes.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class TcpSocket;
+struct PooledBuffer;
+struct SendRequest;
+
+/**
+ * WebSocket (RFC 6455) protocol state of one TCP connection.
+ *
+ * Runs the opening handshake, parses and unmasks frames, reassembles
+ * fragmented messages and answers pings on the UV thread, so the Receive
+ * callback fires once per complete text or binary message. Outgoing
+ * messages are framed on the game thread by TcpSocket::Send.
+ *
+ * Messages that arrive within one read are delivered in place from the
+ * read slab; messages spanning reads or fragments are assembled in a side
+ * buffer. Extensions and subprotocols are not negotiated.
+ *
+ * Thread safety: created before the socket is published to the other
+ * thread, then used on the UV thread only. EncodeFrame() is thread-safe.
+ */
+class WebSocketSession {
+public:
+	enum class Role {
+		Client,
+		Server
+	};
+
+	enum Opcode : uint8_t {
+		Continuation = 0x0,
+		Text = 0x1,
+		Binary = 0x2,
+		Close = 0x8,
+		Ping = 0x9,
+		Pong = 0xA
+	};
+
+	// Largest frame header: 2 bytes, 8 byte extended length, 4 byte mask
+	static constexpr size_t kMaxHeaderSize = 14;
+	static constexpr size_t kDefaultMaxMessageSize = 65536;
+	static constexpr uint16_t kCloseNormal = 1000;
+
+	/**
+	 * @param host Host header sent by a client (ignored for servers)
+	 * @param path Request target sent by a client (ignored for servers)
+	 */
+	WebSocketSession(Role role, std::string host, std::string path);
+	~WebSocketSession();
+
+	WebSocketSession(const WebSocketSession&) = delete;
+	WebSocketSession& operator=(const WebSocketSession&) = delete;
+
+	[[nodiscard]] Role GetRole() const { return m_role; }
+	[[nodiscard]] bool IsOpen() const { return m_state == State::Open; }
+
+	/**
+	 * Send the client's upgrade request once TCP is connected (UV thread).
+	 * @return false if the request could not be queued
+	 */
+	bool Start(TcpSocket* socket);
+
+	/**
+	 * Keep a send back until the handshake completes (UV thread).
+	 * Takes ownership of request.
+	 */
+	void Hold(SendRequest* request);
+
+	/**
+	 * Process one read. Takes over the caller's reference on slab, data
+	 * must point into it.
+	 *
+	 * @return false if the connection failed or was closed; the matching
+	 *         event has been enqueued and the caller should stop reading
+	 */
+	bool Consume(TcpSocket* socket, PooledBuffer* slab, char* data, size_t length, const RemoteEndpoint& sender);
+
+	/**
+	 * Size of a frame carrying length payload bytes.
+	 */
+	[[nodiscard]] static size_t FrameSize(size_t length, bool masked);
+
+	/**
+	 * Write a complete, unfragmented frame to out, which must hold
+	 * FrameSize(length, masked) bytes. Masked frames use a random key.
+	 */
+	static void EncodeFrame(char* out, Opcode opcode, const char* payload, size_t length, bool masked);
+
+private:
+	enum class State : uint8_t {
+		Handshaking,
+		Open,
+		Closed
+	};
+
+	// In-place message waiting for the bytes after it to be parsed
+	struct Pending {
+		char* data;
+		size_t length;
+	};
+
+	bool ConsumeHandshake(TcpSocket* socket, const char* data, size_t length, size_t& consumed, const RemoteEndpoint& sender);
+	bool AcceptRequest(TcpSocket* socket, std::string_view request);
+	bool AcceptResponse(TcpSocket* socket, std::string_view response, const RemoteEndpoint& sender);
+	void Open(TcpSocket* socket);
+
+	// Bytes of the header being received, as far as they are known yet
+	[[nodiscard]] size_t HeaderSize() const;
+	// Parse m_header, returns false on a protocol violation
+	bool ParseHeader(size_t maxMessageSize, const char*& error, uint16_t& closeCode);
+	bool FinishFrame(TcpSocket* socket, const RemoteEndpoint& sender);
+
+	void FlushPending(TcpSocket* socket, PooledBuffer* slab, const RemoteEndpoint& sender);
+	void EnqueueMessage(TcpSocket* socket, const RemoteEndpoint& sender);
+
+	bool SendControl(TcpSocket* socket, Opcode opcode, const char* payload, size_t length);
+	bool SendRaw(TcpSocket* socket, std::string_view data);
+	void Fail(TcpSocket* socket, uint16_t closeCode, const char* error);
+
+	Role m_role;
+	State m_state = State::Handshaking;
+
+	// Client: Host header and request target, then the expected accept key
+	std::string m_host;
+	std::string m_path;
+	std::string m_accept;
+
+	// Handshake bytes received so far
+	std::string m_handshake;
+
+	// Sends made before the handshake completed
+	std::vector<SendRequest*> m_held;
+
+	// Frame being received
+	char m_header[kMaxHeaderSize];
+	uint8_t m_headerLength = 0;
+	bool m_inPayload = false;
+	bool m_fin = false;
+	bool m_masked = false;
+	uint8_t m_opcode = 0;
+	uint8_t m_mask[4] = {};
+	uint64_t m_payloadLength = 0;
+	uint64_t m_payloadReceived = 0;
+
+	// Message spanning reads or fragments, and its opcode (0 if none)
+	std::vector<char> m_message;
+	uint8_t m_messageOpcode = 0;
+
+	// Payload of the control frame being received (at most 125 bytes)
+	char m_control[125];
+
+	bool m_closeSent = false;
+
+	Pending m_pending{};
+	bool m_hasPending = false;
+};
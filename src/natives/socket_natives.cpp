@@ -3,12 +3,18 @@
 #include "socket/SocketBase.h"
 #include "socket/TcpSocket.h"
 #include "socket/UdpSocket.h"
+#include "socket/StreamFramer.h"
 #ifndef _WIN32
 #include "socket/UnixSocket.h"
 #endif
 #include "core/SocketManager.h"
+#include "core/CallbackManager.h"
+#include "core/EventLoop.h"
+#include "core/BufferPool.h"
+#include "core/HttpClient.h"
 #include <cstring>
 #include <string_view>
+#include <vector>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -145,7 +151,11 @@ static cell_t SocketSend(IPluginContext* context, const cell_t* params) {
 
 	if (!socket->IsOpen()) return context->ThrowNativeError("Can't send, socket is not connected");
 
-	return socket->Send(data);
+	if (!socket->Send(data)) {
+		return 0;
+	}
+	socket->RecordSent(data.size(), 1);
+	return 1;
 }
 
 static cell_t SocketSendTo(IPluginContext* context, const cell_t* params) {
@@ -168,7 +178,50 @@ static cell_t SocketSendTo(IPluginContext* context, const cell_t* params) {
 	char* hostname = nullptr;
 	context->LocalToString(params[4], &hostname);
 
-	return socket->SendTo(data, hostname, static_cast<uint16_t>(params[5]));
+	if (!socket->SendTo(data, hostname, static_cast<uint16_t>(params[5]))) {
+		return 0;
+	}
+	socket->RecordSent(data.size(), 1);
+	return 1;
+}
+
+static cell_t SocketSendToMany(IPluginContext* context, const cell_t* params) {
+	SocketBase* socket = GetSocket(context, params[1]);
+	if (!socket) return 0;
+
+	if (socket->GetType() != SocketType::Udp)
+		return context->ThrowNativeError("This native only supports UDP sockets");
+
+	char* rawData = nullptr;
+	context->LocalToString(params[2], &rawData);
+
+	std::string_view data;
+	if (params[3] == -1) {
+		data = rawData;
+	} else {
+		data = std::string_view(rawData, params[3]);
+	}
+
+	cell_t count = params[6];
+	if (count < 0)
+		return context->ThrowNativeError("Invalid destination count %d", count);
+
+	cell_t* hosts = nullptr;
+	cell_t* ports = nullptr;
+	context->LocalToPhysAddr(params[4], &hosts);
+	context->LocalToPhysAddr(params[5], &ports);
+
+	std::vector<DatagramTarget> targets(static_cast<size_t>(count));
+	for (cell_t i = 0; i < count; ++i) {
+		// Each cell of a string array holds the offset of its string from that cell
+		char* host = nullptr;
+		context->LocalToString(params[4] + i * sizeof(cell_t) + hosts[i], &host);
+		targets[i] = DatagramTarget{host, static_cast<uint16_t>(ports[i])};
+	}
+
+	size_t queued = static_cast<UdpSocket*>(socket)->SendToMany(data, targets.data(), targets.size());
+	socket->RecordSent(data.size() * queued, queued);
+	return static_cast<cell_t>(queued);
 }
 
 static cell_t SocketSetOption(IPluginContext* context, const cell_t* params) {
@@ -178,7 +231,12 @@ static cell_t SocketSetOption(IPluginContext* context, const cell_t* params) {
 		case SocketOption::ConcatenateCallbacks:
 		case SocketOption::ForceFrameLock:
 		case SocketOption::CallbacksPerFrame:
+		case SocketOption::CallbackBudgetMode:
+		case SocketOption::CallbackTimeSlice:
 		case SocketOption::DebugMode:
+		case SocketOption::HttpMaxConnections:
+		case SocketOption::HttpPipelineDepth:
+		case SocketOption::HttpTimeout:
 			g_GlobalOptions.Set(option, params[3]);
 			return true;
 		default:
@@ -191,6 +249,65 @@ static cell_t SocketSetOption(IPluginContext* context, const cell_t* params) {
 	return socket->SetOption(option, params[3]);
 }
 
+static cell_t SocketSetFrameDelimiter(IPluginContext* context, const cell_t* params) {
+	SocketBase* socket = GetSocket(context, params[1]);
+	if (!socket) return 0;
+
+	if (socket->GetType() == SocketType::Udp) return context->ThrowNativeError("SetFrameDelimiter only works for stream sockets");
+
+	char* delimiter = nullptr;
+	context->LocalToString(params[2], &delimiter);
+
+	size_t length = strlen(delimiter);
+	if (length == 0 || length > StreamFramer::kMaxDelimiterLength) {
+		return context->ThrowNativeError("Delimiter must be 1 to %d characters", static_cast<int>(StreamFramer::kMaxDelimiterLength));
+	}
+
+	return socket->SetFrameDelimiter(std::string_view(delimiter, length));
+}
+
+static cell_t SocketSetWebSocketPath(IPluginContext* context, const cell_t* params) {
+	SocketBase* socket = GetSocket(context, params[1]);
+	if (!socket) return 0;
+
+	if (socket->GetType() != SocketType::Tcp) return context->ThrowNativeError("SetWebSocketPath only works for TCP sockets");
+
+	if (socket->IsOpen()) return context->ThrowNativeError("Socket is already open");
+
+	char* path = nullptr;
+	context->LocalToString(params[2], &path);
+
+	return static_cast<TcpSocket*>(socket)->SetWebSocketPath(path);
+}
+
+static cell_t SocketHttpRequest(IPluginContext* context, const cell_t* params) {
+	char* method = nullptr;
+	char* url = nullptr;
+	char* headers = nullptr;
+	char* rawBody = nullptr;
+	context->LocalToString(params[1], &method);
+	context->LocalToString(params[2], &url);
+	context->LocalToString(params[5], &headers);
+	context->LocalToString(params[6], &rawBody);
+
+	IPluginFunction* callback = context->GetFunctionById(params[3]);
+	if (!callback) return context->ThrowNativeError("Invalid callback function");
+
+	std::string_view body;
+	if (params[7] == -1) {
+		body = rawBody;
+	} else {
+		body = std::string_view(rawBody, params[7]);
+	}
+
+	const char* error = nullptr;
+	if (!g_HttpClient.Request(method, url, headers, body, callback, params[4], error)) {
+		if (error) return context->ThrowNativeError("%s", error);
+		return false;
+	}
+	return true;
+}
+
 static cell_t SocketSetReceiveCallback(IPluginContext* context, const cell_t* params) {
 	SocketBase* socket = GetSocket(context, params[1]);
 	if (!socket) return 0;
@@ -316,6 +433,119 @@ static cell_t SocketGetLocalPort(IPluginContext* context, const cell_t* params)
 	return endpoint.port;
 }
 
+static cell_t SocketGetGlobalStat(IPluginContext* context, const cell_t* params) {
+	auto stat = static_cast<SocketGlobalStat>(params[1]);
+
+	switch (stat) {
+		case SocketGlobalStat::BufferPoolHits: {
+			uint64_t hits = 0;
+			for (const ReceivePools& pools : g_ReceivePools) {
+				hits += pools.GetHits();
+			}
+			return static_cast<cell_t>(hits);
+		}
+		case SocketGlobalStat::BufferPoolMisses: {
+			uint64_t misses = 0;
+			for (const ReceivePools& pools : g_ReceivePools) {
+				misses += pools.GetMisses();
+			}
+			return static_cast<cell_t>(misses);
+		}
+		case SocketGlobalStat::DroppedEvents:
+			return static_cast<cell_t>(g_CallbackManager.GetDroppedEvents());
+		case SocketGlobalStat::JobQueueOverflows: {
+			uint64_t overflows = 0;
+			for (size_t i = 0; i < g_EventLoops.GetCount(); ++i) {
+				overflows += g_EventLoops.Get(i).GetOverflowCount();
+			}
+			return static_cast<cell_t>(overflows);
+		}
+		case SocketGlobalStat::JobQueueHighWater: {
+			// Deepest backlog of any loop
+			size_t highWater = 0;
+			for (size_t i = 0; i < g_EventLoops.GetCount(); ++i) {
+				size_t loopHighWater = g_EventLoops.Get(i).GetOverflowHighWater();
+				if (loopHighWater > highWater) {
+					highWater = loopHighWater;
+				}
+			}
+			return static_cast<cell_t>(highWater);
+		}
+		case SocketGlobalStat::SendAllocations: {
+			uint64_t allocations = 0;
+			for (size_t i = 0; i < g_EventLoops.GetCount(); ++i) {
+				allocations += g_EventLoops.Get(i).GetSendPool().GetAllocations();
+			}
+			return static_cast<cell_t>(allocations);
+		}
+		case SocketGlobalStat::PendingEvents:
+			return static_cast<cell_t>(g_CallbackManager.GetPendingCount());
+		case SocketGlobalStat::PendingEventsHighWater:
+			return static_cast<cell_t>(g_CallbackManager.GetPendingHighWater());
+		case SocketGlobalStat::ReadyQueueDepth:
+			return static_cast<cell_t>(g_CallbackManager.GetReadyQueueDepth());
+		case SocketGlobalStat::ReadyQueueFull:
+			return static_cast<cell_t>(g_CallbackManager.GetReadyQueueFull());
+		case SocketGlobalStat::JobQueueDepth: {
+			size_t depth = 0;
+			for (size_t i = 0; i < g_EventLoops.GetCount(); ++i) {
+				depth += g_EventLoops.Get(i).GetJobQueueDepth();
+			}
+			return static_cast<cell_t>(depth);
+		}
+		case SocketGlobalStat::JobQueueDepthHighWater: {
+			size_t highWater = 0;
+			for (size_t i = 0; i < g_EventLoops.GetCount(); ++i) {
+				size_t loopHighWater = g_EventLoops.Get(i).GetJobQueueHighWater();
+				if (loopHighWater > highWater) {
+					highWater = loopHighWater;
+				}
+			}
+			return static_cast<cell_t>(highWater);
+		}
+		default:
+			return context->ThrowNativeError("Invalid stat %d", params[1]);
+	}
+}
+
+static cell_t SocketGetStat(IPluginContext* context, const cell_t* params) {
+	SocketBase* socket = GetSocket(context, params[1]);
+	if (!socket) return 0;
+
+	const SocketEventQueue& queue = *socket->GetEventQueue();
+	auto stat = static_cast<SocketStat>(params[2]);
+
+	switch (stat) {
+		case SocketStat::DroppedEvents:
+			return static_cast<cell_t>(queue.droppedEvents.load(std::memory_order_relaxed));
+		case SocketStat::ReceivePauses:
+			return static_cast<cell_t>(queue.receivePauses.load(std::memory_order_relaxed));
+		case SocketStat::PendingBytes:
+			return static_cast<cell_t>(queue.pendingBytes.load(std::memory_order_relaxed));
+		case SocketStat::BytesReceived:
+			return static_cast<cell_t>(queue.bytesReceived.load(std::memory_order_relaxed));
+		case SocketStat::MessagesReceived:
+			return static_cast<cell_t>(queue.messagesReceived.load(std::memory_order_relaxed));
+		case SocketStat::BytesSent:
+			return static_cast<cell_t>(queue.bytesSent.load(std::memory_order_relaxed));
+		case SocketStat::MessagesSent:
+			return static_cast<cell_t>(queue.messagesSent.load(std::memory_order_relaxed));
+		case SocketStat::SendErrors:
+			return static_cast<cell_t>(queue.sendErrors.load(std::memory_order_relaxed));
+		case SocketStat::ReceiveErrors:
+			return static_cast<cell_t>(queue.receiveErrors.load(std::memory_order_relaxed));
+		case SocketStat::SendBacklog: {
+			// Requests released by the UV thread may briefly run ahead of Acquire's count
+			int64_t backlog = queue.sendBacklog.load(std::memory_order_relaxed);
+			return static_cast<cell_t>(backlog > 0 ? backlog : 0);
+		}
+		case SocketStat::ConnectLatency:
+			return static_cast<cell_t>(queue.connectLatency.load(std::memory_order_relaxed));
+		default:
+			return context->ThrowNativeError("Invalid stat %d", params[2]);
+	}
+}
+
 extern const sp_nativeinfo_t socket_natives[] = {
 	{"Socket.Socket",                   SocketCreate},
 	{"Socket.Bind",                     SocketBind},
@@ -325,7 +555,11 @@ extern const sp_nativeinfo_t socket_natives[] = {
 	{"Socket.Listen",                   SocketListen},
 	{"Socket.Send",                     SocketSend},
 	{"Socket.SendTo",                   SocketSendTo},
+	{"Socket.SendToMany",               SocketSendToMany},
 	{"Socket.SetOption",                SocketSetOption},
+	{"Socket.SetFrameDelimiter",        SocketSetFrameDelimiter},
+	{"Socket.SetWebSocketPath",         SocketSetWebSocketPath},
+	{"Socket.HttpRequest",              SocketHttpRequest},
 	{"Socket.SetReceiveCallback",       SocketSetReceiveCallback},
 	{"Socket.SetDisconnectCallback",    SocketSetDisconnectCallback},
 	{"Socket.SetErrorCallback",         SocketSetErrorCallback},
@@ -335,6 +569,8 @@ extern const sp_nativeinfo_t socket_natives[] = {
 	{"Socket.GetHostName",              SocketGetHostName},
 	{"Socket.GetLocalAddress",          SocketGetLocalAddress},
 	{"Socket.GetLocalPort",             SocketGetLocalPort},
+	{"Socket.GetStat",                  SocketGetStat},
+	{"Socket.GetGlobalStat",            SocketGetGlobalStat},
 	{"Socket.Connected.get",            SocketIsConnected},
 	{nullptr,                           nullptr},
 };
\ No newline at end of file